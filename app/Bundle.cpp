@@ -0,0 +1,343 @@
+#include "Bundle.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <streambuf>
+#include <string_view>
+#include <unordered_map>
+
+#include <SDL.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Config.hpp"
+#include "Metrics.hpp"
+
+//===========================================================================//
+//=== Mapping ===============================================================//
+//===========================================================================//
+
+namespace {
+
+/// Read-only view of a whole file.
+class Mapping
+{
+  const char* mData;
+  size_t mSize;
+#ifdef _WIN32
+  HANDLE mFile;
+  HANDLE mView;
+#endif
+
+public:
+  explicit Mapping(const std::string& aPath);
+
+  Mapping(const Mapping& aOther) = delete;
+  Mapping& operator=(const Mapping& aOther) = delete;
+  ~Mapping();
+
+  std::string_view GetData() const { return { mData, mSize }; }
+};
+
+#ifdef _WIN32
+
+Mapping::Mapping(const std::string& aPath)
+  : mData(nullptr)
+  , mSize(0)
+  , mView(nullptr)
+{
+  mFile = CreateFileA(aPath.c_str(),
+                      GENERIC_READ,
+                      FILE_SHARE_READ,
+                      nullptr,
+                      OPEN_EXISTING,
+                      FILE_ATTRIBUTE_NORMAL,
+                      nullptr);
+  if (mFile == INVALID_HANDLE_VALUE)
+    throw std::runtime_error("Cannot open " + aPath);
+
+  LARGE_INTEGER size;
+  if (GetFileSizeEx(mFile, &size))
+    mView = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+  if (mView)
+    mData = static_cast<const char*>(
+      MapViewOfFile(mView, FILE_MAP_READ, 0, 0, 0));
+
+  if (!mData) {
+    DWORD error = GetLastError();
+    if (mView)
+      CloseHandle(mView);
+    CloseHandle(mFile);
+    throw std::runtime_error("Cannot map " + aPath + " (error " +
+                             std::to_string(error) + ")");
+  }
+
+  mSize = static_cast<size_t>(size.QuadPart);
+}
+
+Mapping::~Mapping()
+{
+  UnmapViewOfFile(mData);
+  CloseHandle(mView);
+  CloseHandle(mFile);
+}
+
+#else
+
+Mapping::Mapping(const std::string& aPath)
+  : mData(nullptr)
+  , mSize(0)
+{
+  int fd = open(aPath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    throw std::runtime_error(aPath + ": " + strerror(errno));
+
+  struct stat info;
+  int error = 0;
+  if (fstat(fd, &info) != 0)
+    error = errno;
+  else if (info.st_size == 0)
+    error = EINVAL;
+
+  if (error) {
+    close(fd);
+    throw std::runtime_error(aPath + ": " + strerror(error));
+  }
+
+  mSize = static_cast<size_t>(info.st_size);
+  void* data = mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+  error = errno;
+  close(fd);
+
+  if (data == MAP_FAILED)
+    throw std::runtime_error(aPath + ": " + strerror(error));
+
+#ifdef MADV_WILLNEED
+  // Start reading now so the first frames do not fault on every page.
+  madvise(data, mSize, MADV_WILLNEED);
+#endif
+
+  mData = static_cast<const char*>(data);
+}
+
+Mapping::~Mapping()
+{
+  munmap(const_cast<char*>(mData), mSize);
+}
+
+#endif
+
+}
+
+//===========================================================================//
+//=== Index =================================================================//
+//===========================================================================//
+
+namespace {
+
+class Bundle
+{
+  Mapping mMapping;
+  /// Both point into the mapping.
+  std::unordered_map<std::string_view, std::string_view> mLinks;
+  std::unordered_map<std::string_view, std::string_view> mMasterIds;
+
+public:
+  explicit Bundle(const std::string& aPath)
+    : mMapping(aPath)
+  {
+    std::string_view file = mMapping.GetData();
+    BundleHeader header;
+
+    if (file.size() < sizeof(header))
+      throw std::runtime_error(aPath + ": not a bundle");
+
+    memcpy(&header, file.data(), sizeof(header));
+    header = BundleOrder(header);
+    if (memcmp(header.Magic, BundleMagic, sizeof(BundleMagic)) != 0)
+      throw std::runtime_error(aPath + ": not a bundle");
+    if (header.Version != BundleVersion)
+      throw std::runtime_error(aPath + ": unsupported version");
+    if (header.IndexOffset > file.size() ||
+        header.IndexSize > file.size() - header.IndexOffset)
+      throw std::runtime_error(aPath + ": truncated");
+
+    // Every entry is checked so a bad file cannot read past the mapping.
+    std::string_view index = file.substr(header.IndexOffset, header.IndexSize);
+    for (uint32_t i = 0; i < header.Count; ++i) {
+      BundleEntry entry;
+      if (index.size() < sizeof(entry))
+        throw std::runtime_error(aPath + ": truncated index");
+
+      memcpy(&entry, index.data(), sizeof(entry));
+      entry = BundleOrder(entry);
+      index.remove_prefix(sizeof(entry));
+
+      if (uint64_t(entry.LinkSize) + entry.MasterIdSize > index.size() ||
+          entry.Offset > header.IndexOffset ||
+          entry.Size > header.IndexOffset - entry.Offset)
+        throw std::runtime_error(aPath + ": corrupt index");
+
+      std::string_view data = file.substr(entry.Offset, entry.Size);
+      mLinks.emplace(index.substr(0, entry.LinkSize), data);
+      index.remove_prefix(entry.LinkSize);
+
+      if (entry.MasterIdSize > 0)
+        mMasterIds.emplace(index.substr(0, entry.MasterIdSize), data);
+      index.remove_prefix(entry.MasterIdSize);
+    }
+  }
+
+  size_t GetCount() const { return mLinks.size(); }
+
+  std::optional<std::string_view> Find(std::string_view aLink) const
+  {
+    auto it = mLinks.find(aLink);
+    if (it != mLinks.end())
+      return it->second;
+
+    // The path of an image link names the master at some depth.
+    size_t start = aLink.find("://");
+    start = aLink.find('/', (start == aLink.npos) ? 0 : start + 3);
+    std::string_view path = aLink.substr(std::min(start, aLink.size()));
+    path = path.substr(0, path.find_first_of("?#"));
+
+    while (!path.empty()) {
+      path.remove_prefix(1);
+      std::string_view segment = path.substr(0, path.find('/'));
+      path.remove_prefix(segment.size());
+
+      auto it = mMasterIds.find(segment);
+      if (it != mMasterIds.end())
+        return it->second;
+    }
+
+    return std::nullopt;
+  }
+};
+
+}
+
+//===========================================================================//
+//=== Stream ================================================================//
+//===========================================================================//
+
+namespace {
+
+/// Exposes a slice of the mapping as the get area without copying it.
+class BundleBuffer : public std::streambuf
+{
+  /// Keeps the mapping alive.
+  std::shared_ptr<const Bundle> mOwner;
+
+public:
+  BundleBuffer(std::shared_ptr<const Bundle> aOwner, std::string_view aData)
+    : mOwner(std::move(aOwner))
+  {
+    // The get area is never written through.
+    char* base = const_cast<char*>(aData.data());
+    setg(base, base, base + aData.size());
+  }
+
+protected:
+  pos_type seekoff(off_type aOffset,
+                   std::ios_base::seekdir aDirection,
+                   std::ios_base::openmode) override
+  {
+    off_type target = aOffset;
+    if (aDirection == std::ios_base::cur)
+      target += gptr() - eback();
+    else if (aDirection == std::ios_base::end)
+      target += egptr() - eback();
+
+    if (target < 0 || target > egptr() - eback())
+      return pos_type(off_type(-1));
+
+    setg(eback(), eback() + target, egptr());
+    return pos_type(target);
+  }
+
+  pos_type seekpos(pos_type aPosition, std::ios_base::openmode aMode) override
+  {
+    return seekoff(off_type(aPosition), std::ios_base::beg, aMode);
+  }
+};
+
+class BundleStream : public std::istream
+{
+  BundleBuffer mBufferImpl;
+
+public:
+  BundleStream(std::shared_ptr<const Bundle> aOwner, std::string_view aData)
+    : mBufferImpl(std::move(aOwner), aData)
+  {
+    rdbuf(&mBufferImpl);
+  }
+};
+
+}
+
+//===========================================================================//
+//=== Globals ===============================================================//
+//===========================================================================//
+
+namespace {
+
+/// Never changes between \ref InitBundle and \ref FreeBundle.
+std::shared_ptr<const Bundle> gBundle;
+
+}
+
+void
+InitBundle()
+{
+  assert(!gBundle);
+
+  std::string path = GetConfig()->BundlePath;
+  if (path.empty())
+    return;
+
+  try {
+    gBundle = std::make_shared<Bundle>(path);
+    SDL_Log("Bundle: %s (%zu resources)", path.c_str(), gBundle->GetCount());
+  } catch (const std::exception& error) {
+    // Everything is downloaded instead.
+    SDL_LogWarn(0, "Cannot open bundle: %s", error.what());
+  }
+}
+
+void
+FreeBundle()
+{
+  gBundle.reset();
+}
+
+std::shared_ptr<std::istream>
+OpenBundled(const std::string& aLink)
+{
+  if (!gBundle)
+    return nullptr;
+
+  std::optional<std::string_view> data = gBundle->Find(aLink);
+  if (!data) {
+    CountMetric("bundle.misses");
+    return nullptr;
+  }
+
+  CountMetric("bundle.hits");
+  CountMetric("bundle.bytes", data->size());
+  return std::make_shared<BundleStream>(gBundle, data.value());
+}
@@ -0,0 +1,101 @@
+#ifndef BUNDLE_HPP
+#define BUNDLE_HPP
+
+/**
+ * \file
+ * \brief Offline copies of the web API and the tile images.
+ *
+ * A bundle is a single file that is mapped into memory as a whole. It starts
+ * with a \ref BundleHeader, then holds the contents of every resource back to
+ * back, then the index: one \ref BundleEntry per resource followed by its link
+ * and master ID (not terminated). All integers are little-endian (see
+ * \ref BundleOrder). Bundles are written by `tools/BundleBuilder.cpp`.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+
+/// First bytes of every bundle file.
+constexpr char BundleMagic[8] = { 'D', 'P', 'B', 'U', 'N', 'D', 'L', 'E' };
+constexpr uint32_t BundleVersion = 1;
+
+struct BundleHeader
+{
+  char Magic[8];
+  uint32_t Version;
+  /// Number of entries in the index.
+  uint32_t Count;
+  /// Location of the index in the file.
+  uint64_t IndexOffset;
+  uint64_t IndexSize;
+};
+
+struct BundleEntry
+{
+  /// Location of the contents in the file.
+  uint64_t Offset;
+  uint64_t Size;
+  uint32_t LinkSize;
+  /// Zero for documents; images can also be found by the ID in their link.
+  uint32_t MasterIdSize;
+};
+
+/// Convert between host order and little-endian (the same both ways).
+template<typename T>
+constexpr T
+BundleOrder(T aValue)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  T result = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    result = static_cast<T>(result << 8 | (aValue & 0xff));
+    aValue >>= 8;
+  }
+  return result;
+#else
+  return aValue;
+#endif
+}
+
+inline BundleHeader
+BundleOrder(BundleHeader aHeader)
+{
+  aHeader.Version = BundleOrder(aHeader.Version);
+  aHeader.Count = BundleOrder(aHeader.Count);
+  aHeader.IndexOffset = BundleOrder(aHeader.IndexOffset);
+  aHeader.IndexSize = BundleOrder(aHeader.IndexSize);
+  return aHeader;
+}
+
+inline BundleEntry
+BundleOrder(BundleEntry aEntry)
+{
+  aEntry.Offset = BundleOrder(aEntry.Offset);
+  aEntry.Size = BundleOrder(aEntry.Size);
+  aEntry.LinkSize = BundleOrder(aEntry.LinkSize);
+  aEntry.MasterIdSize = BundleOrder(aEntry.MasterIdSize);
+  return aEntry;
+}
+
+/// Map the file in `network.bundle` (if any) into memory.
+void
+InitBundle();
+/// Release the mapping once the last stream is gone.
+void
+FreeBundle();
+
+/**
+ * \brief Stream over the bundled copy of the resource (thread-safe).
+ *
+ * The stream reads straight from the mapping. Images that are not found by
+ * their link are looked up by the master ID in any segment of the path, so
+ * the copy is used whatever size the link asks for. Returns null if the
+ * resource is not in the bundle.
+ */
+std::shared_ptr<std::istream>
+OpenBundled(const std::string& aLink);
+
+#endif
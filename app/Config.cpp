@@ -0,0 +1,375 @@
+#include "Config.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <SDL.h>
+
+//===========================================================================//
+//=== Options ===============================================================//
+//===========================================================================//
+
+namespace {
+
+using Field = std::variant<bool Config::*,
+                           int64_t Config::*,
+                           double Config::*,
+                           std::string Config::*>;
+
+struct Option
+{
+  const char* Key;
+  Field Member;
+  /// Range of accepted values (numbers only).
+  double Minimum = 0.0;
+  double Maximum = std::numeric_limits<double>::max();
+};
+
+const Option gOptions[] = {
+  { "graphics.msaa_samples", &Config::MultisampleSamples, 0, 64 },
+  { "graphics.font_size", &Config::FontSize, 1, 1024 },
+  { "viewer.margin", &Config::Margin, 0, 0.5 },
+  { "viewer.spacing", &Config::Spacing, 0, 0.5 },
+  { "viewer.lazy_rows", &Config::LazyRows },
+  { "viewer.search_limit", &Config::SearchLimit },
+  { "viewer.page_ahead", &Config::PageAhead },
+  { "viewer.warm_idle_delay", &Config::WarmIdleDelay },
+  { "viewer.warm_tiles", &Config::WarmTileCount },
+  { "viewer.warm_budget", &Config::WarmByteBudget },
+  { "viewer.warm_time_share", &Config::WarmTimeShare, 0.01, 1 },
+  { "viewer.warm_resume_delay", &Config::WarmResumeDelay },
+  { "viewer.shed_delay", &Config::ShedDelay },
+  { "network.base_url", &Config::BaseLink },
+  { "network.origins", &Config::Origins },
+  { "network.poll_timeout", &Config::PollTimeout, 1, 60000 },
+  { "network.max_connections", &Config::MaxConnections },
+  { "network.session_file", &Config::SessionFile },
+  { "network.ca_file", &Config::CaFile },
+  { "network.hedging", &Config::Hedging },
+  { "network.hedge_percentile", &Config::HedgePercentile, 0.5, 0.999 },
+  { "network.hedge_budget", &Config::HedgeBudget, 0, 1 },
+  { "network.har_limit", &Config::HarLimit, 1 },
+  { "network.har", &Config::HarPath },
+  { "network.bundle", &Config::BundlePath },
+  { "disk.threads", &Config::DiskThreads, 1, 64 },
+  { "worker.threads", &Config::WorkerThreads, 0, 256 },
+  { "json.simdjson", &Config::Simdjson },
+  { "json.validation_cache", &Config::ValidationCacheSize, 1 },
+  { "profiler.rate", &Config::SampleRate, 2, 10000 },
+  { "profiler.output", &Config::ProfilePath },
+  { "trace.output", &Config::TracePath },
+  { "pressure.script", &Config::PressureScript },
+  { "shutdown.timeout", &Config::ShutdownTimeout },
+  { "crawl.report", &Config::CrawlReport },
+  { "crawl.parallel", &Config::CrawlParallel, 1, 100000 },
+  { "threads.main", &Config::MainThreadClass },
+  { "threads.download", &Config::DownloadThreadClass },
+  { "threads.worker", &Config::WorkerThreadClass },
+  { "threads.disk", &Config::DiskThreadClass },
+  { "threads.interactive_nice", &Config::InteractiveNice, -20, 19 },
+  { "threads.utility_nice", &Config::UtilityNice, -20, 19 },
+  { "threads.background_nice", &Config::BackgroundNice, -20, 19 },
+  { "threads.interactive_cpus", &Config::InteractiveCpus },
+  { "threads.utility_cpus", &Config::UtilityCpus },
+  { "threads.background_cpus", &Config::BackgroundCpus },
+};
+
+/// Flags from before the configuration existed.
+struct Shorthand
+{
+  const char* Flag;
+  const char* Key;
+  /// Null when the flag takes the value as the next argument.
+  const char* Value;
+};
+
+const Shorthand gShorthands[] = {
+  { "--simdjson", "json.simdjson", "true" },
+  { "--lazy-rows", "viewer.lazy_rows", "true" },
+  { "--har", "network.har", nullptr },
+  { "--bundle", "network.bundle", nullptr },
+  { "--profile", "profiler.output", nullptr },
+  { "--gl-trace", "trace.output", nullptr },
+  { "--pressure-script", "pressure.script", nullptr },
+  { "--crawl", "crawl.report", nullptr },
+};
+
+const Option&
+FindOption(const std::string& aKey)
+{
+  for (const Option& elem : gOptions)
+    if (aKey == elem.Key)
+      return elem;
+
+  throw std::runtime_error("Unknown setting: " + aKey);
+}
+
+bool
+ParseBool(const Option& aOption, const std::string& aValue)
+{
+  if (aValue == "1" || aValue == "true" || aValue == "yes" || aValue == "on")
+    return true;
+  if (aValue == "0" || aValue == "false" || aValue == "no" || aValue == "off")
+    return false;
+
+  throw std::runtime_error(std::string(aOption.Key) + ": not a boolean");
+}
+
+double
+ParseNumber(const Option& aOption, const std::string& aValue, bool aInteger)
+{
+  const char* begin = aValue.c_str();
+  char* end;
+  errno = 0;
+  double result = aInteger ? std::strtoll(begin, &end, 10)
+                           : std::strtod(begin, &end);
+
+  if (end == begin || *end != '\0' || errno == ERANGE)
+    throw std::runtime_error(std::string(aOption.Key) + ": not a number");
+
+  if (result < aOption.Minimum || result > aOption.Maximum) {
+    std::ostringstream message;
+    message << aOption.Key << ": must be between " << aOption.Minimum
+            << " and " << aOption.Maximum;
+    throw std::runtime_error(message.str());
+  }
+
+  return result;
+}
+
+void
+Assign(Config& aConfig, const Option& aOption, const std::string& aValue)
+{
+  const Field& member = aOption.Member;
+
+  if (auto ptr = std::get_if<bool Config::*>(&member))
+    aConfig.*(*ptr) = ParseBool(aOption, aValue);
+  else if (auto ptr = std::get_if<int64_t Config::*>(&member))
+    aConfig.*(*ptr) = ParseNumber(aOption, aValue, true);
+  else if (auto ptr = std::get_if<double Config::*>(&member))
+    aConfig.*(*ptr) = ParseNumber(aOption, aValue, false);
+  else if (auto ptr = std::get_if<std::string Config::*>(&member))
+    aConfig.*(*ptr) = aValue;
+}
+
+std::string
+Format(const Config& aConfig, const Option& aOption)
+{
+  std::ostringstream result;
+  std::visit([&](auto ptr) { result << std::boolalpha << aConfig.*ptr; },
+             aOption.Member);
+  return result.str();
+}
+
+std::string
+Trim(const std::string& aText)
+{
+  size_t first = aText.find_first_not_of(" \t\r");
+  if (first == std::string::npos)
+    return std::string();
+
+  size_t last = aText.find_last_not_of(" \t\r");
+  return aText.substr(first, last - first + 1);
+}
+
+/**
+ * \brief Apply a file of `key = value` lines.
+ *
+ * Lines that start with `#` or `;` are comments. A `[section]` line is
+ * prepended to the keys that follow it, unless they have a dot already.
+ */
+void
+ReadFile(const std::string& aPath, Config& aConfig)
+{
+  std::ifstream input(aPath);
+  if (!input)
+    throw std::runtime_error("Cannot open " + aPath);
+
+  std::string line;
+  std::string section;
+
+  for (int number = 1; std::getline(input, line); ++number) {
+    line = Trim(line);
+    if (line.empty() || line[0] == '#' || line[0] == ';')
+      continue;
+
+    try {
+      if (line.front() == '[' && line.back() == ']') {
+        section = Trim(line.substr(1, line.size() - 2)) + '.';
+        continue;
+      }
+
+      size_t split = line.find('=');
+      if (split == std::string::npos)
+        throw std::runtime_error("Expected key = value");
+
+      std::string key = Trim(line.substr(0, split));
+      if (key.find('.') == std::string::npos)
+        key = section + key;
+
+      Assign(aConfig, FindOption(key), Trim(line.substr(split + 1)));
+    } catch (const std::exception& error) {
+      std::ostringstream message;
+      message << aPath << ':' << number << ": " << error.what();
+      throw std::runtime_error(message.str());
+    }
+  }
+}
+
+}
+
+//===========================================================================//
+//=== Globals ===============================================================//
+//===========================================================================//
+
+namespace {
+
+/// Only ever replaced as a whole so readers never see a partial update.
+std::shared_ptr<const Config> gConfig = std::make_shared<Config>();
+/// Optional file given on the command line.
+std::string gPath;
+/// Command line values in order; these win over the file.
+std::vector<std::pair<std::string, std::string>> gOverrides;
+volatile std::sig_atomic_t gReload = 0;
+
+Config
+BuildConfig()
+{
+  Config result;
+
+  if (!gPath.empty())
+    ReadFile(gPath, result);
+
+  for (auto& [key, value] : gOverrides)
+    Assign(result, FindOption(key), value);
+
+#ifndef USE_SIMDJSON
+  if (result.Simdjson) {
+    SDL_LogWarn(0, "simdjson support is not compiled in");
+    result.Simdjson = false;
+  }
+#endif
+
+  return result;
+}
+
+void
+AddOverride(const std::string& aKey, std::string aValue)
+{
+  // Fail early instead of on the first reload.
+  Config scratch;
+  Assign(scratch, FindOption(aKey), aValue);
+  gOverrides.emplace_back(aKey, std::move(aValue));
+}
+
+void
+OnReloadSignal(int)
+{
+  gReload = 1;
+}
+
+}
+
+std::shared_ptr<const Config>
+GetConfig()
+{
+  return std::atomic_load(&gConfig);
+}
+
+void
+InitConfig(int argc, char** argv)
+{
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool known = false;
+
+    for (const Shorthand& elem : gShorthands) {
+      if (arg != elem.Flag)
+        continue;
+
+      if (elem.Value)
+        AddOverride(elem.Key, elem.Value);
+      else if (i + 1 < argc)
+        AddOverride(elem.Key, argv[++i]);
+      else
+        throw std::runtime_error(arg + " needs a value");
+
+      known = true;
+    }
+
+    if (known)
+      continue;
+
+    if (arg == "--config" && i + 1 < argc) {
+      gPath = argv[++i];
+    } else if (arg == "--set" && i + 1 < argc) {
+      std::string pair = argv[++i];
+      size_t split = pair.find('=');
+      if (split == std::string::npos)
+        throw std::runtime_error("Expected --set key=value");
+
+      AddOverride(pair.substr(0, split), pair.substr(split + 1));
+    } else {
+      // Some platforms add their own arguments.
+      SDL_LogWarn(0, "Ignoring argument: %s", arg.c_str());
+    }
+  }
+
+  std::atomic_store(&gConfig,
+                    std::shared_ptr<const Config>(
+                      std::make_shared<Config>(BuildConfig())));
+
+  if (!gPath.empty())
+    SDL_Log("Configuration file: %s", gPath.c_str());
+
+#ifdef SIGHUP
+  signal(SIGHUP, OnReloadSignal);
+#endif
+}
+
+void
+UpdateConfig()
+{
+  if (!gReload)
+    return;
+
+  gReload = 0;
+  std::shared_ptr<const Config> next;
+
+  try {
+    next = std::make_shared<Config>(BuildConfig());
+  } catch (const std::exception& error) {
+    SDL_LogWarn(0, "Keeping the previous configuration: %s", error.what());
+    return;
+  }
+
+  // Print what changed so a reload can be verified from the log.
+  std::shared_ptr<const Config> prev = GetConfig();
+  for (const Option& elem : gOptions) {
+    std::string before = Format(*prev, elem);
+    std::string after = Format(*next, elem);
+
+    if (before != after)
+      SDL_Log("Setting %s = %s", elem.Key, after.c_str());
+  }
+
+  std::atomic_store(&gConfig, std::move(next));
+}
+
+void
+FreeConfig()
+{
+#ifdef SIGHUP
+  signal(SIGHUP, SIG_DFL);
+#endif
+}
@@ -0,0 +1,136 @@
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+/**
+ * \file
+ * \brief Tuning knobs from the command line and a reloadable file.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * \brief Every setting with its default value.
+ *
+ * Each field has a key of the form `section.name` (listed in the README).
+ * Most of them are read whenever they are needed, so a reload applies to the
+ * running program; the ones that are only read at startup say so.
+ */
+struct Config
+{
+  /// Samples per pixel for the window (startup only).
+  int64_t MultisampleSamples = 16;
+  /// Point size used to render text (applies to new text).
+  int64_t FontSize = 256;
+
+  double Margin = 0.025;
+  double Spacing = 0.015;
+  /// Decode inline rows only once they become visible.
+  bool LazyRows = false;
+  /// Most tiles shown in the search results row.
+  int64_t SearchLimit = 40;
+  /// Fetch the next page of a long row this many tiles before the end.
+  int64_t PageAhead = 5;
+  /// Quiet time after any input before loading ahead (milliseconds).
+  int64_t WarmIdleDelay = 2000;
+  /// Images loaded ahead of time at the start of every row.
+  int64_t WarmTileCount = 4;
+  /// Stop loading ahead after this much data.
+  int64_t WarmByteBudget = 64 << 20;
+  /// Rough fraction of the time spent on loading ahead.
+  double WarmTimeShare = 0.25;
+  /// Load ahead again once there was no memory pressure for this long.
+  int64_t WarmResumeDelay = 30000;
+  /// Only shed what has been off the screen for this long (milliseconds).
+  int64_t ShedDelay = 1000;
+
+  /// Prefix of every web API link.
+  std::string BaseLink = "https://cd-static.bamgrid.com/dp-117731241344";
+  /// Groups of equivalent hosts such as `https://a,https://b;https://c,...`.
+  std::string Origins;
+  /// Longest wait for network activity (milliseconds).
+  int64_t PollTimeout = 1000;
+  /// Concurrent connections for all transfers (zero for no limit).
+  int64_t MaxConnections = 0;
+  /// Keep DNS results and TLS sessions in this file (startup only).
+  std::string SessionFile;
+  /// Trust only the certificates in this PEM file (for local test servers).
+  std::string CaFile;
+  /// Send a second request for transfers that are slow to respond.
+  bool Hedging = false;
+  /// Slower than this fraction of the recent transfers counts as slow.
+  double HedgePercentile = 0.95;
+  /// Most duplicates per transfer on average.
+  double HedgeBudget = 0.05;
+  /// Transfers kept for the HTTP Archive.
+  int64_t HarLimit = 4096;
+  /// Write the HTTP Archive here on exit.
+  std::string HarPath;
+  /// Serve transfers from this offline bundle when possible (startup only).
+  std::string BundlePath;
+
+  /// Threads for the portable disk backend (storage is rarely the limit).
+  int64_t DiskThreads = 2;
+  /// Decoder threads (zero for one per core; startup only).
+  int64_t WorkerThreads = 1;
+
+  /// Parse complete documents with simdjson (if compiled in).
+  bool Simdjson = false;
+  /// Most payloads remembered for each schema.
+  int64_t ValidationCacheSize = 256;
+
+  /// Samples per second of CPU time (applies when sampling starts).
+  int64_t SampleRate = 99;
+  /// Start the profiler with this output (startup only).
+  std::string ProfilePath;
+  /// Write the OpenGL call counts here (startup only).
+  std::string TracePath;
+  /// Replay memory pressure from this file (startup only).
+  std::string PressureScript;
+
+  /// Threads still busy after this long are abandoned on exit (milliseconds).
+  int64_t ShutdownTimeout = 500;
+
+  /// Crawl the catalog without a window and write the report here (startup
+  /// only).
+  std::string CrawlReport;
+  /// Most requests at once while crawling.
+  int64_t CrawlParallel = 64;
+
+  /// Class of each pipeline thread: `interactive`, `utility` or `background`
+  /// (applies when the thread starts).
+  std::string MainThreadClass = "interactive";
+  std::string DownloadThreadClass = "utility";
+  std::string WorkerThreadClass = "utility";
+  std::string DiskThreadClass = "background";
+  /// Niceness of each class (Linux; lowering it needs privileges).
+  int64_t InteractiveNice = 0;
+  int64_t UtilityNice = 5;
+  int64_t BackgroundNice = 10;
+  /// CPUs of each class such as `0-3,6` (empty for any).
+  std::string InteractiveCpus;
+  std::string UtilityCpus;
+  std::string BackgroundCpus;
+};
+
+/// Current settings; a reload swaps in a new object (thread-safe).
+std::shared_ptr<const Config>
+GetConfig();
+
+/**
+ * \brief Read the command line and the file given with `--config`.
+ *
+ * Values from `--set key=value` and the shorthand flags override the file.
+ * Throws \c std::runtime_error for unknown keys and malformed values.
+ */
+void
+InitConfig(int argc, char** argv);
+/// Read the file again if `SIGHUP` arrived since the last call (main thread).
+void
+UpdateConfig();
+/// Restore the default `SIGHUP` handler.
+void
+FreeConfig();
+
+#endif
@@ -0,0 +1,473 @@
+#include "Crawl.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <SDL.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include "Config.hpp"
+#include "Main.hpp"
+#include "Metrics.hpp"
+#include "Worker.hpp"
+
+//===========================================================================//
+//=== Callbacks =============================================================//
+//===========================================================================//
+
+namespace {
+
+/// Results of the requests waiting for the crawling thread.
+class CallbackQueue
+{
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::deque<std::function<void()>> mQueue;
+
+public:
+  /// Called from any thread.
+  void Push(std::function<void()> aFunctor)
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mQueue.push_back(std::move(aFunctor));
+    mCondition.notify_one();
+  }
+
+  /// Run the next functor; false if none arrived before the timeout.
+  bool RunOne(std::chrono::milliseconds aTimeout)
+  {
+    std::function<void()> next;
+
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      auto ready = [&] { return !mQueue.empty(); };
+      if (!mCondition.wait_for(lock, aTimeout, ready))
+        return false;
+
+      next = std::move(mQueue.front());
+      mQueue.pop_front();
+    }
+
+    next();
+    return true;
+  }
+};
+
+}
+
+//===========================================================================//
+//=== Crawler ===============================================================//
+//===========================================================================//
+
+namespace {
+
+struct Failure
+{
+  /// One of `home`, `set`, `page` or `image`.
+  const char* Kind;
+  std::string Link;
+  std::string Message;
+};
+
+/// Histograms in the report (milliseconds, except the queue in microseconds).
+const char* const gTimings[] = {
+  "crawl.home",
+  "crawl.set",
+  "crawl.page",
+  "crawl.image",
+  "network.dns",
+  "network.connect",
+  "network.tls",
+  "network.ttfb",
+  "network.total",
+  "queue.worker.latency",
+};
+
+class Crawler
+{
+  using Clock = std::chrono::steady_clock;
+  using QueryProc = std::function<void(AsyncQuery::ResultType&)>;
+
+  /// Time between two progress lines in the log.
+  static constexpr std::chrono::seconds ProgressInterval{ 10 };
+
+  CallbackQueue mCallbacks;
+  Executor mExecutor;
+  std::string mBaseLink;
+  size_t mParallel;
+  /// Requests that were started and have not finished.
+  size_t mRunning;
+  /// Requests waiting for a free slot (in the order they were found).
+  std::deque<std::function<void()>> mWaiting;
+  /// Owned until the signals have been emitted.
+  std::list<std::unique_ptr<AsyncQuery>> mQueries;
+  std::list<std::unique_ptr<AsyncImage>> mImages;
+  std::unordered_set<std::string> mSeenSets;
+  std::unordered_set<std::string> mSeenImages;
+
+  size_t mSetCount;
+  size_t mPageCount;
+  size_t mTileCount;
+  size_t mImageCount;
+  uint64_t mPixelCount;
+  std::vector<Failure> mFailures;
+
+public:
+  explicit Crawler(const Config& aConfig)
+    : mExecutor([this](auto aFunctor) { mCallbacks.Push(std::move(aFunctor)); })
+    , mBaseLink(aConfig.BaseLink)
+    , mParallel(static_cast<size_t>(aConfig.CrawlParallel))
+    , mRunning(0)
+    , mSetCount(0)
+    , mPageCount(0)
+    , mTileCount(0)
+    , mImageCount(0)
+    , mPixelCount(0)
+  {}
+
+  Crawler(const Crawler& aOther) = delete;
+  Crawler& operator=(const Crawler& aOther) = delete;
+
+  size_t GetFailureCount() const { return mFailures.size(); }
+
+  /// Crawl everything that can be reached from the home screen.
+  void Run()
+  {
+    LoadHome();
+
+    auto progress = Clock::now() + ProgressInterval;
+    while (mRunning > 0 || !mWaiting.empty()) {
+      mCallbacks.RunOne(ProgressInterval);
+
+      if (Clock::now() >= progress) {
+        progress = Clock::now() + ProgressInterval;
+        SDL_Log("Crawled %zu sets and %zu images (%zu waiting, %zu failed)",
+                mSetCount + mPageCount,
+                mImageCount,
+                mWaiting.size(),
+                mFailures.size());
+      }
+    }
+
+    // The requests that finished last are still owned.
+    while (mCallbacks.RunOne(std::chrono::milliseconds(0)))
+      continue;
+  }
+
+  void WriteReport(std::ostream& aOutput, double aSeconds, int64_t aBytes)
+  {
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+    writer.StartObject();
+    writer.Key("baseUrl");
+    writer.String(mBaseLink.c_str());
+    writer.Key("seconds");
+    writer.Double(aSeconds);
+
+    writer.Key("counts");
+    writer.StartObject();
+    writer.Key("sets");
+    writer.Uint64(mSetCount);
+    writer.Key("pages");
+    writer.Uint64(mPageCount);
+    writer.Key("tiles");
+    writer.Uint64(mTileCount);
+    writer.Key("images");
+    writer.Uint64(mImageCount);
+    writer.Key("bytes");
+    writer.Int64(aBytes);
+    writer.Key("failures");
+    writer.Uint64(mFailures.size());
+    writer.EndObject();
+
+    // Rates over the whole run, including the time to find the work.
+    double seconds = std::max(aSeconds, 1e-3);
+    writer.Key("throughput");
+    writer.StartObject();
+    writer.Key("documentsPerSecond");
+    writer.Double((mSetCount + mPageCount) / seconds);
+    writer.Key("imagesPerSecond");
+    writer.Double(mImageCount / seconds);
+    writer.Key("megabytesPerSecond");
+    writer.Double(aBytes / 1e6 / seconds);
+    writer.Key("megapixelsPerSecond");
+    writer.Double(mPixelCount / 1e6 / seconds);
+    writer.EndObject();
+
+    writer.Key("failures");
+    writer.StartArray();
+    for (const Failure& elem : mFailures) {
+      writer.StartObject();
+      writer.Key("kind");
+      writer.String(elem.Kind);
+      writer.Key("link");
+      writer.String(elem.Link.c_str());
+      writer.Key("message");
+      writer.String(elem.Message.c_str());
+      writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("timings");
+    writer.StartObject();
+    for (const char* name : gTimings) {
+      MetricHistogram value = GetHistogram(name);
+      if (value.Count == 0)
+        continue;
+
+      writer.Key(name);
+      writer.StartObject();
+      writer.Key("count");
+      writer.Uint64(value.Count);
+      writer.Key("mean");
+      writer.Double(value.Sum / value.Count);
+      writer.Key("min");
+      writer.Double(value.Minimum);
+      writer.Key("p50");
+      writer.Double(value.GetPercentile(0.50));
+      writer.Key("p90");
+      writer.Double(value.GetPercentile(0.90));
+      writer.Key("p99");
+      writer.Double(value.GetPercentile(0.99));
+      writer.Key("max");
+      writer.Double(value.Maximum);
+      writer.EndObject();
+    }
+    writer.EndObject();
+
+    writer.Key("counters");
+    writer.StartObject();
+    for (const auto& [name, value] : GetCounters()) {
+      writer.Key(name.c_str());
+      writer.Int64(value);
+    }
+    writer.EndObject();
+    writer.EndObject();
+
+    aOutput.write(buffer.GetString(), buffer.GetSize());
+    aOutput << std::endl;
+  }
+
+private:
+  /// Start the request now or once there is room for it.
+  void Schedule(std::function<void()> aStart)
+  {
+    mWaiting.push_back(std::move(aStart));
+    StartWaiting();
+  }
+
+  void StartWaiting()
+  {
+    while (mRunning < mParallel && !mWaiting.empty()) {
+      std::function<void()> next = std::move(mWaiting.front());
+      mWaiting.pop_front();
+      mRunning += 1;
+      next();
+    }
+  }
+
+  void Finish(const char* aKind, Clock::time_point aStart)
+  {
+    std::chrono::duration<double, std::milli> elapsed = Clock::now() - aStart;
+    RecordMetric(std::string("crawl.") + aKind, elapsed.count());
+    mRunning -= 1;
+    StartWaiting();
+  }
+
+  void AddFailure(const char* aKind, std::string aLink, std::string aMessage)
+  {
+    SDL_LogWarn(0, "%s: %s", aLink.c_str(), aMessage.c_str());
+    mFailures.push_back({ aKind, std::move(aLink), std::move(aMessage) });
+  }
+
+  void Query(std::string aLink,
+             AsyncQuery::Mode aMode,
+             const char* aKind,
+             QueryProc aDone)
+  {
+    Schedule([this, aLink, aMode, aKind, aDone]() {
+      auto start = Clock::now();
+      auto it = mQueries.insert(mQueries.end(),
+                                std::make_unique<AsyncQuery>(aLink));
+
+      // The request is destroyed after its signal returns.
+      auto release = [this, it]() {
+        mCallbacks.Push([this, it]() { mQueries.erase(it); });
+      };
+
+      AsyncQuery& query = **it;
+      query.SetExecutor(mExecutor);
+      query.Failed.connect([=](std::string aMessage) {
+        AddFailure(aKind, aLink, std::move(aMessage));
+        Finish(aKind, start);
+        release();
+      });
+      query.Finished.connect(
+        [=](std::shared_ptr<AsyncQuery::ResultType> aResult) {
+          aDone(*aResult);
+          Finish(aKind, start);
+          release();
+        });
+      query.Enqueue(aMode);
+    });
+  }
+
+  void LoadHome()
+  {
+    std::string link = mBaseLink + "/home.json";
+
+    Query(link, AsyncQuery::Home, "home", [this, link](auto& aResult) {
+      for (ApiContainer& elem : std::get<ApiHome>(aResult).Containers) {
+        if (auto set = std::get_if<ApiFuzzySet>(&elem))
+          AddSet(link, std::string(), *set, std::nullopt);
+        else if (auto ref = std::get_if<ApiSetRef>(&elem))
+          LoadSet(ref->ReferenceId);
+      }
+    });
+  }
+
+  void LoadSet(const std::string& aId)
+  {
+    std::ostringstream oss;
+    oss << mBaseLink << "/sets";
+    oss << '/' << aId << ".json";
+
+    std::string link = oss.str();
+    if (!mSeenSets.insert(link).second)
+      return;
+
+    Query(link, AsyncQuery::Dereference, "set", [=](auto& aResult) {
+      AddSet(link, aId, std::get<ApiFuzzySet>(aResult), std::nullopt);
+    });
+  }
+
+  void LoadPage(const std::string& aId, size_t aOffset, size_t aPageSize)
+  {
+    std::ostringstream oss;
+    oss << mBaseLink << "/sets";
+    oss << '/' << aId << ".json";
+    oss << "?offset=" << aOffset << "&page_size=" << aPageSize;
+
+    std::string link = oss.str();
+    Query(link, AsyncQuery::Dereference, "page", [=](auto& aResult) {
+      AddSet(link, aId, std::get<ApiFuzzySet>(aResult), aOffset);
+    });
+  }
+
+  /// Queue the images of the set (and the other pages for the first one).
+  void AddSet(const std::string& aLink,
+              const std::string& aId,
+              const ApiFuzzySet& aSet,
+              std::optional<size_t> aOffset)
+  {
+    // Servers that ignore the query would repeat the first page.
+    if (aOffset && (aSet.PageOffset != aOffset.value() || aSet.Tiles.empty())) {
+      AddFailure("page", aLink, "Not the page that was asked for");
+      return;
+    }
+
+    (aOffset ? mPageCount : mSetCount) += 1;
+    for (const ApiFuzzyTile& tile : aSet.Tiles) {
+      mTileCount += 1;
+      for (const ApiImage& image : tile.TileImages)
+        LoadImage(image.ResourceLink);
+    }
+
+    if (aOffset || aSet.PageSize == 0)
+      return;
+
+    const std::string& id = aSet.SetId.empty() ? aId : aSet.SetId;
+    if (id.empty()) {
+      AddFailure("set", aLink, "Paged set without an ID");
+      return;
+    }
+
+    // Every page is known up-front so they are all requested at once.
+    size_t offset = aSet.PageOffset + aSet.Tiles.size();
+    for (; offset < aSet.TotalCount; offset += aSet.PageSize)
+      LoadPage(id, offset, aSet.PageSize);
+  }
+
+  void LoadImage(const std::string& aLink)
+  {
+    if (!mSeenImages.insert(aLink).second)
+      return;
+
+    Schedule([this, aLink]() {
+      auto start = Clock::now();
+      auto it = mImages.insert(mImages.end(),
+                               std::make_unique<AsyncImage>(aLink));
+
+      // The request (and the decoded image) goes after the signal returns.
+      auto release = [this, it]() {
+        mCallbacks.Push([this, it]() { mImages.erase(it); });
+      };
+
+      AsyncImage& image = **it;
+      image.SetExecutor(mExecutor);
+      image.Failed.connect([=](std::string aMessage) {
+        AddFailure("image", aLink, std::move(aMessage));
+        Finish("image", start);
+        release();
+      });
+      image.Finished.connect([=](std::shared_ptr<SDL_Surface> aImage) {
+        mImageCount += 1;
+        mPixelCount += uint64_t(aImage->w) * uint64_t(aImage->h);
+        Finish("image", start);
+        release();
+      });
+      image.Enqueue();
+    });
+  }
+};
+
+}
+
+int
+RunCrawl(const std::string& aReportPath)
+{
+  std::shared_ptr<const Config> config = GetConfig();
+  std::ofstream output(aReportPath, std::ios_base::binary);
+  if (!output) {
+    SDL_LogCritical(0, "Cannot create %s", aReportPath.c_str());
+    return 1;
+  }
+
+  Crawler crawler(*config);
+  int64_t bytes = GetCounter("network.bytes");
+  auto start = std::chrono::steady_clock::now();
+  crawler.Run();
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  bytes = GetCounter("network.bytes") - bytes;
+  crawler.WriteReport(output, elapsed.count(), bytes);
+
+  if (!output.flush()) {
+    SDL_LogCritical(0, "Cannot write %s", aReportPath.c_str());
+    return 1;
+  }
+
+  SDL_Log("Crawl report: %s (%zu failures in %.1f s)",
+          aReportPath.c_str(),
+          crawler.GetFailureCount(),
+          elapsed.count());
+  return crawler.GetFailureCount() == 0 ? 0 : 1;
+}
@@ -0,0 +1,24 @@
+#ifndef CRAWL_HPP
+#define CRAWL_HPP
+
+/**
+ * \file
+ * \brief Check the whole catalog without a window.
+ */
+
+#include <string>
+
+/**
+ * \brief Download, validate and decode every set and tile image.
+ *
+ * Starts from `home.json` under `network.base_url`, follows every set
+ * reference and every page of the paged sets, and decodes each distinct tile
+ * image. At most `crawl.parallel` requests run at once. The report is a JSON
+ * file with the counts, the throughput, every failure and the timing
+ * distributions. Must run on the main thread with the network and worker
+ * modules initialized. Returns the exit status: zero if nothing failed.
+ */
+int
+RunCrawl(const std::string& aReportPath);
+
+#endif
@@ -0,0 +1,703 @@
+#include "Disk.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <SDL.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "Config.hpp"
+#include "Metrics.hpp"
+#include "Profiler.hpp"
+#include "Scheduling.hpp"
+
+//===========================================================================//
+//=== Request ===============================================================//
+//===========================================================================//
+
+namespace {
+
+struct Request
+{
+  enum class Kind
+  {
+    Read,
+    Write,
+    Sync,
+  };
+
+  Kind Type;
+  int File;
+  char* Buffer = nullptr;
+  size_t Size = 0;
+  uint64_t Offset = 0;
+  /// Bytes written by earlier attempts (for short writes).
+  size_t Transferred = 0;
+  DiskCallback Callback;
+  std::chrono::steady_clock::time_point Start;
+};
+
+const char*
+GetLatencyMetric(Request::Kind aKind)
+{
+  switch (aKind) {
+    case Request::Kind::Read:
+      return "disk.read.latency";
+    case Request::Kind::Write:
+      return "disk.write.latency";
+    default:
+      return "disk.sync.latency";
+  }
+}
+
+/// Invoke the callback unless the request has to be submitted again.
+bool
+FinishRequest(Request& aRequest, long aResult)
+{
+  if (aResult == -EINTR || aResult == -EAGAIN)
+    return false;
+
+  if (aRequest.Type == Request::Kind::Write && aResult >= 0) {
+    auto count = static_cast<size_t>(aResult);
+
+    if (count == 0 && aRequest.Size != 0) {
+      aResult = -EIO;
+    } else if (count < aRequest.Size) {
+      aRequest.Buffer += count;
+      aRequest.Size -= count;
+      aRequest.Offset += count;
+      aRequest.Transferred += count;
+      return false;
+    } else {
+      aResult += static_cast<long>(aRequest.Transferred);
+    }
+  }
+
+  std::chrono::duration<double, std::micro> elapsed =
+    std::chrono::steady_clock::now() - aRequest.Start;
+  RecordMetric(GetLatencyMetric(aRequest.Type), elapsed.count());
+
+  aRequest.Callback(aResult);
+  return true;
+}
+
+}
+
+//===========================================================================//
+//=== Backend ===============================================================//
+//===========================================================================//
+
+namespace {
+
+class DiskBackend
+{
+public:
+  virtual ~DiskBackend() = default;
+  virtual const char* GetName() const = 0;
+  virtual void Submit(std::unique_ptr<Request> aRequest) = 0;
+};
+
+#ifdef _WIN32
+
+/// MinGW has no positional i/o so every seek is serialized.
+std::mutex gSeekMutex;
+
+long
+PerformRequest(const Request& aRequest)
+{
+  if (aRequest.Type == Request::Kind::Sync)
+    return (_commit(aRequest.File) == 0) ? 0 : -errno;
+
+  std::unique_lock<std::mutex> lock(gSeekMutex);
+  long result = -1;
+
+  if (_lseeki64(aRequest.File, aRequest.Offset, SEEK_SET) >= 0) {
+    if (aRequest.Type == Request::Kind::Read)
+      result = _read(aRequest.File, aRequest.Buffer, aRequest.Size);
+    else
+      result = _write(aRequest.File, aRequest.Buffer, aRequest.Size);
+  }
+
+  return (result >= 0) ? result : -errno;
+}
+
+#else
+
+long
+PerformRequest(const Request& aRequest)
+{
+  long result = 0;
+
+  switch (aRequest.Type) {
+    case Request::Kind::Read:
+      result = pread(aRequest.File,
+                     aRequest.Buffer,
+                     aRequest.Size,
+                     static_cast<off_t>(aRequest.Offset));
+      break;
+    case Request::Kind::Write:
+      result = pwrite(aRequest.File,
+                      aRequest.Buffer,
+                      aRequest.Size,
+                      static_cast<off_t>(aRequest.Offset));
+      break;
+    case Request::Kind::Sync:
+      result = fdatasync(aRequest.File);
+      break;
+  }
+
+  return (result >= 0) ? result : -errno;
+}
+
+#endif
+
+/// Portable fallback that runs blocking system calls on a few threads.
+class PoolBackend : public DiskBackend
+{
+  bool mRunning;
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::deque<std::unique_ptr<Request>> mQueue;
+  /// Threads that have not left yet.
+  std::list<std::thread> mThreads;
+  /// Threads that left, which the next resize joins.
+  std::list<std::thread> mLeft;
+  /// Idle threads leave while there are more than this.
+  size_t mWanted;
+
+public:
+  explicit PoolBackend(size_t aThreadCount)
+    : mRunning(true)
+    , mWanted(0)
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    Resize(aThreadCount);
+  }
+
+  PoolBackend(const PoolBackend& aOther) = delete;
+  PoolBackend& operator=(const PoolBackend& aOther) = delete;
+
+  ~PoolBackend()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mRunning = false;
+    mCondition.notify_all();
+    mCondition.wait(lock, [&]() { return mThreads.empty(); });
+    lock.unlock();
+
+    for (std::thread& elem : mLeft)
+      elem.join();
+  }
+
+  const char* GetName() const override { return "thread pool"; }
+
+  void Submit(std::unique_ptr<Request> aRequest) override
+  {
+    auto wanted = static_cast<size_t>(GetConfig()->DiskThreads);
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    // Follow the configuration when it is reloaded.
+    if (wanted != mWanted)
+      Resize(wanted);
+
+    mQueue.emplace_back(std::move(aRequest));
+    mCondition.notify_one();
+  }
+
+private:
+  /// Lock must be held.
+  void Resize(size_t aThreadCount)
+  {
+    mWanted = aThreadCount;
+
+    // They only had to release the lock after leaving.
+    for (std::thread& elem : mLeft)
+      elem.join();
+    mLeft.clear();
+
+    while (mThreads.size() < mWanted)
+      mThreads.emplace_back(std::bind(&PoolBackend::MainLoop, this));
+
+    mCondition.notify_all();
+  }
+
+  /// Lock must be held (by the calling thread of the pool).
+  void Leave()
+  {
+    auto self = std::find_if(
+      mThreads.begin(), mThreads.end(), [](const std::thread& aThread) {
+        return aThread.get_id() == std::this_thread::get_id();
+      });
+
+    mLeft.splice(mLeft.end(), mThreads, self);
+    // The destructor waits for the last one.
+    mCondition.notify_all();
+  }
+
+  void MainLoop()
+  {
+    ProfilerScope profile("disk");
+    ApplyThreadClass("disk");
+
+    while (true) {
+      std::unique_ptr<Request> request;
+
+      {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCondition.wait(lock, [&]() {
+          return !mRunning || !mQueue.empty() || mThreads.size() > mWanted;
+        });
+
+        // Everything is drained before the threads exit.
+        if (mQueue.empty() || mThreads.size() > mWanted) {
+          Leave();
+          return;
+        }
+
+        request = std::move(mQueue.front());
+        mQueue.pop_front();
+      }
+
+      while (!FinishRequest(*request, PerformRequest(*request)))
+        continue;
+    }
+  }
+};
+
+#ifdef HAVE_IO_URING
+
+/// Single thread that owns an io_uring instance (no liburing required).
+class UringBackend : public DiskBackend
+{
+  /// Submission slots; one of them is always used for the wake-up poll.
+  static constexpr unsigned Entries = 64;
+
+  std::atomic<bool> mRunning;
+  std::thread mThread;
+  /// Synchronize access to the request queue.
+  std::mutex mMutex;
+  std::deque<std::unique_ptr<Request>> mQueue;
+
+  /// Interrupts the thread when new requests arrive.
+  int mWakeup = -1;
+  int mRing = -1;
+  io_uring_params mParams;
+
+  void* mSqMemory = nullptr;
+  size_t mSqLength = 0;
+  void* mCqMemory = nullptr;
+  size_t mCqLength = 0;
+  io_uring_sqe* mSqes = nullptr;
+  size_t mSqesLength = 0;
+
+  unsigned* mSqTail;
+  unsigned* mSqMask;
+  unsigned* mSqArray;
+  unsigned* mCqHead;
+  unsigned* mCqTail;
+  unsigned* mCqMask;
+  io_uring_cqe* mCqes;
+
+  /// Only touched by the thread.
+  unsigned mInFlight = 0;
+  unsigned mUnsubmitted = 0;
+
+public:
+  UringBackend()
+    : mRunning(true)
+  {
+    try {
+      Open();
+    } catch (...) {
+      Release();
+      throw;
+    }
+
+    mThread = std::thread(std::bind(&UringBackend::MainLoop, this));
+  }
+
+  UringBackend(const UringBackend& aOther) = delete;
+  UringBackend& operator=(const UringBackend& aOther) = delete;
+
+  ~UringBackend()
+  {
+    mRunning = false;
+    Wake();
+    mThread.join();
+    Release();
+  }
+
+  const char* GetName() const override { return "io_uring"; }
+
+  void Submit(std::unique_ptr<Request> aRequest) override
+  {
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mQueue.emplace_back(std::move(aRequest));
+    }
+
+    Wake();
+  }
+
+private:
+  void Open()
+  {
+    memset(&mParams, 0, sizeof(mParams));
+    mRing = syscall(__NR_io_uring_setup, Entries, &mParams);
+    if (mRing < 0)
+      throw std::runtime_error(strerror(errno));
+
+    CheckOpcodes();
+
+    const io_sqring_offsets& sq = mParams.sq_off;
+    const io_cqring_offsets& cq = mParams.cq_off;
+    mSqLength = sq.array + mParams.sq_entries * sizeof(unsigned);
+    mCqLength = cq.cqes + mParams.cq_entries * sizeof(io_uring_cqe);
+
+    // Newer kernels share one mapping between both rings.
+    if (mParams.features & IORING_FEAT_SINGLE_MMAP) {
+      mSqLength = std::max(mSqLength, mCqLength);
+      mSqMemory = MapRing(mSqLength, IORING_OFF_SQ_RING);
+      mCqMemory = mSqMemory;
+    } else {
+      mSqMemory = MapRing(mSqLength, IORING_OFF_SQ_RING);
+      mCqMemory = MapRing(mCqLength, IORING_OFF_CQ_RING);
+    }
+
+    mSqesLength = mParams.sq_entries * sizeof(io_uring_sqe);
+    mSqes = static_cast<io_uring_sqe*>(MapRing(mSqesLength, IORING_OFF_SQES));
+
+    auto sqBase = static_cast<char*>(mSqMemory);
+    mSqTail = reinterpret_cast<unsigned*>(sqBase + sq.tail);
+    mSqMask = reinterpret_cast<unsigned*>(sqBase + sq.ring_mask);
+    mSqArray = reinterpret_cast<unsigned*>(sqBase + sq.array);
+
+    auto cqBase = static_cast<char*>(mCqMemory);
+    mCqHead = reinterpret_cast<unsigned*>(cqBase + cq.head);
+    mCqTail = reinterpret_cast<unsigned*>(cqBase + cq.tail);
+    mCqMask = reinterpret_cast<unsigned*>(cqBase + cq.ring_mask);
+    mCqes = reinterpret_cast<io_uring_cqe*>(cqBase + cq.cqes);
+
+    mWakeup = eventfd(0, EFD_CLOEXEC);
+    if (mWakeup < 0)
+      throw std::runtime_error(strerror(errno));
+  }
+
+  /// Plain reads and writes need Linux 5.6 or newer.
+  void CheckOpcodes()
+  {
+    constexpr unsigned count = IORING_OP_LAST;
+    std::vector<char> memory(sizeof(io_uring_probe) +
+                             count * sizeof(io_uring_probe_op));
+    auto probe = reinterpret_cast<io_uring_probe*>(memory.data());
+
+    if (syscall(__NR_io_uring_register,
+                mRing,
+                IORING_REGISTER_PROBE,
+                probe,
+                count) < 0)
+      throw std::runtime_error(strerror(errno));
+
+    for (int opcode : { IORING_OP_READ,
+                        IORING_OP_WRITE,
+                        IORING_OP_FSYNC,
+                        IORING_OP_POLL_ADD }) {
+      if (opcode > probe->last_op ||
+          !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED))
+        throw std::runtime_error("Missing opcode " + std::to_string(opcode));
+    }
+  }
+
+  void* MapRing(size_t aLength, off_t aOffset)
+  {
+    void* result = mmap(nullptr,
+                        aLength,
+                        PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE,
+                        mRing,
+                        aOffset);
+    if (result == MAP_FAILED)
+      throw std::runtime_error(strerror(errno));
+    return result;
+  }
+
+  void Release()
+  {
+    if (mSqes)
+      munmap(mSqes, mSqesLength);
+    if (mCqMemory && mCqMemory != mSqMemory)
+      munmap(mCqMemory, mCqLength);
+    if (mSqMemory)
+      munmap(mSqMemory, mSqLength);
+
+    // Closing the ring cancels the last wake-up poll.
+    if (mRing >= 0)
+      close(mRing);
+    if (mWakeup >= 0)
+      close(mWakeup);
+  }
+
+  void Wake() { eventfd_write(mWakeup, 1); }
+
+  void MainLoop()
+  {
+    ProfilerScope profile("disk");
+    ApplyThreadClass("disk");
+    PushWakeup();
+
+    while (true) {
+      // The wake-up poll does not count as outstanding work.
+      bool drained = PushQueue() && mInFlight == 0;
+      if (drained && !mRunning)
+        break;
+
+      Enter();
+      Reap();
+    }
+  }
+
+  /// Move as many requests as possible to the ring (true if all of them).
+  bool PushQueue()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    // The completion ring is twice as big so it can never overflow.
+    while (!mQueue.empty() && mInFlight + 1 < Entries) {
+      PushRequest(mQueue.front().release());
+      mQueue.pop_front();
+      mInFlight += 1;
+    }
+
+    return mQueue.empty();
+  }
+
+  io_uring_sqe& PushEntry()
+  {
+    unsigned tail = *mSqTail;
+    unsigned index = tail & *mSqMask;
+    io_uring_sqe& result = mSqes[index];
+
+    memset(&result, 0, sizeof(result));
+    mSqArray[index] = index;
+    __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+    mUnsubmitted += 1;
+    return result;
+  }
+
+  void PushRequest(Request* aRequest)
+  {
+    io_uring_sqe& entry = PushEntry();
+    entry.fd = aRequest->File;
+    entry.user_data = reinterpret_cast<uint64_t>(aRequest);
+
+    switch (aRequest->Type) {
+      case Request::Kind::Read:
+        entry.opcode = IORING_OP_READ;
+        break;
+      case Request::Kind::Write:
+        entry.opcode = IORING_OP_WRITE;
+        break;
+      case Request::Kind::Sync:
+        entry.opcode = IORING_OP_FSYNC;
+        entry.fsync_flags = IORING_FSYNC_DATASYNC;
+        return;
+    }
+
+    entry.addr = reinterpret_cast<uint64_t>(aRequest->Buffer);
+    entry.len = static_cast<uint32_t>(aRequest->Size);
+    entry.off = aRequest->Offset;
+  }
+
+  /// Tagged with zero instead of a request.
+  void PushWakeup()
+  {
+    io_uring_sqe& entry = PushEntry();
+    entry.opcode = IORING_OP_POLL_ADD;
+    entry.fd = mWakeup;
+    entry.poll_events = POLLIN;
+  }
+
+  /// Submit everything and wait for at least one completion.
+  void Enter()
+  {
+    while (true) {
+      long status = syscall(__NR_io_uring_enter,
+                            mRing,
+                            mUnsubmitted,
+                            1,
+                            IORING_ENTER_GETEVENTS,
+                            nullptr,
+                            0);
+
+      if (status >= 0) {
+        mUnsubmitted -= static_cast<unsigned>(status);
+        return;
+      } else if (errno == EAGAIN || errno == EBUSY) {
+        // Reaping frees up kernel resources.
+        return;
+      } else if (errno != EINTR) {
+        throw std::runtime_error(strerror(errno));
+      }
+    }
+  }
+
+  void Reap()
+  {
+    unsigned head = *mCqHead;
+
+    while (head != __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE)) {
+      const io_uring_cqe& entry = mCqes[head & *mCqMask];
+      auto request = reinterpret_cast<Request*>(entry.user_data);
+      long result = entry.res;
+
+      // Hand the slot back before running any callbacks.
+      head += 1;
+      __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+
+      if (!request) {
+        eventfd_t value;
+        eventfd_read(mWakeup, &value);
+        PushWakeup();
+        continue;
+      }
+
+      std::unique_ptr<Request> owner(request);
+      mInFlight -= 1;
+
+      if (!FinishRequest(*owner, result)) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mQueue.emplace_front(std::move(owner));
+      }
+    }
+  }
+};
+
+#endif
+
+}
+
+//===========================================================================//
+//=== Globals ===============================================================//
+//===========================================================================//
+
+namespace {
+
+DiskBackend* gBackend = nullptr;
+
+void
+SubmitRequest(std::unique_ptr<Request> aRequest)
+{
+  assert(gBackend);
+  aRequest->Start = std::chrono::steady_clock::now();
+  gBackend->Submit(std::move(aRequest));
+}
+
+}
+
+void
+DiskRead(int aFile,
+         void* aBuffer,
+         size_t aSize,
+         uint64_t aOffset,
+         DiskCallback aDone)
+{
+  auto request = std::make_unique<Request>();
+  request->Type = Request::Kind::Read;
+  request->File = aFile;
+  request->Buffer = static_cast<char*>(aBuffer);
+  request->Size = aSize;
+  request->Offset = aOffset;
+  request->Callback = std::move(aDone);
+  SubmitRequest(std::move(request));
+}
+
+void
+DiskWrite(int aFile,
+          const void* aBuffer,
+          size_t aSize,
+          uint64_t aOffset,
+          DiskCallback aDone)
+{
+  auto request = std::make_unique<Request>();
+  request->Type = Request::Kind::Write;
+  request->File = aFile;
+  // The buffer is never written to.
+  request->Buffer = static_cast<char*>(const_cast<void*>(aBuffer));
+  request->Size = aSize;
+  request->Offset = aOffset;
+  request->Callback = std::move(aDone);
+  SubmitRequest(std::move(request));
+}
+
+void
+DiskSync(int aFile, DiskCallback aDone)
+{
+  auto request = std::make_unique<Request>();
+  request->Type = Request::Kind::Sync;
+  request->File = aFile;
+  request->Callback = std::move(aDone);
+  SubmitRequest(std::move(request));
+}
+
+const char*
+GetDiskBackend()
+{
+  assert(gBackend);
+  return gBackend->GetName();
+}
+
+void
+InitDisk()
+{
+  assert(!gBackend);
+
+#ifdef HAVE_IO_URING
+  try {
+    gBackend = new UringBackend;
+  } catch (const std::exception& error) {
+    // Containers and old kernels often block or lack io_uring.
+    SDL_LogWarn(0, "io_uring is not available: %s", error.what());
+  }
+#endif
+
+  if (!gBackend)
+    gBackend = new PoolBackend(GetConfig()->DiskThreads);
+
+  SDL_Log("Disk backend: %s", gBackend->GetName());
+}
+
+void
+FreeDisk()
+{
+  assert(gBackend);
+  delete gBackend;
+  gBackend = nullptr;
+}
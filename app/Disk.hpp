@@ -0,0 +1,51 @@
+#ifndef DISK_HPP
+#define DISK_HPP
+
+/**
+ * \file
+ * \brief Asynchronous file i/o (io_uring or thread pool).
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/**
+ * \brief Called once the operation is done (on an i/o thread).
+ *
+ * The argument is the number of bytes transferred or a negative error code.
+ * Writes are always complete when this succeeds; reads are only short at the
+ * end of the file.
+ */
+using DiskCallback = std::function<void(long)>;
+
+/// Read from the file descriptor; the buffer must stay alive until the end.
+void
+DiskRead(int aFile,
+         void* aBuffer,
+         size_t aSize,
+         uint64_t aOffset,
+         DiskCallback aDone);
+/// Write to the file descriptor; the buffer must stay alive until the end.
+void
+DiskWrite(int aFile,
+          const void* aBuffer,
+          size_t aSize,
+          uint64_t aOffset,
+          DiskCallback aDone);
+/// Flush the file contents (but not necessarily the metadata) to storage.
+void
+DiskSync(int aFile, DiskCallback aDone);
+
+/// Name of the backend that was picked at startup.
+const char*
+GetDiskBackend();
+
+/// Boot the i/o threads (io_uring if the kernel supports it).
+void
+InitDisk();
+/// Finish every queued operation and shut down the threads.
+void
+FreeDisk();
+
+#endif
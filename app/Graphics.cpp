@@ -2,14 +2,17 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <functional>
+#include <string_view>
 #include <vector>
 
 #include <SDL_ttf.h>
-#include <cmrc/cmrc.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-CMRC_DECLARE(rc);
+#include "Config.hpp"
+#include "Helper.hpp"
+#include "Trace.hpp"
 
 //===========================================================================//
 //=== Globals ===============================================================//
@@ -134,6 +137,27 @@ SDL_UnionRect(const SDL_FRect* A, const SDL_FRect* B, SDL_FRect* result)
 }
 
 TTF_Font* gFont = nullptr;
+/// Point size of the open font.
+int64_t gFontSize = 0;
+
+/// Open the font again when the configured size changes.
+void
+OpenFont()
+{
+  int64_t size = GetConfig()->FontSize;
+  if (gFont && size == gFontSize)
+    return;
+
+  if (gFont)
+    TTF_CloseFont(gFont);
+
+  // Actual font file is embedded in the executable.
+  std::string_view buffer = OpenResource("font.ttf");
+  SDL_RWops* ops = SDL_RWFromConstMem(buffer.data(), buffer.size());
+  gFont = TTF_OpenFontRW(ops, 1, static_cast<int>(size));
+  gFontSize = size;
+  assert(gFont);
+}
 
 }
 
@@ -154,14 +178,7 @@ InitGraphics()
     SDL_Log("TTF version: %d.%d.%d", ver->major, ver->minor, ver->patch);
   }
 
-  // Actual font file is embedded in the executable.
-  {
-    auto fs = cmrc::rc::get_filesystem();
-    auto buffer = fs.open("font.ttf");
-    SDL_RWops* ops = SDL_RWFromConstMem(buffer.begin(), buffer.size());
-    gFont = TTF_OpenFontRW(ops, 1, 256);
-    assert(gFont);
-  }
+  OpenFont();
 }
 
 void
@@ -171,6 +188,7 @@ FreeGraphics()
   TTF_CloseFont(gFont);
   TTF_Quit();
   gFont = nullptr;
+  gFontSize = 0;
 }
 
 //===========================================================================//
@@ -318,6 +336,7 @@ void
 Texture::StrokeText(const char* aText)
 {
   SDL_Color fg{ 0xFF, 0xFF, 0xFF, 0xFF };
+  OpenFont();
   SDL_Surface* surface = TTF_RenderText_Blended(gFont, aText, fg);
 
   if (!surface) {
@@ -350,6 +369,23 @@ Texture::StrokeText(const char* aText)
   SDL_FreeSurface(surface);
 }
 
+void
+Texture::Unload()
+{
+  GLint prev;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev);
+  glBindTexture(GL_TEXTURE_2D, mHandle);
+
+  // An empty image keeps the handle and its parameters.
+  glTexImage2D(
+    GL_TEXTURE_2D, 0, GL_RGBA, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+  glBindTexture(GL_TEXTURE_2D, prev);
+
+  mWidth = 0;
+  mHeight = 0;
+}
+
 //===========================================================================//
 //=== RenderNode ============================================================//
 //===========================================================================//
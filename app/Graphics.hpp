@@ -31,6 +31,8 @@ public:
 
   void LoadImage(const SDL_Surface& aImage);
   void StrokeText(const char* aText);
+  /// Free the pixels but keep the aspect ratio so layouts stay put.
+  void Unload();
 };
 
 class RenderNode
@@ -2,6 +2,18 @@
 
 #include <cstddef>
 #include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <cmrc/cmrc.hpp>
+#ifdef COMPRESS_RESOURCES
+#include <zstd.h>
+#endif
+
+#include "Metrics.hpp"
+
+CMRC_DECLARE(rc);
 
 //===========================================================================//
 //=== Stream ================================================================//
@@ -99,3 +111,166 @@ CppToRW(std::unique_ptr<std::istream> aFile)
   ops->hidden.unknown.data1 = aFile.release();
   return ops;
 }
+
+//===========================================================================//
+//=== Resources =============================================================//
+//===========================================================================//
+
+#ifdef COMPRESS_RESOURCES
+
+namespace {
+
+std::mutex gResourceMutex;
+/// Inflated files; the nodes (and their strings) never move.
+std::unordered_map<std::string, std::string> gResources;
+
+}
+
+std::string_view
+OpenResource(const std::string& aName)
+{
+  std::unique_lock<std::mutex> lock(gResourceMutex);
+  auto it = gResources.find(aName);
+  if (it != gResources.end())
+    return it->second;
+
+  // The build stores every file with this suffix.
+  auto fs = cmrc::rc::get_filesystem();
+  auto packed = fs.open(aName + ".zst");
+  auto size = ZSTD_getFrameContentSize(packed.begin(), packed.size());
+  if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN)
+    throw std::runtime_error("Corrupt resource: " + aName);
+
+  std::string result(size, '\0');
+  size_t status = ZSTD_decompress(
+    result.data(), result.size(), packed.begin(), packed.size());
+  if (ZSTD_isError(status) || status != result.size())
+    throw std::runtime_error("Corrupt resource: " + aName);
+
+  CountMetric("resource.inflated", result.size());
+  return gResources.emplace(aName, std::move(result)).first->second;
+}
+
+#else
+
+std::string_view
+OpenResource(const std::string& aName)
+{
+  auto fs = cmrc::rc::get_filesystem();
+  auto file = fs.open(aName);
+  return { file.begin(), file.size() };
+}
+
+#endif
+
+//===========================================================================//
+//=== Hash ==================================================================//
+//===========================================================================//
+
+namespace {
+
+constexpr uint64_t Prime1 = 11400714785074694791ULL;
+constexpr uint64_t Prime2 = 14029467366897019727ULL;
+constexpr uint64_t Prime3 = 1609587929392839161ULL;
+constexpr uint64_t Prime4 = 9650029242287828579ULL;
+constexpr uint64_t Prime5 = 2870177450012600261ULL;
+
+uint64_t
+RotateLeft(uint64_t aValue, int aCount)
+{
+  return (aValue << aCount) | (aValue >> (64 - aCount));
+}
+
+/// Unaligned little-endian loads.
+uint64_t
+Load64(const unsigned char* aData)
+{
+  uint64_t result = 0;
+  for (int i = 7; i >= 0; --i)
+    result = result << 8 | aData[i];
+  return result;
+}
+
+uint32_t
+Load32(const unsigned char* aData)
+{
+  uint32_t result = 0;
+  for (int i = 3; i >= 0; --i)
+    result = result << 8 | aData[i];
+  return result;
+}
+
+uint64_t
+HashRound(uint64_t aAccumulator, uint64_t aInput)
+{
+  aAccumulator += aInput * Prime2;
+  aAccumulator = RotateLeft(aAccumulator, 31);
+  return aAccumulator * Prime1;
+}
+
+uint64_t
+HashMerge(uint64_t aAccumulator, uint64_t aValue)
+{
+  aAccumulator ^= HashRound(0, aValue);
+  return aAccumulator * Prime1 + Prime4;
+}
+
+}
+
+uint64_t
+HashBytes(const void* aData, size_t aSize, uint64_t aSeed)
+{
+  auto cursor = reinterpret_cast<const unsigned char*>(aData);
+  auto end = cursor + aSize;
+  uint64_t result;
+
+  if (aSize >= 32) {
+    uint64_t v1 = aSeed + Prime1 + Prime2;
+    uint64_t v2 = aSeed + Prime2;
+    uint64_t v3 = aSeed;
+    uint64_t v4 = aSeed - Prime1;
+
+    // Four independent lanes keep the pipeline busy.
+    for (; cursor + 32 <= end; cursor += 32) {
+      v1 = HashRound(v1, Load64(cursor + 0));
+      v2 = HashRound(v2, Load64(cursor + 8));
+      v3 = HashRound(v3, Load64(cursor + 16));
+      v4 = HashRound(v4, Load64(cursor + 24));
+    }
+
+    result = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) +
+             RotateLeft(v4, 18);
+    result = HashMerge(result, v1);
+    result = HashMerge(result, v2);
+    result = HashMerge(result, v3);
+    result = HashMerge(result, v4);
+  } else {
+    result = aSeed + Prime5;
+  }
+
+  result += static_cast<uint64_t>(aSize);
+
+  for (; cursor + 8 <= end; cursor += 8) {
+    result ^= HashRound(0, Load64(cursor));
+    result = RotateLeft(result, 27) * Prime1 + Prime4;
+  }
+
+  if (cursor + 4 <= end) {
+    result ^= static_cast<uint64_t>(Load32(cursor)) * Prime1;
+    result = RotateLeft(result, 23) * Prime2 + Prime3;
+    cursor += 4;
+  }
+
+  for (; cursor < end; ++cursor) {
+    result ^= (*cursor) * Prime5;
+    result = RotateLeft(result, 11) * Prime1;
+  }
+
+  // Final avalanche.
+  result ^= result >> 33;
+  result *= Prime2;
+  result ^= result >> 29;
+  result *= Prime3;
+  result ^= result >> 32;
+  return result;
+}
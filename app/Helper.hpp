@@ -6,8 +6,12 @@
  * \brief Common functions that are used everywhere.
  */
 
+#include <cstddef>
+#include <cstdint>
 #include <istream>
 #include <memory>
+#include <string>
+#include <string_view>
 
 #include <SDL.h>
 
@@ -18,4 +22,17 @@ CppToRW(std::istream& aFile);
 SDL_RWops*
 CppToRW(std::unique_ptr<std::istream> aFile);
 
+/**
+ * \brief Embedded file from the `data` directory (thread-safe).
+ *
+ * Compressed builds inflate the file on first use and keep it for the rest of
+ * the run. Throws \c std::system_error if there is no such file.
+ */
+std::string_view
+OpenResource(const std::string& aName);
+
+/// Fast non-cryptographic 64-bit hash (XXH64).
+uint64_t
+HashBytes(const void* aData, size_t aSize, uint64_t aSeed = 0);
+
 #endif
@@ -1,19 +1,36 @@
 #include "Json.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
-#include <cmrc/cmrc.hpp>
+#include <SDL.h>
 #include <rapidjson/document.h>
 #include <rapidjson/error/en.h>
 #include <rapidjson/istreamwrapper.h>
 #include <rapidjson/memorystream.h>
+#include <rapidjson/reader.h>
 #include <rapidjson/schema.h>
 #include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#ifdef USE_SIMDJSON
+#include <simdjson.h>
+#endif
 
-CMRC_DECLARE(rc);
+#include "Config.hpp"
+#include "Helper.hpp"
+#include "Metrics.hpp"
+#include "Schema.hpp"
 
 //===========================================================================//
 //=== JSON ==================================================================//
@@ -66,14 +83,15 @@ class SchemaProvider : public rapidjson::IRemoteSchemaDocumentProvider
 {
   std::optional<rapidjson::SchemaDocument> mMetaSchema;
   std::unordered_map<std::string, rapidjson::SchemaDocument> mTable;
+  /// Loading a schema looks up the schemas it refers to.
+  std::recursive_mutex mMutex;
 
 public:
   SchemaProvider()
   {
-    auto fs = cmrc::rc::get_filesystem();
-    auto buffer = fs.open("schema-meta.json");
+    std::string_view buffer = OpenResource("schema-meta.json");
 
-    rapidjson::MemoryStream wrapper(buffer.begin(), buffer.size());
+    rapidjson::MemoryStream wrapper(buffer.data(), buffer.size());
     rapidjson::Document dom = ReadJsonDocument(wrapper);
     mMetaSchema.emplace(dom);
     ValidateJsonDocument(dom, mMetaSchema.value());
@@ -84,6 +102,7 @@ public:
     rapidjson::SizeType aLinkLength) override
   {
     (void)aLinkLength;
+    std::unique_lock<std::recursive_mutex> lock(mMutex);
     std::string key;
 
     // Compute the key by cutting at the pount sign.
@@ -102,10 +121,9 @@ public:
 
     // Insert new elements into the table if required.
     if (iter == mTable.end()) {
-      auto fs = cmrc::rc::get_filesystem();
-      auto buffer = fs.open(key);
+      std::string_view buffer = OpenResource(key);
 
-      rapidjson::MemoryStream wrapper(buffer.begin(), buffer.size());
+      rapidjson::MemoryStream wrapper(buffer.data(), buffer.size());
       rapidjson::Document dom = ReadJsonDocument(wrapper);
       ValidateJsonDocument(dom, mMetaSchema.value());
 
@@ -121,7 +139,156 @@ public:
   }
 };
 
-SchemaProvider gProvider;
+#ifdef COMPILED_SCHEMAS
+/// Same error format as the generic validator.
+template<typename T>
+void
+ValidateCompiledDocument(const T& aDocument, const std::string& aSchema)
+{
+  SchemaFunction<T> function = FindSchemaFunction<T>(aSchema);
+  if (!function)
+    throw std::runtime_error("Unknown JSON schema: " + aSchema);
+
+  SchemaError error;
+  if (!function(aDocument, error)) {
+    std::ostringstream oss;
+    oss << "JSON validation error:" << std::endl;
+    oss << '\t' << "Document pointer: #" << error.DocumentPointer << std::endl;
+    oss << '\t' << "Schema pointer: " << error.SchemaPointer << std::endl;
+    oss << '\t' << "Schema keyword: " << error.Keyword;
+    throw std::runtime_error(oss.str());
+  }
+}
+
+void
+ValidateJsonDocument(const rapidjson::Value& aDocument,
+                     const std::string& aSchema)
+{
+  ValidateCompiledDocument(aDocument, aSchema);
+}
+
+#ifdef USE_SIMDJSON
+void
+ValidateJsonDocument(const simdjson::dom::element& aDocument,
+                     const std::string& aSchema)
+{
+  ValidateCompiledDocument(aDocument, aSchema);
+}
+#endif
+#else
+/// Built on first use so the schemas are only parsed if needed.
+SchemaProvider&
+GetProvider()
+{
+  static SchemaProvider instance;
+  return instance;
+}
+
+void
+ValidateJsonDocument(const rapidjson::Value& aDocument,
+                     const std::string& aSchema)
+{
+  auto schema = GetProvider().GetRemoteDocument(aSchema.c_str(), 0);
+  ValidateJsonDocument(aDocument, *schema);
+}
+#endif
+
+/// Remember hashes of payloads that already passed validation.
+class ValidationCache
+{
+  struct Entry
+  {
+    /// Most recently used at the front.
+    std::list<uint64_t> Order;
+    std::unordered_map<uint64_t, std::list<uint64_t>::iterator> Lookup;
+  };
+
+  std::unordered_map<std::string, Entry> mTable;
+  /// Every decoder thread shares the cache.
+  std::mutex mMutex;
+
+public:
+  bool Contains(const std::string& aSchema, uint64_t aHash)
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    Entry& ref = mTable[aSchema];
+    auto it = ref.Lookup.find(aHash);
+
+    if (it == ref.Lookup.end())
+      return false;
+
+    ref.Order.splice(ref.Order.begin(), ref.Order, it->second);
+    return true;
+  }
+
+  void Insert(const std::string& aSchema, uint64_t aHash)
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    Entry& ref = mTable[aSchema];
+
+    if (ref.Lookup.count(aHash) != 0)
+      return;
+
+    // The limit can shrink when the configuration is reloaded.
+    auto limit = static_cast<size_t>(GetConfig()->ValidationCacheSize);
+    while (ref.Order.size() >= limit) {
+      ref.Lookup.erase(ref.Order.back());
+      ref.Order.pop_back();
+    }
+
+    ref.Order.push_front(aHash);
+    ref.Lookup.emplace(aHash, ref.Order.begin());
+  }
+
+  void Clear()
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTable.clear();
+  }
+};
+
+ValidationCache gValidated;
+
+/// Skip validation for payloads identical to one that passed before.
+template<typename T>
+void
+ValidateJsonPayload(const T& aDocument,
+                    const std::string& aSchema,
+                    std::string_view aPayload)
+{
+  uint64_t hash = HashBytes(aPayload.data(), aPayload.size());
+
+  if (gValidated.Contains(aSchema, hash)) {
+    CountMetric("json.validation.hit");
+    return;
+  }
+
+  CountMetric("json.validation.miss");
+  ValidateJsonDocument(aDocument, aSchema);
+  gValidated.Insert(aSchema, hash);
+}
+
+/// Bytes are needed up-front to compute the hash.
+std::string
+ReadPayload(std::istream& aInput)
+{
+  std::ostringstream oss;
+  oss << aInput.rdbuf();
+  return oss.str();
+}
+
+/// Parse and decode speed of a complete payload in MB/s.
+void
+RecordThroughput(const char* aName,
+                 size_t aSize,
+                 std::chrono::steady_clock::time_point aStart)
+{
+  std::chrono::duration<double, std::micro> elapsed =
+    std::chrono::steady_clock::now() - aStart;
+
+  if (elapsed.count() > 0)
+    RecordMetric(aName, aSize / elapsed.count());
+}
 
 }
 
@@ -195,14 +362,100 @@ ReadApiFuzzyTile(const rapidjson::Value& aValue)
   return result;
 }
 
+/// None of these fields are covered by the schemas so check every type.
+void
+ReadApiTileAttributes(const rapidjson::Value& aValue, ApiTileTable& aTable)
+{
+  aTable.AppendEmpty();
+
+  auto type = aValue.FindMember("type");
+  if (type != aValue.MemberEnd() && type->value.IsString()) {
+    const char* name = type->value.GetString();
+
+    if (strcmp(name, "DmcSeries") == 0)
+      aTable.Types.back() = ApiTileTable::Series;
+    else if (strcmp(name, "DmcVideo") == 0)
+      aTable.Types.back() = ApiTileTable::Video;
+    else if (strcmp(name, "StandardCollection") == 0)
+      aTable.Types.back() = ApiTileTable::Collection;
+  }
+
+  auto availability = aValue.FindMember("currentAvailability");
+  if (availability != aValue.MemberEnd() && availability->value.IsObject()) {
+    const rapidjson::Value& table = availability->value;
+    auto region = table.FindMember("region");
+    auto kids = table.FindMember("kidsMode");
+
+    if (region != table.MemberEnd() && region->value.IsString())
+      aTable.Regions.back() = PackRegion(region->value.GetString());
+
+    if (kids != table.MemberEnd() && kids->value.IsBool())
+      aTable.Kids.back() = kids->value.GetBool() ? ApiTileTable::KidsIncluded
+                                                 : ApiTileTable::KidsExcluded;
+  }
+
+  auto releases = aValue.FindMember("releases");
+  if (releases != aValue.MemberEnd() && releases->value.IsArray())
+    for (const auto& ent : releases->value.GetArray()) {
+      if (!ent.IsObject())
+        continue;
+
+      auto year = ent.FindMember("releaseYear");
+      if (year != ent.MemberEnd() && year->value.IsInt()) {
+        aTable.Years.back() = std::clamp(year->value.GetInt(), 0, 0xFFFF);
+        break;
+      }
+    }
+
+  auto tags = aValue.FindMember("tags");
+  if (tags != aValue.MemberEnd() && tags->value.IsArray())
+    for (const auto& ent : tags->value.GetArray()) {
+      if (!ent.IsObject())
+        continue;
+
+      auto type = ent.FindMember("type");
+      auto value = ent.FindMember("value");
+      if (type == ent.MemberEnd() || !type->value.IsString())
+        continue;
+      else if (value == ent.MemberEnd() || !value->value.IsString())
+        continue;
+
+      if (strcmp(type->value.GetString(), "disneyPlusOriginal") == 0)
+        aTable.Originals.back() = strcmp(value->value.GetString(), "true") == 0;
+    }
+}
+
 ApiFuzzySet
 ReadApiFuzzySet(const rapidjson::Value& aValue)
 {
   ApiFuzzySet result;
   result.Text = ReadApiFuzzyText(aValue["text"]);
 
-  for (const auto& ent : aValue["items"].GetArray())
+  for (const auto& ent : aValue["items"].GetArray()) {
     result.Tiles.emplace_back(ReadApiFuzzyTile(ent));
+    ReadApiTileAttributes(ent, result.Attributes);
+  }
+
+  auto id = aValue.FindMember("setId");
+  if (id != aValue.MemberEnd())
+    result.SetId = id->value.GetString();
+
+  result.TotalCount = result.Tiles.size();
+  auto meta = aValue.FindMember("meta");
+  if (meta != aValue.MemberEnd()) {
+    const rapidjson::Value& table = meta->value;
+    const rapidjson::Value& hits = table["hits"];
+    const rapidjson::Value& offset = table["offset"];
+    const rapidjson::Value& size = table["page_size"];
+
+    // The schema allows negative numbers.
+    if (hits.IsUint64() && offset.IsUint64() && size.IsUint64()) {
+      result.PageOffset = offset.GetUint64();
+      result.PageSize = size.GetUint64();
+      result.TotalCount = std::max<size_t>(
+        hits.GetUint64(), result.PageOffset + result.Tiles.size());
+    }
+  }
 
   return result;
 }
@@ -217,38 +470,780 @@ ReadApiSetRef(const rapidjson::Value& aValue)
   return result;
 }
 
+ApiContainer
+ReadApiContainer(const rapidjson::Value& aValue)
+{
+  const rapidjson::Value& set = aValue["set"];
+
+  if (strcmp(set["type"].GetString(), "SetRef") == 0)
+    return ReadApiSetRef(set);
+  else
+    return ReadApiFuzzySet(set);
+}
+
+/// Decode a single container that was cut out of the home screen.
+ApiContainer
+ReadApiContainer(std::string_view aPayload)
+{
+  rapidjson::MemoryStream wrapper(aPayload.data(), aPayload.size());
+  rapidjson::Document dom = ReadJsonDocument(wrapper);
+  ValidateJsonPayload(dom, "schema-shelf.json", aPayload);
+  return ReadApiContainer(dom);
+}
+
+}
+
+//===========================================================================//
+//=== simdjson ==============================================================//
+//===========================================================================//
+
+#ifdef USE_SIMDJSON
+
+namespace {
+
+/**
+ * These mirror the RapidJSON readers above and must produce identical
+ * results. Documents are validated first so the accessors never throw.
+ */
+using Element = simdjson::dom::element;
+
+/// Reused because allocating the internal buffers is expensive.
+thread_local simdjson::dom::parser gParser;
+
+/// Stays valid until the next document is parsed on this thread.
+Element
+ParseSimdDocument(std::string& aPayload)
+{
+  // Parse in place instead of copying into a padded buffer.
+  aPayload.reserve(aPayload.size() + simdjson::SIMDJSON_PADDING);
+
+  Element result;
+  auto error =
+    gParser.parse(aPayload.data(), aPayload.size(), false).get(result);
+
+  if (error) {
+    std::ostringstream oss;
+    oss << "JSON parsing error: " << simdjson::error_message(error);
+    throw std::runtime_error(oss.str());
+  }
+
+  return result;
+}
+
+/// The web API likes objects with a single unknown key.
+Element
+GetFirstValue(const Element& aValue)
+{
+  simdjson::dom::object table = aValue;
+  return (*table.begin()).value;
+}
+
+ApiImage
+ReadApiImage(std::string_view aKey, const Element& aValue)
+{
+  ApiImage result;
+  result.AspectRatio = atof(std::string(aKey).c_str());
+
+  if (result.AspectRatio > 0) {
+    Element table = GetFirstValue(aValue)["default"];
+    result.MasterWidth = static_cast<int>(int64_t(table["masterWidth"]));
+    result.MasterHeight = static_cast<int>(int64_t(table["masterHeight"]));
+    result.ResourceLink = std::string_view(table["url"]);
+  }
+
+  return result;
+}
+
+ApiFuzzyText
+ReadApiFuzzyText(const Element& aValue)
+{
+  ApiFuzzyText result;
+
+  {
+    Element title = aValue["title"];
+    Element full;
+    Element slug;
+
+    if (title["full"].get(full) == simdjson::SUCCESS) {
+      Element entry = GetFirstValue(full)["default"];
+      result.FullTitle = std::string_view(entry["content"]);
+    }
+
+    if (title["slug"].get(slug) == simdjson::SUCCESS) {
+      Element entry = GetFirstValue(slug)["default"];
+      result.SlugTitle = std::string_view(entry["content"]);
+    }
+  }
+
+  return result;
+}
+
+ApiFuzzyTile
+ReadApiFuzzyTile(const Element& aValue)
+{
+  ApiFuzzyTile result;
+  result.Text = ReadApiFuzzyText(aValue["text"]);
+
+  {
+    simdjson::dom::object tile;
+
+    if (aValue["image"]["tile"].get(tile) == simdjson::SUCCESS)
+      for (const auto& ent : tile)
+        result.TileImages.emplace_back(ReadApiImage(ent.key, ent.value));
+  }
+
+  return result;
+}
+
+void
+ReadApiTileAttributes(const Element& aValue, ApiTileTable& aTable)
+{
+  aTable.AppendEmpty();
+
+  std::string_view type;
+  if (aValue["type"].get(type) == simdjson::SUCCESS) {
+    if (type == "DmcSeries")
+      aTable.Types.back() = ApiTileTable::Series;
+    else if (type == "DmcVideo")
+      aTable.Types.back() = ApiTileTable::Video;
+    else if (type == "StandardCollection")
+      aTable.Types.back() = ApiTileTable::Collection;
+  }
+
+  simdjson::dom::object availability;
+  if (aValue["currentAvailability"].get(availability) == simdjson::SUCCESS) {
+    std::string_view region;
+    bool kids;
+
+    if (availability["region"].get(region) == simdjson::SUCCESS)
+      aTable.Regions.back() = PackRegion(region);
+
+    if (availability["kidsMode"].get(kids) == simdjson::SUCCESS)
+      aTable.Kids.back() =
+        kids ? ApiTileTable::KidsIncluded : ApiTileTable::KidsExcluded;
+  }
+
+  simdjson::dom::array releases;
+  if (aValue["releases"].get(releases) == simdjson::SUCCESS)
+    for (Element ent : releases) {
+      int64_t year;
+
+      // Same as RapidJSON's IsInt() on objects with the field.
+      if (!ent.is_object())
+        continue;
+      else if (ent["releaseYear"].get(year) != simdjson::SUCCESS)
+        continue;
+      else if (year < INT32_MIN || year > INT32_MAX)
+        continue;
+
+      aTable.Years.back() = std::clamp<int64_t>(year, 0, 0xFFFF);
+      break;
+    }
+
+  simdjson::dom::array tags;
+  if (aValue["tags"].get(tags) == simdjson::SUCCESS)
+    for (Element ent : tags) {
+      std::string_view type;
+      std::string_view value;
+
+      if (!ent.is_object())
+        continue;
+      else if (ent["type"].get(type) != simdjson::SUCCESS)
+        continue;
+      else if (ent["value"].get(value) != simdjson::SUCCESS)
+        continue;
+
+      if (type == "disneyPlusOriginal")
+        aTable.Originals.back() = value == "true";
+    }
+}
+
+ApiFuzzySet
+ReadApiFuzzySet(const Element& aValue)
+{
+  ApiFuzzySet result;
+  result.Text = ReadApiFuzzyText(aValue["text"]);
+
+  for (Element ent : simdjson::dom::array(aValue["items"])) {
+    result.Tiles.emplace_back(ReadApiFuzzyTile(ent));
+    ReadApiTileAttributes(ent, result.Attributes);
+  }
+
+  std::string_view id;
+  if (aValue["setId"].get(id) == simdjson::SUCCESS)
+    result.SetId = id;
+
+  result.TotalCount = result.Tiles.size();
+  simdjson::dom::object meta;
+  if (aValue["meta"].get(meta) == simdjson::SUCCESS) {
+    uint64_t hits;
+    uint64_t offset;
+    uint64_t size;
+
+    // Same as RapidJSON's IsUint64() on the fields.
+    if (meta["hits"].get(hits) == simdjson::SUCCESS &&
+        meta["offset"].get(offset) == simdjson::SUCCESS &&
+        meta["page_size"].get(size) == simdjson::SUCCESS) {
+      result.PageOffset = offset;
+      result.PageSize = size;
+      result.TotalCount =
+        std::max<size_t>(hits, result.PageOffset + result.Tiles.size());
+    }
+  }
+
+  return result;
+}
+
+ApiSetRef
+ReadApiSetRef(const Element& aValue)
+{
+  ApiSetRef result;
+  result.Text = ReadApiFuzzyText(aValue["text"]);
+  result.ReferenceId = std::string_view(aValue["refId"]);
+  result.ReferenceType = std::string_view(aValue["refType"]);
+  return result;
+}
+
+ApiContainer
+ReadApiContainer(const Element& aValue)
+{
+  Element set = aValue["set"];
+
+  if (std::string_view(set["type"]) == "SetRef")
+    return ReadApiSetRef(set);
+  else
+    return ReadApiFuzzySet(set);
+}
+
+ApiHome
+ReadSimdApiHome(std::string& aPayload)
+{
+  auto start = std::chrono::steady_clock::now();
+  Element dom = ParseSimdDocument(aPayload);
+  ValidateJsonPayload(dom, "schema-home.json", aPayload);
+
+  ApiHome result;
+  Element collection = GetFirstValue(dom["data"]);
+  result.Text = ReadApiFuzzyText(collection["text"]);
+
+  for (Element container : simdjson::dom::array(collection["containers"]))
+    result.Containers.emplace_back(ReadApiContainer(container));
+
+  RecordThroughput("json.simdjson.throughput", aPayload.size(), start);
+  return result;
+}
+
+ApiFuzzySet
+ReadSimdApiFuzzySet(std::string& aPayload)
+{
+  auto start = std::chrono::steady_clock::now();
+  Element dom = ParseSimdDocument(aPayload);
+  ValidateJsonPayload(dom, "schema-ref.json", aPayload);
+
+  ApiFuzzySet result = ReadApiFuzzySet(GetFirstValue(dom["data"]));
+  RecordThroughput("json.simdjson.throughput", aPayload.size(), start);
+  return result;
+}
+
+}
+
+#endif
+
+//===========================================================================//
+//=== Streaming =============================================================//
+//===========================================================================//
+
+namespace {
+
+/// Keys of the objects that lead to the containers of the home screen.
+const char* const gContainerPath[] = { "data",
+                                       "StandardCollection",
+                                       "containers" };
+
+/**
+ * \brief Whether the array that was just opened holds the containers.
+ *
+ * The SAX handlers keep a key for each open object and array (with the new
+ * array on top), which is looked up by its level.
+ */
+template<typename T>
+bool
+IsContainerArray(size_t aDepth, T&& aGetKey)
+{
+  const size_t length = std::size(gContainerPath);
+  if (aDepth != length + 1)
+    return false;
+
+  for (size_t i = 0; i < length; ++i)
+    if (aGetKey(i) != gContainerPath[i])
+      return false;
+
+  return true;
+}
+
+/**
+ * \brief SAX handler that cuts the home screen into separate documents.
+ *
+ * Each element of the containers array is written to its own buffer and
+ * handed to the callback as soon as it is complete. Everything else goes to
+ * the envelope, which ends up as the home screen without any containers.
+ */
+class ContainerSplitter
+{
+  using Writer = rapidjson::Writer<rapidjson::StringBuffer>;
+
+  struct Frame
+  {
+    bool Array;
+    /// Most recent key when this is an object.
+    std::string Key;
+  };
+
+  std::function<void(std::string)> mSink;
+  rapidjson::StringBuffer mEnvelope;
+  Writer mEnvelopeWriter;
+  rapidjson::StringBuffer mItem;
+  std::optional<Writer> mItemWriter;
+
+  std::vector<Frame> mStack;
+  /// Stack size inside the containers array (zero when outside).
+  size_t mArrayDepth;
+
+public:
+  explicit ContainerSplitter(std::function<void(std::string)> aSink)
+    : mSink(std::move(aSink))
+    , mEnvelopeWriter(mEnvelope)
+    , mArrayDepth(0)
+  {}
+
+  ContainerSplitter(const ContainerSplitter& aOther) = delete;
+  ContainerSplitter& operator=(const ContainerSplitter& aOther) = delete;
+
+  std::string GetEnvelope() const
+  {
+    return std::string(mEnvelope.GetString(), mEnvelope.GetSize());
+  }
+
+  bool Null()
+  {
+    return Scalar([](Writer& aWriter) { return aWriter.Null(); });
+  }
+
+  bool Bool(bool aValue)
+  {
+    return Scalar([&](Writer& aWriter) { return aWriter.Bool(aValue); });
+  }
+
+  bool Int(int aValue)
+  {
+    return Scalar([&](Writer& aWriter) { return aWriter.Int(aValue); });
+  }
+
+  bool Uint(unsigned aValue)
+  {
+    return Scalar([&](Writer& aWriter) { return aWriter.Uint(aValue); });
+  }
+
+  bool Int64(int64_t aValue)
+  {
+    return Scalar([&](Writer& aWriter) { return aWriter.Int64(aValue); });
+  }
+
+  bool Uint64(uint64_t aValue)
+  {
+    return Scalar([&](Writer& aWriter) { return aWriter.Uint64(aValue); });
+  }
+
+  bool Double(double aValue)
+  {
+    return Scalar([&](Writer& aWriter) { return aWriter.Double(aValue); });
+  }
+
+  bool RawNumber(const char* aText, rapidjson::SizeType aLength, bool aCopy)
+  {
+    return Scalar([&](Writer& aWriter) {
+      return aWriter.RawNumber(aText, aLength, aCopy);
+    });
+  }
+
+  bool String(const char* aText, rapidjson::SizeType aLength, bool aCopy)
+  {
+    return Scalar([&](Writer& aWriter) {
+      return aWriter.String(aText, aLength, aCopy);
+    });
+  }
+
+  bool Key(const char* aText, rapidjson::SizeType aLength, bool aCopy)
+  {
+    mStack.back().Key.assign(aText, aLength);
+    return Forward(
+      [&](Writer& aWriter) { return aWriter.Key(aText, aLength, aCopy); });
+  }
+
+  bool StartObject()
+  {
+    bool status =
+      Forward([](Writer& aWriter) { return aWriter.StartObject(); });
+    mStack.push_back({ false, {} });
+    return status;
+  }
+
+  bool EndObject(rapidjson::SizeType aCount)
+  {
+    mStack.pop_back();
+    bool status =
+      Forward([&](Writer& aWriter) { return aWriter.EndObject(aCount); });
+    Complete();
+    return status;
+  }
+
+  bool StartArray()
+  {
+    bool status = Forward([](Writer& aWriter) { return aWriter.StartArray(); });
+    mStack.push_back({ true, {} });
+
+    auto key = [&](size_t aLevel) -> const std::string& {
+      return mStack[aLevel].Key;
+    };
+    if (IsContainerArray(mStack.size(), key))
+      mArrayDepth = mStack.size();
+
+    return status;
+  }
+
+  bool EndArray(rapidjson::SizeType aCount)
+  {
+    // Closing the containers array itself belongs to the envelope.
+    if (!mItemWriter && mStack.size() == mArrayDepth)
+      mArrayDepth = 0;
+
+    mStack.pop_back();
+    bool status =
+      Forward([&](Writer& aWriter) { return aWriter.EndArray(aCount); });
+    Complete();
+    return status;
+  }
+
+private:
+  template<typename T>
+  bool Forward(T&& aEvent)
+  {
+    // Start a new document for each element of the containers array.
+    if (!mItemWriter && mArrayDepth != 0 && mStack.size() == mArrayDepth) {
+      mItem.Clear();
+      mItemWriter.emplace(mItem);
+    }
+
+    return aEvent(mItemWriter ? mItemWriter.value() : mEnvelopeWriter);
+  }
+
+  template<typename T>
+  bool Scalar(T&& aEvent)
+  {
+    bool status = Forward(std::forward<T>(aEvent));
+    Complete();
+    return status;
+  }
+
+  void Complete()
+  {
+    // Elements are complete once the stack is back at the array.
+    if (mItemWriter && mStack.size() == mArrayDepth) {
+      mItemWriter.reset();
+      mSink(std::string(mItem.GetString(), mItem.GetSize()));
+    }
+  }
+};
+
+/**
+ * \brief SAX handler that finds the containers of the home screen.
+ *
+ * Records the byte range of each element of the containers array and
+ * whether it is a set reference without building a DOM.
+ */
+class ContainerIndexer
+  : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, ContainerIndexer>
+{
+public:
+  struct Item
+  {
+    size_t Offset;
+    size_t Length;
+    bool Reference;
+  };
+
+private:
+  const rapidjson::MemoryStream& mStream;
+  /// Most recent key at each level (empty for arrays).
+  std::vector<std::string> mKeys;
+  /// Stack size inside the containers array (zero when outside).
+  size_t mArrayDepth;
+  /// Offsets just after the opening and at the closing bracket.
+  size_t mArrayStart;
+  size_t mArrayEnd;
+  std::vector<Item> mItems;
+
+public:
+  explicit ContainerIndexer(const rapidjson::MemoryStream& aStream)
+    : mStream(aStream)
+    , mArrayDepth(0)
+    , mArrayStart(0)
+    , mArrayEnd(0)
+  {}
+
+  ContainerIndexer(const ContainerIndexer& aOther) = delete;
+  ContainerIndexer& operator=(const ContainerIndexer& aOther) = delete;
+
+  const std::vector<Item>& GetItems() const { return mItems; }
+
+  /// Document with an empty containers array.
+  std::string GetEnvelope(const std::string& aPayload) const
+  {
+    if (mArrayEnd == 0)
+      return aPayload;
+    else
+      return aPayload.substr(0, mArrayStart) + aPayload.substr(mArrayEnd);
+  }
+
+  bool Default()
+  {
+    // Containers that are not objects are rejected by the schema anyway.
+    return mArrayDepth == 0 || mKeys.size() != mArrayDepth;
+  }
+
+  bool String(const char* aText, rapidjson::SizeType aLength, bool aCopy)
+  {
+    (void)aCopy;
+
+    // The path inside the element is set/type.
+    if (mArrayDepth != 0 && mKeys.size() == mArrayDepth + 2 &&
+        mKeys[mArrayDepth] == "set" && mKeys.back() == "type")
+      mItems.back().Reference = std::string_view(aText, aLength) == "SetRef";
+
+    return Default();
+  }
+
+  bool Key(const char* aText, rapidjson::SizeType aLength, bool aCopy)
+  {
+    (void)aCopy;
+    mKeys.back().assign(aText, aLength);
+    return true;
+  }
+
+  bool StartObject()
+  {
+    // The reader has already consumed the opening brace.
+    if (mArrayDepth != 0 && mKeys.size() == mArrayDepth)
+      mItems.push_back({ mStream.Tell() - 1, 0, false });
+
+    mKeys.emplace_back();
+    return true;
+  }
+
+  bool EndObject(rapidjson::SizeType aCount)
+  {
+    (void)aCount;
+    mKeys.pop_back();
+
+    if (mArrayDepth != 0 && mKeys.size() == mArrayDepth)
+      mItems.back().Length = mStream.Tell() - mItems.back().Offset;
+
+    return true;
+  }
+
+  bool StartArray()
+  {
+    if (!Default())
+      return false;
+
+    mKeys.emplace_back();
+
+    auto key = [&](size_t aLevel) -> const std::string& {
+      return mKeys[aLevel];
+    };
+    if (IsContainerArray(mKeys.size(), key)) {
+      mArrayDepth = mKeys.size();
+      mArrayStart = mStream.Tell();
+    }
+
+    return true;
+  }
+
+  bool EndArray(rapidjson::SizeType aCount)
+  {
+    (void)aCount;
+
+    if (mArrayDepth != 0 && mKeys.size() == mArrayDepth) {
+      mArrayDepth = 0;
+      mArrayEnd = mStream.Tell() - 1;
+    }
+
+    mKeys.pop_back();
+    return true;
+  }
+};
+
+}
+
+JsonBackend
+GetJsonBackend()
+{
+  // The setting is cleared when support is not compiled in.
+  if (GetConfig()->Simdjson)
+    return JsonBackend::Simdjson;
+  return JsonBackend::RapidJson;
+}
+
+void
+ClearValidationCache()
+{
+  gValidated.Clear();
 }
 
 ApiHome
 ReadApiHome(std::istream& aInput)
 {
-  rapidjson::IStreamWrapper wrapper(aInput);
+  return ReadApiHome(aInput, GetJsonBackend());
+}
+
+ApiHome
+ReadApiHome(std::istream& aInput, JsonBackend aBackend)
+{
+  std::string payload = ReadPayload(aInput);
+
+  if (aBackend == JsonBackend::Simdjson)
+#ifdef USE_SIMDJSON
+    return ReadSimdApiHome(payload);
+#else
+    throw std::runtime_error("simdjson support is not compiled in");
+#endif
+
+  auto start = std::chrono::steady_clock::now();
+  rapidjson::MemoryStream wrapper(payload.data(), payload.size());
   rapidjson::Document dom = ReadJsonDocument(wrapper);
-  auto schema = gProvider.GetRemoteDocument("schema-home.json", 0);
-  ValidateJsonDocument(dom, *schema);
+  ValidateJsonPayload(dom, "schema-home.json", payload);
 
   ApiHome result;
   const rapidjson::Value& collection = dom["data"].MemberBegin()->value;
   result.Text = ReadApiFuzzyText(collection["text"]);
 
-  for (const auto& container : collection["containers"].GetArray()) {
-    const rapidjson::Value& set = container["set"];
+  for (const auto& container : collection["containers"].GetArray())
+    result.Containers.emplace_back(ReadApiContainer(container));
 
-    if (strcmp(set["type"].GetString(), "SetRef") == 0)
-      result.Containers.emplace_back(ReadApiSetRef(set));
-    else
-      result.Containers.emplace_back(ReadApiFuzzySet(set));
+  RecordThroughput("json.rapidjson.throughput", payload.size(), start);
+  return result;
+}
+
+ApiHome
+ReadApiHome(std::istream& aInput,
+            const std::function<void(ApiContainer)>& aSink)
+{
+  ContainerSplitter splitter(
+    [&](std::string aBuffer) { aSink(ReadApiContainer(aBuffer)); });
+
+  {
+    rapidjson::IStreamWrapper wrapper(aInput);
+    rapidjson::Reader reader;
+
+    if (reader.Parse(wrapper, splitter).IsError()) {
+      std::ostringstream oss;
+      oss << "JSON parsing error: ";
+      oss << rapidjson::GetParseError_En(reader.GetParseErrorCode());
+      throw std::runtime_error(oss.str());
+    }
+  }
+
+  // The containers were checked one at a time.
+  std::string envelope = splitter.GetEnvelope();
+  rapidjson::MemoryStream wrapper(envelope.data(), envelope.size());
+  rapidjson::Document dom = ReadJsonDocument(wrapper);
+  ValidateJsonPayload(dom, "schema-home.json", envelope);
+
+  ApiHome result;
+  const rapidjson::Value& collection = dom["data"].MemberBegin()->value;
+  result.Text = ReadApiFuzzyText(collection["text"]);
+  return result;
+}
+
+ApiHome
+ReadLazyApiHome(std::istream& aInput)
+{
+  auto payload = std::make_shared<std::string>(ReadPayload(aInput));
+  rapidjson::MemoryStream stream(payload->data(), payload->size());
+  ContainerIndexer indexer(stream);
+
+  {
+    rapidjson::Reader reader;
+
+    if (reader.Parse(stream, indexer).IsError()) {
+      std::ostringstream oss;
+      oss << "JSON parsing error: ";
+      oss << rapidjson::GetParseError_En(reader.GetParseErrorCode());
+      throw std::runtime_error(oss.str());
+    }
   }
 
+  // The containers are checked when they are decoded.
+  std::string envelope = indexer.GetEnvelope(*payload);
+  rapidjson::MemoryStream wrapper(envelope.data(), envelope.size());
+  rapidjson::Document dom = ReadJsonDocument(wrapper);
+  ValidateJsonPayload(dom, "schema-home.json", envelope);
+
+  ApiHome result;
+  const rapidjson::Value& collection = dom["data"].MemberBegin()->value;
+  result.Text = ReadApiFuzzyText(collection["text"]);
+
+  // References are tiny and needed up-front to download the real sets.
+  for (const ContainerIndexer::Item& item : indexer.GetItems())
+    if (item.Reference)
+      result.Containers.emplace_back(ReadApiContainer(
+        std::string_view(*payload).substr(item.Offset, item.Length)));
+    else
+      result.Containers.emplace_back(
+        ApiLazySet{ payload, item.Offset, item.Length });
+
+  CountMetric("json.lazy.containers", indexer.GetItems().size());
   return result;
 }
 
 ApiFuzzySet
 ReadApiFuzzySet(std::istream& aInput)
 {
-  rapidjson::IStreamWrapper wrapper(aInput);
+  return ReadApiFuzzySet(aInput, GetJsonBackend());
+}
+
+ApiFuzzySet
+ReadApiFuzzySet(std::istream& aInput, JsonBackend aBackend)
+{
+  std::string payload = ReadPayload(aInput);
+
+  if (aBackend == JsonBackend::Simdjson)
+#ifdef USE_SIMDJSON
+    return ReadSimdApiFuzzySet(payload);
+#else
+    throw std::runtime_error("simdjson support is not compiled in");
+#endif
+
+  auto start = std::chrono::steady_clock::now();
+  rapidjson::MemoryStream wrapper(payload.data(), payload.size());
   rapidjson::Document dom = ReadJsonDocument(wrapper);
-  auto schema = gProvider.GetRemoteDocument("schema-ref.json", 0);
-  ValidateJsonDocument(dom, *schema);
-  return ReadApiFuzzySet(dom["data"].MemberBegin()->value);
+  ValidateJsonPayload(dom, "schema-ref.json", payload);
+
+  ApiFuzzySet result = ReadApiFuzzySet(dom["data"].MemberBegin()->value);
+  RecordThroughput("json.rapidjson.throughput", payload.size(), start);
+  return result;
+}
+
+ApiFuzzySet
+ReadApiFuzzySet(const ApiLazySet& aModel)
+{
+  CountMetric("json.lazy.decoded");
+  std::string_view payload(*aModel.Buffer);
+  ApiContainer result =
+    ReadApiContainer(payload.substr(aModel.Offset, aModel.Length));
+
+  if (auto set = std::get_if<ApiFuzzySet>(&result))
+    return std::move(*set);
+  else
+    throw std::runtime_error("Lazy row is not an inline set");
 }
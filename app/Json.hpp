@@ -7,11 +7,15 @@
  */
 
 #include <cstddef>
+#include <functional>
 #include <istream>
+#include <memory>
 #include <string>
 #include <variant>
 #include <vector>
 
+#include "Table.hpp"
+
 struct ApiCollection;
 
 /// Single image entry for the tiles.
@@ -62,6 +66,17 @@ struct ApiFuzzySet
   ApiFuzzyText Text;
   /// Displayed as single images but have different meanings.
   std::vector<ApiFuzzyTile> Tiles;
+  /// Filterable attributes with one row for each tile (same order).
+  ApiTileTable Attributes;
+
+  /// Used to compute the URL for the other pages; might be empty.
+  std::string SetId;
+  /// Tiles in the whole set (the tiles here if there is no paging).
+  size_t TotalCount = 0;
+  /// Position of the first tile here within the whole set.
+  size_t PageOffset = 0;
+  /// Tiles per page on the server (zero if there is no paging).
+  size_t PageSize = 0;
 };
 
 /// Rough translation of references to remote sets.
@@ -75,19 +90,85 @@ struct ApiSetRef
   std::string ReferenceType;
 };
 
+/**
+ * \brief Inline set that has not been decoded yet.
+ *
+ * Points into the raw home screen, which is shared by every row, so nothing
+ * is decoded until \ref ReadApiFuzzySet is called with this.
+ */
+struct ApiLazySet
+{
+  /// Entire home screen document.
+  std::shared_ptr<const std::string> Buffer;
+  /// Byte range of the container inside the document.
+  size_t Offset = 0;
+  size_t Length = 0;
+};
+
+/// Single row of the home screen.
+using ApiContainer = std::variant<ApiFuzzySet, ApiSetRef, ApiLazySet>;
+
 /// Rough translation of the top-level standard collection structure.
 struct ApiHome
 {
   /// Name of the home screen.
   ApiFuzzyText Text;
   /// Only some of the rows are provided up-front.
-  std::vector<std::variant<ApiFuzzySet, ApiSetRef>> Containers;
+  std::vector<ApiContainer> Containers;
 };
 
+/// Library used to parse complete documents.
+enum class JsonBackend
+{
+  RapidJson,
+  Simdjson,
+};
+
+/// Library for the next documents (`json.simdjson` in the configuration).
+JsonBackend
+GetJsonBackend();
+
+/// Validate the next payloads even if they passed before (for measurements).
+void
+ClearValidationCache();
+
 ApiHome
 ReadApiHome(std::istream& aInput);
+/// Use a specific library (throws if it is not compiled in).
+ApiHome
+ReadApiHome(std::istream& aInput, JsonBackend aBackend);
+
+/**
+ * \brief Parse the home screen and hand out each row as soon as possible.
+ *
+ * Every container is validated on its own and passed to the callback as soon
+ * as its closing brace has been read, so this works well with streams that
+ * are still being downloaded. The rest of the document is validated at the
+ * end and the containers of the result are always empty. This always uses
+ * RapidJSON because simdjson needs the whole document up-front.
+ */
+ApiHome
+ReadApiHome(std::istream& aInput,
+            const std::function<void(ApiContainer)>& aSink);
+
+/**
+ * \brief Parse the home screen but leave the inline sets undecoded.
+ *
+ * A single pass without a DOM records where each container starts and ends.
+ * Only the rest of the document and the (small) set references are decoded
+ * up-front; the inline sets are returned as \ref ApiLazySet.
+ */
+ApiHome
+ReadLazyApiHome(std::istream& aInput);
 
 ApiFuzzySet
 ReadApiFuzzySet(std::istream& aInput);
+/// Use a specific library (throws if it is not compiled in).
+ApiFuzzySet
+ReadApiFuzzySet(std::istream& aInput, JsonBackend aBackend);
+
+/// Decode and validate a row returned by \ref ReadLazyApiHome.
+ApiFuzzySet
+ReadApiFuzzySet(const ApiLazySet& aModel);
 
 #endif
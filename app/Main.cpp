@@ -1,14 +1,30 @@
 #include "Main.hpp"
 
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <string>
 #include <utility>
 
 #include <GL/glew.h>
 #include <SDL.h>
 
+#include "Bundle.hpp"
+#include "Config.hpp"
+#include "Crawl.hpp"
+#include "Disk.hpp"
 #include "Graphics.hpp"
+#include "Metrics.hpp"
 #include "Network.hpp"
+#include "Pressure.hpp"
+#include "Profiler.hpp"
+#include "Scheduling.hpp"
+#include "Trace.hpp"
 #include "Viewer.hpp"
 #include "Worker.hpp"
 
@@ -22,6 +38,22 @@ InvokeAsync(std::function<void()> aFunctor)
   SDL_PushEvent(&reinterpret_cast<SDL_Event&>(ev));
 }
 
+void
+DiscardAsync()
+{
+  const Uint32 type = SDL_USEREVENT;
+  SDL_Event ev;
+  int64_t count = 0;
+
+  // The functors own their results so this also removes the cache files.
+  while (SDL_PeepEvents(&ev, 1, SDL_GETEVENT, type, type) == 1) {
+    delete reinterpret_cast<std::function<void()>*>(ev.user.data1);
+    count += 1;
+  }
+
+  CountMetric("exit.discarded", count);
+}
+
 namespace {
 
 void
@@ -36,6 +68,8 @@ HandleEvent(const SDL_UserEvent& aEvent)
 void
 MainLoop(SDL_Window* aWindow)
 {
+  ProfilerScope profile("main");
+  ApplyThreadClass("main");
   Viewer viewer;
   bool quit = false;
 
@@ -54,17 +88,92 @@ MainLoop(SDL_Window* aWindow)
           break;
       }
 
+    UpdateConfig();
     viewer.DrawFrame();
+    EndTraceFrame();
     SDL_GL_SwapWindow(aWindow);
   }
 }
 
+void
+WriteHar()
+{
+  // The path may have changed since startup.
+  std::shared_ptr<const Config> config = GetConfig();
+  if (!config->HarPath.empty()) {
+    std::ofstream output(config->HarPath, std::ios_base::binary);
+    ExportHar(output);
+  }
+}
+
+/**
+ * \brief Exit right away after a thread was abandoned.
+ *
+ * That thread may still use the disk, the bundle, the event queue or any
+ * global, so nothing else is shut down or destroyed.
+ */
+[[noreturn]] void
+ExitAbandoned(int aResult)
+{
+  std::fflush(nullptr);
+  std::_Exit(aResult);
+}
+
+/// Same pipeline without a window (there is no event loop either).
+int
+RunHeadless(const std::string& aReportPath)
+{
+  ProfilerScope profile("main");
+  ApplyThreadClass("main");
+  std::shared_ptr<const Config> config = GetConfig();
+
+  InitProfiler();
+  if (!config->ProfilePath.empty())
+    StartProfiler(config->ProfilePath);
+
+  InitDisk();
+  InitBundle();
+  InitNetwork();
+  InitWorker();
+  int result = RunCrawl(aReportPath);
+
+  auto start = std::chrono::steady_clock::now();
+  auto timeout = std::chrono::milliseconds(GetConfig()->ShutdownTimeout);
+  bool joined = FreeNetwork(start + timeout);
+  joined = FreeWorker(start + timeout) && joined;
+  if (joined) {
+    FreeBundle();
+    FreeDisk();
+  }
+  FreeProfiler();
+
+  DumpMetrics();
+  WriteHar();
+  if (!joined)
+    ExitAbandoned(result);
+
+  FreeConfig();
+  return result;
+}
+
 }
 
 int
 main(int argc, char** argv)
 {
-  (void)argc;
+  try {
+    InitConfig(argc, argv);
+  } catch (const std::exception& error) {
+    SDL_LogCritical(0, "Configuration error: %s", error.what());
+    return 1;
+  }
+
+  // Settings that only apply at startup.
+  std::shared_ptr<const Config> config = GetConfig();
+  int samples = static_cast<int>(config->MultisampleSamples);
+
+  if (!config->CrawlReport.empty())
+    return RunHeadless(config->CrawlReport);
 
 #ifdef _WIN32
   freopen("NUL", "r", stdin);
@@ -82,8 +191,8 @@ main(int argc, char** argv)
   SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
   SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
   SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
-  SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-  SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 16);
+  SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, samples > 0);
+  SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, samples);
   SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
 
   SDL_Window* window =
@@ -93,7 +202,7 @@ main(int argc, char** argv)
                      1920,
                      1080,
                      SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
-  if (!window) {
+  if (!window && samples > 4) {
     SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
     SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
     window = SDL_CreateWindow(argv[0],
@@ -102,11 +211,11 @@ main(int argc, char** argv)
                               1920,
                               1080,
                               SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
+  }
 
-    if (!window) {
-      SDL_LogCritical(0, "SDL window error: %s", SDL_GetError());
-      return 1;
-    }
+  if (!window) {
+    SDL_LogCritical(0, "SDL window error: %s", SDL_GetError());
+    return 1;
   }
 
   SDL_GLContext context = SDL_GL_CreateContext(window);
@@ -126,13 +235,45 @@ main(int argc, char** argv)
   SDL_Log("OpenGL renderer: %s", glGetString(GL_RENDERER));
   SDL_Log("OpenGL vendor: %s", glGetString(GL_VENDOR));
 
+  InitProfiler();
+  if (!config->ProfilePath.empty())
+    StartProfiler(config->ProfilePath);
+
+  if (!config->TracePath.empty())
+    StartTrace(config->TracePath);
+
   InitGraphics();
+  InitDisk();
+  InitBundle();
   InitNetwork();
   InitWorker();
+  InitPressure();
   MainLoop(window);
+
+  // Cancel the transfers first so streaming decodes stop waiting for data.
+  auto start = std::chrono::steady_clock::now();
+  auto timeout = std::chrono::milliseconds(GetConfig()->ShutdownTimeout);
+  FreePressure();
   FreeGraphics();
-  FreeNetwork();
-  FreeWorker();
+  FreeTrace();
+  bool joined = FreeNetwork(start + timeout);
+  joined = FreeWorker(start + timeout) && joined;
+  if (joined) {
+    DiscardAsync();
+    FreeBundle();
+    FreeDisk();
+  }
+  FreeProfiler();
+
+  std::chrono::duration<double, std::milli> elapsed =
+    std::chrono::steady_clock::now() - start;
+  RecordMetric("exit.time", elapsed.count());
+  DumpMetrics();
+  WriteHar();
+  if (!joined)
+    ExitAbandoned(0);
+
+  FreeConfig();
 
   SDL_GL_DeleteContext(context);
   SDL_DestroyWindow(window);
@@ -3,7 +3,19 @@
 
 #include <functional>
 
+/**
+ * \brief Runs a functor on some thread (called from any thread).
+ *
+ * The asynchronous requests deliver their results through one of these; the
+ * default is \ref InvokeAsync.
+ */
+using Executor = std::function<void(std::function<void()>)>;
+
+/// Run the functor on the main loop (thread-safe).
 void
 InvokeAsync(std::function<void()> aFunctor);
+/// Destroy the functors that never ran (once no thread can add more).
+void
+DiscardAsync();
 
 #endif
@@ -0,0 +1,184 @@
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+#include <SDL.h>
+
+//===========================================================================//
+//=== MetricHistogram =======================================================//
+//===========================================================================//
+
+namespace {
+
+/// Enough buckets for nanoseconds up to several minutes.
+constexpr size_t BucketCount = 48;
+
+size_t
+FindBucket(double aValue)
+{
+  if (!(aValue >= 1.0))
+    return 0;
+
+  int exponent;
+  std::frexp(aValue, &exponent);
+  return std::min(static_cast<size_t>(exponent), BucketCount - 1);
+}
+
+}
+
+double
+MetricHistogram::GetPercentile(double aFraction) const
+{
+  if (Count == 0)
+    return 0.0;
+
+  auto target = static_cast<uint64_t>(std::ceil(aFraction * Count));
+  uint64_t seen = 0;
+
+  for (size_t i = 0; i < Buckets.size(); ++i) {
+    seen += Buckets[i];
+    if (seen >= target && Buckets[i] != 0)
+      return std::min(std::ldexp(1.0, static_cast<int>(i)), Maximum);
+  }
+
+  return Maximum;
+}
+
+//===========================================================================//
+//=== Globals ===============================================================//
+//===========================================================================//
+
+namespace {
+
+/// Metrics are rare enough that a single lock is fine.
+std::mutex gMutex;
+std::map<std::string, int64_t> gCounters;
+std::map<std::string, MetricHistogram> gHistograms;
+
+}
+
+void
+CountMetric(const std::string& aName, int64_t aDelta)
+{
+  std::unique_lock<std::mutex> lock(gMutex);
+  gCounters[aName] += aDelta;
+}
+
+void
+RecordMetric(const std::string& aName, double aValue)
+{
+  std::unique_lock<std::mutex> lock(gMutex);
+  MetricHistogram& ref = gHistograms[aName];
+
+  if (ref.Count == 0) {
+    ref.Buckets.resize(BucketCount, 0);
+    ref.Minimum = aValue;
+    ref.Maximum = aValue;
+  } else {
+    ref.Minimum = std::min(ref.Minimum, aValue);
+    ref.Maximum = std::max(ref.Maximum, aValue);
+  }
+
+  ref.Count += 1;
+  ref.Sum += aValue;
+  ref.Buckets[FindBucket(aValue)] += 1;
+}
+
+int64_t
+GetCounter(const std::string& aName)
+{
+  std::unique_lock<std::mutex> lock(gMutex);
+  auto it = gCounters.find(aName);
+  return (it == gCounters.end()) ? 0 : it->second;
+}
+
+MetricHistogram
+GetHistogram(const std::string& aName)
+{
+  std::unique_lock<std::mutex> lock(gMutex);
+  auto it = gHistograms.find(aName);
+  return (it == gHistograms.end()) ? MetricHistogram() : it->second;
+}
+
+std::map<std::string, int64_t>
+GetCounters()
+{
+  std::unique_lock<std::mutex> lock(gMutex);
+  return gCounters;
+}
+
+void
+DumpMetrics()
+{
+  std::unique_lock<std::mutex> lock(gMutex);
+
+  for (const auto& [name, value] : gCounters)
+    SDL_Log("%s: %lld", name.c_str(), static_cast<long long>(value));
+
+  for (const auto& [name, value] : gHistograms)
+    SDL_Log("%s: count=%llu mean=%g min=%g p50=%g p99=%g max=%g",
+            name.c_str(),
+            static_cast<unsigned long long>(value.Count),
+            value.Sum / value.Count,
+            value.Minimum,
+            value.GetPercentile(0.50),
+            value.GetPercentile(0.99),
+            value.Maximum);
+}
+
+//===========================================================================//
+//=== MeteredMutex ==========================================================//
+//===========================================================================//
+
+namespace {
+
+double
+GetMicroseconds(std::chrono::steady_clock::time_point aStart,
+                std::chrono::steady_clock::time_point aEnd)
+{
+  return std::chrono::duration<double, std::micro>(aEnd - aStart).count();
+}
+
+}
+
+MeteredMutex::MeteredMutex(const std::string& aName)
+  : mHoldName(aName + ".hold")
+  , mWaitName(aName + ".wait")
+  , mContendedName(aName + ".contended")
+{}
+
+void
+MeteredMutex::lock()
+{
+  if (try_lock())
+    return;
+
+  auto start = std::chrono::steady_clock::now();
+  mMutex.lock();
+  mAcquired = std::chrono::steady_clock::now();
+
+  // Metrics have their own lock so this only delays the current owner.
+  CountMetric(mContendedName);
+  RecordMetric(mWaitName, GetMicroseconds(start, mAcquired));
+}
+
+bool
+MeteredMutex::try_lock()
+{
+  if (!mMutex.try_lock())
+    return false;
+
+  mAcquired = std::chrono::steady_clock::now();
+  return true;
+}
+
+void
+MeteredMutex::unlock()
+{
+  auto held = GetMicroseconds(mAcquired, std::chrono::steady_clock::now());
+  mMutex.unlock();
+  RecordMetric(mHoldName, held);
+}
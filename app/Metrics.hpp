@@ -0,0 +1,139 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+/**
+ * \file
+ * \brief Process-wide counters and histograms (thread-safe).
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Summary of a histogram with power-of-two buckets.
+struct MetricHistogram
+{
+  uint64_t Count = 0;
+  double Sum = 0.0;
+  double Minimum = 0.0;
+  double Maximum = 0.0;
+  /// Bucket i holds samples in [2^(i-1), 2^i); bucket zero is below one.
+  std::vector<uint64_t> Buckets;
+
+  /// Approximate percentile (upper bound of the bucket).
+  double GetPercentile(double aFraction) const;
+};
+
+/// Add to a named counter.
+void
+CountMetric(const std::string& aName, int64_t aDelta = 1);
+/// Add a sample to a named histogram.
+void
+RecordMetric(const std::string& aName, double aValue);
+
+/// Current value of a counter (zero if it was never touched).
+int64_t
+GetCounter(const std::string& aName);
+/// Copy of a histogram (empty if it was never touched).
+MetricHistogram
+GetHistogram(const std::string& aName);
+/// Copy of every counter.
+std::map<std::string, int64_t>
+GetCounters();
+
+/// Print every metric to the log.
+void
+DumpMetrics();
+
+/**
+ * \brief Mutex that records how it is used (in microseconds).
+ *
+ * Every acquisition adds to `<name>.hold` and contended ones also add to
+ * `<name>.wait` and `<name>.contended`. This costs a metric update per
+ * unlock so it is only meant for locks that are taken once per task. Use it
+ * with std::condition_variable_any.
+ */
+class MeteredMutex
+{
+  std::mutex mMutex;
+  std::string mHoldName;
+  std::string mWaitName;
+  std::string mContendedName;
+  /// Only valid while the mutex is held.
+  std::chrono::steady_clock::time_point mAcquired;
+
+public:
+  explicit MeteredMutex(const std::string& aName);
+  MeteredMutex(const MeteredMutex& aOther) = delete;
+  MeteredMutex& operator=(const MeteredMutex& aOther) = delete;
+
+  void lock();
+  bool try_lock();
+  void unlock();
+};
+
+/**
+ * \brief FIFO queue that records how long each element waited.
+ *
+ * Removing an element adds to `<name>.latency` (microseconds) and adding
+ * one records the new size in `<name>.depth`. This is not synchronized.
+ */
+template<typename T>
+class MeteredQueue
+{
+  using Clock = std::chrono::steady_clock;
+
+  std::queue<std::pair<T, Clock::time_point>> mQueue;
+  std::string mLatencyName;
+  std::string mDepthName;
+
+public:
+  using value_type = T;
+
+  explicit MeteredQueue(const std::string& aName)
+    : mLatencyName(aName + ".latency")
+    , mDepthName(aName + ".depth")
+  {}
+
+  bool empty() const { return mQueue.empty(); }
+  size_t size() const { return mQueue.size(); }
+
+  void push(T aValue)
+  {
+    mQueue.emplace(std::move(aValue), Clock::now());
+    RecordMetric(mDepthName, mQueue.size());
+  }
+
+  T pop()
+  {
+    T result = std::move(mQueue.front().first);
+    RecordLatency(mQueue.front().second);
+    mQueue.pop();
+    return result;
+  }
+
+  /// Remove every element at once (in order).
+  std::vector<T> PopAll()
+  {
+    std::vector<T> result;
+    result.reserve(mQueue.size());
+    while (!mQueue.empty())
+      result.push_back(pop());
+    return result;
+  }
+
+private:
+  void RecordLatency(Clock::time_point aStart)
+  {
+    std::chrono::duration<double, std::micro> elapsed = Clock::now() - aStart;
+    RecordMetric(mLatencyName, elapsed.count());
+  }
+};
+
+#endif
@@ -1,29 +1,56 @@
 #include "Network.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
 #include <fstream>
+#include <future>
 #include <list>
+#include <map>
 #include <mutex>
 #include <optional>
 #include <ostream>
-#include <queue>
+#include <sstream>
+#include <stdexcept>
 #include <streambuf>
 #include <thread>
 #include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include <SDL.h>
 #include <curl/curl.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
 
 #ifdef _MSC_VER
 #else
+#include <fcntl.h>
 #include <stdio.h>
 #include <unistd.h>
 #endif
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "Bundle.hpp"
+#include "Config.hpp"
+#include "Disk.hpp"
 #include "Main.hpp"
+#include "Metrics.hpp"
+#include "Profiler.hpp"
+#include "Scheduling.hpp"
 
 //===========================================================================//
 //=== Stream ================================================================//
@@ -35,31 +62,1087 @@ namespace {
 #error
 #else
 
-/// Special stream that deletes its file automatically.
-class TempFile : public std::iostream
+/**
+ * \brief Download spooled to a temporary file without waiting for storage.
+ *
+ * The transfer thread only appends to memory; every full block is written in
+ * the background and stays readable from memory until that write is done. The
+ * reader always has the next block in flight while it consumes the current
+ * one.
+ */
+class CacheBuffer : public std::streambuf
 {
-  std::string mPath;
-  std::filebuf mBufferImpl;
+  /// Granularity for both writes and reads.
+  static constexpr size_t BlockSize = 64 * 1024;
+
+  using Block = std::shared_ptr<std::string>;
+
+  /// State shared with the i/o callbacks (which can outlive the buffer).
+  struct Shared
+  {
+    std::string Path;
+    int File = -1;
+    std::mutex Mutex;
+    std::condition_variable Condition;
+    /// Blocks that are not on disk yet (sorted by offset).
+    std::map<uint64_t, Block> Pending;
+
+    ~Shared()
+    {
+      if (File >= 0)
+        close(File);
+      remove(Path.c_str());
+    }
+  };
+
+  /// Block that is being read in the background.
+  struct Fetch
+  {
+    uint64_t Offset = 0;
+    Block Data;
+    bool Ready = false;
+    long Result = 0;
+  };
+
+  std::shared_ptr<Shared> mShared;
+  /// Block being filled by the transfer thread.
+  std::string mTail;
+  /// Number of bytes handed to the disk so far.
+  uint64_t mSpilled;
+  /// Total size (once the transfer is done).
+  uint64_t mSize;
+  /// Block exposed through the get area and its offset in the file.
+  Block mCurrent;
+  uint64_t mWindow;
+  std::shared_ptr<Fetch> mAhead;
 
 public:
-  TempFile()
+  CacheBuffer()
+    : mShared(std::make_shared<Shared>())
+    , mSpilled(0)
+    , mSize(0)
+    , mWindow(0)
   {
     char buffer[] = "tempXXXXXX";
-    close(mkstemp(buffer));
+    mShared->File = mkstemp(buffer);
+    mShared->Path = buffer;
+
+    // Failed writes keep their blocks in memory so this is not fatal.
+    if (mShared->File < 0)
+      SDL_LogWarn(0, "Cannot create cache file: %s", strerror(errno));
+  }
+
+  /// Called by the transfer thread; this never waits for the disk.
+  void Append(const char* aData, size_t aSize)
+  {
+    mTail.append(aData, aSize);
+    if (mTail.size() >= BlockSize)
+      Spill();
+  }
 
-    mPath = buffer;
-    mBufferImpl.open(buffer, in | out | binary);
+  /// Write the last block and rewind for reading.
+  void Close()
+  {
+    Spill();
+    mSize = mSpilled;
+    mCurrent.reset();
+    mWindow = 0;
+    setg(nullptr, nullptr, nullptr);
+  }
+
+protected:
+  int_type underflow() override
+  {
+    if (!Load(mWindow + (egptr() - eback())))
+      return traits_type::eof();
+    return traits_type::to_int_type(*gptr());
+  }
+
+  pos_type seekoff(off_type aOffset,
+                   std::ios_base::seekdir aDirection,
+                   std::ios_base::openmode aMode) override
+  {
+    off_type base = 0;
+    if (aDirection == std::ios_base::cur)
+      base = mWindow + (gptr() - eback());
+    else if (aDirection == std::ios_base::end)
+      base = mSize;
+
+    return seekpos(pos_type(base + aOffset), aMode);
+  }
+
+  pos_type seekpos(pos_type aPosition, std::ios_base::openmode aMode) override
+  {
+    off_type target = aPosition;
+    if (!(aMode & std::ios_base::in) || target < 0 ||
+        target > static_cast<off_type>(mSize))
+      return pos_type(off_type(-1));
+
+    auto offset = static_cast<uint64_t>(target);
+    auto length = static_cast<uint64_t>(egptr() - eback());
+
+    if (mCurrent && offset >= mWindow && offset < mWindow + length) {
+      setg(eback(), eback() + (offset - mWindow), egptr());
+    } else {
+      // The next underflow starts here.
+      mCurrent.reset();
+      mWindow = offset;
+      setg(nullptr, nullptr, nullptr);
+    }
+
+    return aPosition;
+  }
+
+private:
+  void Spill()
+  {
+    if (mTail.empty())
+      return;
+
+    auto block = std::make_shared<std::string>(std::move(mTail));
+    uint64_t offset = mSpilled;
+    mSpilled += block->size();
+    mTail.clear();
+
+    {
+      std::unique_lock<std::mutex> lock(mShared->Mutex);
+      mShared->Pending.emplace(offset, block);
+    }
+
+    auto shared = mShared;
+    DiskWrite(shared->File,
+              block->data(),
+              block->size(),
+              offset,
+              [shared, offset](long aResult) {
+                std::unique_lock<std::mutex> lock(shared->Mutex);
+
+                // Readers keep using the memory if the write failed.
+                if (aResult >= 0)
+                  shared->Pending.erase(offset);
+                else
+                  SDL_LogWarn(0, "Cache write error: %s", strerror(-aResult));
+              });
+  }
+
+  /// Find the pending block that covers the offset (lock must be held).
+  std::map<uint64_t, Block>::iterator FindPending(uint64_t aOffset)
+  {
+    auto& pending = mShared->Pending;
+    auto it = pending.upper_bound(aOffset);
+    if (it == pending.begin())
+      return pending.end();
+
+    --it;
+    return (aOffset < it->first + it->second->size()) ? it : pending.end();
+  }
+
+  /// Make sure the block at this offset is on its way.
+  void Prefetch(uint64_t aOffset)
+  {
+    if (aOffset >= mSize || (mAhead && mAhead->Offset == aOffset))
+      return;
+
+    uint64_t length = std::min<uint64_t>(BlockSize, mSize - aOffset);
+
+    {
+      std::unique_lock<std::mutex> lock(mShared->Mutex);
+      if (FindPending(aOffset) != mShared->Pending.end())
+        return;
+
+      // Blocks are only removed once they are on disk so this is stable.
+      auto it = mShared->Pending.lower_bound(aOffset);
+      if (it != mShared->Pending.end())
+        length = std::min(length, it->first - aOffset);
+    }
+
+    auto fetch = std::make_shared<Fetch>();
+    auto shared = mShared;
+    fetch->Offset = aOffset;
+    fetch->Data = std::make_shared<std::string>(length, '\0');
+
+    DiskRead(shared->File,
+             fetch->Data->data(),
+             length,
+             aOffset,
+             [shared, fetch](long aResult) {
+               std::unique_lock<std::mutex> lock(shared->Mutex);
+               fetch->Result = aResult;
+               fetch->Ready = true;
+               shared->Condition.notify_all();
+             });
+
+    mAhead = std::move(fetch);
+  }
+
+  void Expose(Block aBlock, uint64_t aWindow, uint64_t aOffset)
+  {
+    mCurrent = std::move(aBlock);
+    mWindow = aWindow;
+
+    char* base = mCurrent->data();
+    setg(base, base + (aOffset - aWindow), base + mCurrent->size());
+  }
+
+  bool Load(uint64_t aOffset)
+  {
+    if (aOffset >= mSize)
+      return false;
+
+    // Blocks that are still being written never touch the disk.
+    {
+      std::unique_lock<std::mutex> lock(mShared->Mutex);
+      auto it = FindPending(aOffset);
+
+      if (it != mShared->Pending.end()) {
+        Expose(it->second, it->first, aOffset);
+        lock.unlock();
+        Prefetch(mWindow + mCurrent->size());
+        return true;
+      }
+    }
+
+    Prefetch(aOffset);
+    auto fetch = std::move(mAhead);
+
+    {
+      std::unique_lock<std::mutex> lock(mShared->Mutex);
+
+      if (!fetch->Ready) {
+        auto start = std::chrono::steady_clock::now();
+        mShared->Condition.wait(lock, [&]() { return fetch->Ready; });
+
+        // Only time that is actually lost by the reader.
+        std::chrono::duration<double, std::micro> elapsed =
+          std::chrono::steady_clock::now() - start;
+        RecordMetric("disk.read.stall", elapsed.count());
+      }
+    }
+
+    if (fetch->Result <= 0) {
+      if (fetch->Result < 0)
+        SDL_LogWarn(0, "Cache read error: %s", strerror(-fetch->Result));
+      return false;
+    }
+
+    fetch->Data->resize(static_cast<size_t>(fetch->Result));
+    Expose(fetch->Data, aOffset, aOffset);
+    Prefetch(aOffset + fetch->Data->size());
+    return true;
+  }
+};
+
+/// Special stream that deletes its file automatically.
+class TempFile : public std::istream
+{
+  CacheBuffer mBufferImpl;
+
+public:
+  TempFile() { rdbuf(&mBufferImpl); }
+
+  void Append(const char* aData, size_t aSize)
+  {
+    mBufferImpl.Append(aData, aSize);
+  }
+
+  void Close() { mBufferImpl.Close(); }
+};
+
+#endif
+
+/// Buffer that is filled by one thread while another thread reads it.
+class PipeBuffer : public std::streambuf
+{
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  /// Bytes received but not yet handed to the reader.
+  std::string mPending;
+  /// Bytes currently exposed through the get area.
+  std::string mCurrent;
+  /// Set once the writer is done (with an error message on failure).
+  bool mClosed;
+  std::optional<std::string> mError;
+
+public:
+  PipeBuffer()
+    : mClosed(false)
+  {}
+
+  void Append(const char* aData, size_t aSize)
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mPending.append(aData, aSize);
+    mCondition.notify_all();
+  }
+
+  void Close(std::optional<std::string> aError)
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mClosed = true;
+    mError = std::move(aError);
+    mCondition.notify_all();
+  }
+
+protected:
+  int_type underflow() override
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [&]() { return mClosed || !mPending.empty(); });
+
+    if (!mPending.empty()) {
+      // The old window has been consumed so it can be recycled.
+      mCurrent.clear();
+      std::swap(mCurrent, mPending);
+      setg(mCurrent.data(), mCurrent.data(), mCurrent.data() + mCurrent.size());
+      return traits_type::to_int_type(*gptr());
+    } else if (mError) {
+      // This is rethrown by the stream because of the exception mask.
+      throw std::runtime_error(mError.value());
+    } else {
+      return traits_type::eof();
+    }
+  }
+};
+
+/// Special stream that can be read while the download is still running.
+class PipeStream : public std::istream
+{
+  PipeBuffer mBufferImpl;
+
+public:
+  PipeStream()
+  {
     rdbuf(&mBufferImpl);
+    exceptions(badbit);
   }
 
-  ~TempFile()
+  void Append(const char* aData, size_t aSize)
   {
-    mBufferImpl.close();
-    remove(mPath.c_str());
+    mBufferImpl.Append(aData, aSize);
+  }
+
+  void Close(std::optional<std::string> aError = std::nullopt)
+  {
+    mBufferImpl.Close(std::move(aError));
+  }
+};
+
+}
+
+//===========================================================================//
+//=== Timing ================================================================//
+//===========================================================================//
+
+namespace {
+
+std::mutex gHarMutex;
+std::deque<DownloadTiming> gHarLog;
+
+double
+GetMilliseconds(CURL* aHandle, CURLINFO aInfo)
+{
+  curl_off_t value = 0;
+  curl_easy_getinfo(aHandle, aInfo, &value);
+  return value / 1000.0;
+}
+
+/// Fill in everything the library measured about the transfer.
+void
+MeasureTransfer(CURL* aHandle, DownloadTiming& aTiming)
+{
+  aTiming.NameLookup = GetMilliseconds(aHandle, CURLINFO_NAMELOOKUP_TIME_T);
+  aTiming.Connect = GetMilliseconds(aHandle, CURLINFO_CONNECT_TIME_T);
+  aTiming.AppConnect = GetMilliseconds(aHandle, CURLINFO_APPCONNECT_TIME_T);
+  aTiming.StartTransfer =
+    GetMilliseconds(aHandle, CURLINFO_STARTTRANSFER_TIME_T);
+  aTiming.Total = GetMilliseconds(aHandle, CURLINFO_TOTAL_TIME_T);
+
+  curl_off_t size = 0;
+  curl_easy_getinfo(aHandle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+  aTiming.Size = static_cast<uint64_t>(size);
+  curl_easy_getinfo(aHandle, CURLINFO_RESPONSE_CODE, &aTiming.StatusCode);
+
+  long version = 0;
+  curl_easy_getinfo(aHandle, CURLINFO_HTTP_VERSION, &version);
+  switch (version) {
+    case CURL_HTTP_VERSION_1_0:
+      aTiming.HttpVersion = "HTTP/1.0";
+      break;
+    case CURL_HTTP_VERSION_1_1:
+      aTiming.HttpVersion = "HTTP/1.1";
+      break;
+    case CURL_HTTP_VERSION_2_0:
+      aTiming.HttpVersion = "HTTP/2";
+      break;
+    case CURL_HTTP_VERSION_3:
+      aTiming.HttpVersion = "HTTP/3";
+      break;
+  }
+
+  // No new connections means the transfer reused one.
+  long connects = 0;
+  curl_easy_getinfo(aHandle, CURLINFO_NUM_CONNECTS, &connects);
+  aTiming.Reused = (connects == 0 && aTiming.StatusCode != 0);
+
+  char* text = nullptr;
+  curl_easy_getinfo(aHandle, CURLINFO_CONTENT_TYPE, &text);
+  aTiming.ContentType = text ? text : "";
+  text = nullptr;
+  curl_easy_getinfo(aHandle, CURLINFO_PRIMARY_IP, &text);
+  aTiming.ServerAddress = text ? text : "";
+}
+
+/// Aggregate the transfer and keep it for the HTTP Archive.
+void
+RecordTransfer(const DownloadTiming& aTiming)
+{
+  CountMetric("network.bytes", aTiming.Size);
+  RecordMetric("network.total", aTiming.Total);
+
+  // Phases are zero when they were skipped or never reached.
+  if (aTiming.Reused) {
+    CountMetric("network.reused");
+  } else {
+    if (aTiming.NameLookup > 0.0)
+      RecordMetric("network.dns", aTiming.NameLookup);
+    if (aTiming.Connect > 0.0)
+      RecordMetric("network.connect", aTiming.Connect - aTiming.NameLookup);
+    if (aTiming.AppConnect > 0.0)
+      RecordMetric("network.tls", aTiming.AppConnect - aTiming.Connect);
+  }
+
+  if (aTiming.StartTransfer > 0.0)
+    RecordMetric("network.ttfb", aTiming.StartTransfer);
+
+  // The limit can shrink when the configuration is reloaded.
+  auto limit = static_cast<size_t>(GetConfig()->HarLimit);
+  std::unique_lock<std::mutex> lock(gHarMutex);
+  while (gHarLog.size() >= limit)
+    gHarLog.pop_front();
+  gHarLog.push_back(aTiming);
+}
+
+}
+
+//===========================================================================//
+//=== Origins ===============================================================//
+//===========================================================================//
+
+namespace {
+
+/**
+ * \brief Equivalent hosts for the links (`network.origins`).
+ *
+ * A link that starts with any host of a group can be sent to any other host
+ * of the group. Each host keeps a moving average of its time to first byte
+ * and its throughput; requests go to the host that would be fastest for a
+ * typical image, except for every \ref ProbeInterval request, which goes to
+ * another host so the averages stay current. Hosts that fail are avoided for
+ * a while (longer after each failure).
+ */
+class OriginSet
+{
+public:
+  static constexpr size_t None = static_cast<size_t>(-1);
+
+  struct Route
+  {
+    std::string Link;
+    /// Position in the configuration (\ref None if no group matches).
+    size_t Group = None;
+    size_t Host = 0;
+  };
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  /// Requests between two requests to hosts that are not the best.
+  static constexpr size_t ProbeInterval = 16;
+  /// Bytes of the transfer that the hosts are compared for.
+  static constexpr double TypicalSize = 64.0 * 1024.0;
+  /// Weight of the newest sample in the moving averages.
+  static constexpr double Smoothing = 0.2;
+
+  struct Host
+  {
+    std::string Prefix;
+    /// Time to first byte (milliseconds, zero until measured).
+    double Latency = 0.0;
+    /// Bytes per millisecond (zero until measured).
+    double Throughput = 0.0;
+    int Failures = 0;
+    Clock::time_point RetryAt;
+  };
+
+  struct Group
+  {
+    std::vector<Host> Hosts;
+    size_t Requests = 0;
+    size_t Best = None;
+  };
+
+  std::vector<Group> mGroups;
+
+public:
+  /// Groups are separated by `;` and hosts by `,` (`scheme://host[:port]`).
+  explicit OriginSet(const std::string& aSpec)
+  {
+    std::istringstream groups(aSpec);
+    std::string text;
+
+    while (std::getline(groups, text, ';')) {
+      std::istringstream hosts(text);
+      std::string prefix;
+      Group group;
+
+      while (std::getline(hosts, prefix, ',')) {
+        prefix.erase(0, prefix.find_first_not_of(" \t"));
+        prefix.erase(prefix.find_last_not_of(" \t/") + 1);
+
+        if (prefix.find("://") == std::string::npos)
+          SDL_LogWarn(0, "Not an origin: %s", prefix.c_str());
+        else
+          group.Hosts.emplace_back().Prefix = prefix;
+      }
+
+      if (group.Hosts.size() > 1)
+        mGroups.push_back(std::move(group));
+    }
+  }
+
+  size_t GetHostCount(size_t aGroup) const
+  {
+    return (aGroup < mGroups.size()) ? mGroups[aGroup].Hosts.size() : 0;
+  }
+
+  /// Pick a host for the link but none of the hosts in the mask.
+  Route Select(const std::string& aLink, uint64_t aSkip)
+  {
+    Route result;
+    result.Link = aLink;
+
+    size_t length = 0;
+    for (size_t i = 0; i < mGroups.size() && !length; ++i)
+      for (const Host& host : mGroups[i].Hosts)
+        if (IsPrefix(host.Prefix, aLink)) {
+          result.Group = i;
+          length = host.Prefix.size();
+          break;
+        }
+
+    if (result.Group == None)
+      return result;
+
+    Group& group = mGroups[result.Group];
+    Clock::time_point now = Clock::now();
+    std::vector<size_t> healthy;
+    size_t fallback = None;
+
+    for (size_t i = 0; i < group.Hosts.size(); ++i) {
+      if (i < 64 && (aSkip >> i & 1))
+        continue;
+
+      const Host& host = group.Hosts[i];
+      if (host.RetryAt <= now)
+        healthy.push_back(i);
+      else if (fallback == None || host.RetryAt < group.Hosts[fallback].RetryAt)
+        fallback = i;
+    }
+
+    group.Requests += 1;
+
+    if (healthy.empty()) {
+      // Every host failed recently so try the one that failed first.
+      result.Host = (fallback == None) ? 0 : fallback;
+    } else if (group.Requests % ProbeInterval == 0 && healthy.size() > 1) {
+      size_t round = group.Requests / ProbeInterval;
+      result.Host = healthy[round % healthy.size()];
+      CountMetric("network.origin.probes");
+    } else {
+      // Hosts that failed only come back through the probes.
+      result.Host = *std::min_element(
+        healthy.begin(), healthy.end(), [&](size_t a, size_t b) {
+          const Host& left = group.Hosts[a];
+          const Host& right = group.Hosts[b];
+          return std::make_pair(left.Failures > 0, GetCost(left)) <
+                 std::make_pair(right.Failures > 0, GetCost(right));
+        });
+
+      if (group.Best != result.Host && aSkip == 0) {
+        group.Best = result.Host;
+        const std::string& prefix = group.Hosts[result.Host].Prefix;
+        SDL_Log("Preferred origin: %s", prefix.c_str());
+      }
+    }
+
+    result.Link = group.Hosts[result.Host].Prefix + aLink.substr(length);
+    return result;
+  }
+
+  /// Add the measurements of a finished transfer.
+  void Report(size_t aGroup, size_t aHost, const DownloadTiming& aTiming)
+  {
+    Host* host = Find(aGroup, aHost);
+    if (!host)
+      return;
+
+    host->Failures = 0;
+    if (aTiming.StartTransfer > 0.0)
+      Average(host->Latency, aTiming.StartTransfer);
+
+    // Small bodies mostly measure the latency again.
+    double receive = aTiming.Total - aTiming.StartTransfer;
+    if (aTiming.Size >= 16 * 1024 && receive > 0.0)
+      Average(host->Throughput, aTiming.Size / receive);
+  }
+
+  /// Count a transfer that was cancelled before the first byte.
+  void ReportStall(size_t aGroup, size_t aHost, double aElapsed)
+  {
+    if (Host* host = Find(aGroup, aHost))
+      Average(host->Latency, std::max(host->Latency, aElapsed));
+  }
+
+  /// Avoid the host for a while.
+  void ReportFailure(size_t aGroup, size_t aHost)
+  {
+    Host* host = Find(aGroup, aHost);
+    if (!host)
+      return;
+
+    host->Failures += 1;
+    auto backoff = std::chrono::seconds(1 << std::min(host->Failures - 1, 5));
+    host->RetryAt = Clock::now() + backoff;
+    CountMetric("network.origin.failures");
+  }
+
+private:
+  static bool IsPrefix(const std::string& aPrefix, const std::string& aLink)
+  {
+    if (aLink.compare(0, aPrefix.size(), aPrefix) != 0)
+      return false;
+
+    // Do not match a longer host name or port.
+    return aLink.size() == aPrefix.size() || aLink[aPrefix.size()] == '/' ||
+           aLink[aPrefix.size()] == '?';
+  }
+
+  static void Average(double& aValue, double aSample)
+  {
+    aValue = (aValue == 0.0) ? aSample
+                             : aValue + Smoothing * (aSample - aValue);
+  }
+
+  /// Hosts that were never measured come first.
+  static double GetCost(const Host& aHost)
+  {
+    double result = aHost.Latency;
+    if (aHost.Throughput > 0.0)
+      result += TypicalSize / aHost.Throughput;
+    return result;
+  }
+
+  Host* Find(size_t aGroup, size_t aHost)
+  {
+    if (aGroup >= mGroups.size() || aHost >= mGroups[aGroup].Hosts.size())
+      return nullptr;
+    return &mGroups[aGroup].Hosts[aHost];
   }
 };
 
+}
+
+//===========================================================================//
+//=== Sessions ==============================================================//
+//===========================================================================//
+
+namespace {
+
+/// Unlike rename on Windows, this also replaces an existing file.
+bool
+MoveOver(const std::string& aFrom, const std::string& aTo)
+{
+#ifdef _WIN32
+  if (MoveFileExA(aFrom.c_str(), aTo.c_str(), MOVEFILE_REPLACE_EXISTING))
+    return true;
+  errno = EACCES;
+  return false;
+#else
+  return rename(aFrom.c_str(), aTo.c_str()) == 0;
+#endif
+}
+
+/**
+ * \brief Lookups and TLS sessions that outlive the process.
+ *
+ * Every transfer goes through one shared DNS cache and TLS session cache. If
+ * `network.session_file` is set, that file seeds both caches at startup. The
+ * saved addresses go to the first transfer and expire like ordinary lookups.
+ * The saved sessions let the first connection to each host resume instead
+ * of doing a full handshake. The download thread rewrites the file every
+ * \ref SaveInterval and on exit. The write runs on the disk threads.
+ */
+class SessionStore
+{
+  using Clock = std::chrono::steady_clock;
+
+  /// First line of the file (changes with the format).
+  static constexpr const char* Header = "sessions 1";
+  /// Addresses that were not used for this long are looked up again.
+  static constexpr int64_t AddressLifetime = 6 * 60 * 60;
+  static constexpr std::chrono::seconds SaveInterval{ 30 };
+
+  struct Address
+  {
+    std::string Ip;
+    /// Seconds since the epoch.
+    int64_t UsedAt;
+  };
+
+  /// Shared with the write on the disk threads.
+  struct Writer
+  {
+    /// Set while a write is in progress.
+    std::atomic<bool> Busy{ false };
+    /// Contents of the last successful write (only touched while busy).
+    std::string Saved;
+  };
+
+  std::string mPath;
+  CURLSH* mShare;
+  /// Never runs a transfer; it only reaches the share.
+  CURL* mHandle;
+  /// Whether the library can export and import sessions.
+  bool mPortable;
+  /// Saved addresses for the first transfer.
+  curl_slist* mResolve;
+  bool mResolved;
+  /// Keyed by `host:port`.
+  std::map<std::string, Address> mAddresses;
+  Clock::time_point mSaveAt;
+  /// Nothing is written if the contents did not change.
+  std::shared_ptr<Writer> mWriter;
+
+public:
+  explicit SessionStore(std::string aPath)
+    : mPath(std::move(aPath))
+    , mPortable(false)
+    , mResolve(nullptr)
+    , mResolved(false)
+    , mSaveAt(Clock::now() + SaveInterval)
+    , mWriter(std::make_shared<Writer>())
+  {
+    mShare = curl_share_init();
+    curl_share_setopt(mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    mHandle = curl_easy_init();
+    curl_easy_setopt(mHandle, CURLOPT_SHARE, mShare);
+
+    if (mPath.empty())
+      return;
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+    // Not every build has the export functions compiled in.
+    std::string scratch;
+    mPortable = curl_easy_ssls_export(mHandle, ExportProc, &scratch) !=
+                CURLE_NOT_BUILT_IN;
 #endif
+    // Only the addresses are kept then.
+    if (!mPortable)
+      SDL_LogWarn(0,
+                  "TLS sessions are not persisted: CURL %s cannot export them",
+                  curl_version_info(CURLVERSION_NOW)->version);
+
+    Load();
+  }
+
+  SessionStore(const SessionStore& aOther) = delete;
+  SessionStore& operator=(const SessionStore& aOther) = delete;
+
+  /// Only valid once every transfer that used the share is gone.
+  ~SessionStore()
+  {
+    curl_easy_cleanup(mHandle);
+    curl_share_cleanup(mShare);
+    curl_slist_free_all(mResolve);
+  }
+
+  /// Use the shared caches for a new transfer.
+  void Attach(CURL* aHandle)
+  {
+    curl_easy_setopt(aHandle, CURLOPT_SHARE, mShare);
+
+    // The list is copied into the cache when the transfer starts.
+    if (mResolve && !mResolved) {
+      curl_easy_setopt(aHandle, CURLOPT_RESOLVE, mResolve);
+      mResolved = true;
+    }
+  }
+
+  /// Keep the address that the transfer connected to.
+  void Remember(CURL* aHandle, const DownloadTiming& aTiming)
+  {
+    if (mPath.empty() || aTiming.StatusCode == 0 ||
+        aTiming.ServerAddress.empty())
+      return;
+
+    char* link = nullptr;
+    curl_easy_getinfo(aHandle, CURLINFO_EFFECTIVE_URL, &link);
+    long port = 0;
+    curl_easy_getinfo(aHandle, CURLINFO_PRIMARY_PORT, &port);
+
+    CURLU* parts = curl_url();
+    char* host = nullptr;
+    if (link && curl_url_set(parts, CURLUPART_URL, link, 0) == CURLUE_OK &&
+        curl_url_get(parts, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+        host[0] != '[' && aTiming.ServerAddress != host) {
+      // Literal addresses need no lookup.
+      std::string name = std::string(host) + ':' + std::to_string(port);
+      mAddresses[name] = { aTiming.ServerAddress, std::time(nullptr) };
+    }
+
+    curl_free(host);
+    curl_url_cleanup(parts);
+  }
+
+  /// Write the file in the background if it is due (or right away).
+  void Save(bool aNow)
+  {
+    if (mPath.empty() || (!aNow && Clock::now() < mSaveAt))
+      return;
+
+    mSaveAt = Clock::now() + SaveInterval;
+    if (mWriter->Busy.exchange(true))
+      return;
+
+    std::string text = std::string(Header) + '\n';
+    int64_t now = std::time(nullptr);
+    for (auto it = mAddresses.begin(); it != mAddresses.end();) {
+      if (now - it->second.UsedAt > AddressLifetime) {
+        it = mAddresses.erase(it);
+        continue;
+      }
+
+      size_t split = it->first.rfind(':');
+      text += "address " + std::to_string(it->second.UsedAt) + ' ' +
+              it->first.substr(0, split) + ' ' + it->first.substr(split + 1) +
+              ' ' + it->second.Ip + '\n';
+      ++it;
+    }
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+    if (mPortable)
+      curl_easy_ssls_export(mHandle, ExportProc, &text);
+#endif
+
+    if (text == mWriter->Saved) {
+      mWriter->Busy.store(false);
+      return;
+    }
+
+    // Replace the file as a whole so a crash never leaves half of it.
+    std::string temp = mPath + ".tmp";
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_CLOEXEC
+    // MinGW has no such flag (nor exec).
+    flags |= O_CLOEXEC;
+#endif
+    int file = open(temp.c_str(), flags, 0600);
+    if (file < 0) {
+      SDL_LogWarn(0, "Cannot write %s: %s", temp.c_str(), strerror(errno));
+      mWriter->Busy.store(false);
+      return;
+    }
+
+    // Failed writes are tried again with the next save.
+    auto data = std::make_shared<std::string>(std::move(text));
+    auto writer = mWriter;
+    std::string path = mPath;
+    DiskWrite(file,
+              data->data(),
+              data->size(),
+              0,
+              [data, writer, file, temp, path](long aResult) {
+                if (aResult < 0) {
+                  Discard(file, temp, "write", aResult);
+                  writer->Busy.store(false);
+                  return;
+                }
+
+                // A crash after the rename must not leave an empty file.
+                DiskSync(file, [data, writer, file, temp, path](long aResult) {
+                  if (aResult < 0) {
+                    Discard(file, temp, "sync", aResult);
+                  } else {
+                    close(file);
+                    if (MoveOver(temp, path)) {
+                      writer->Saved = std::move(*data);
+                    } else {
+                      SDL_LogWarn(0,
+                                  "Cannot replace %s: %s",
+                                  path.c_str(),
+                                  strerror(errno));
+                      remove(temp.c_str());
+                    }
+                  }
+
+                  writer->Busy.store(false);
+                });
+              });
+  }
+
+private:
+  /// Give up on the temporary file after an i/o error.
+  static void Discard(int aFile,
+                      const std::string& aTemp,
+                      const char* aStep,
+                      long aResult)
+  {
+    close(aFile);
+    SDL_LogWarn(
+      0, "Cannot %s %s: %s", aStep, aTemp.c_str(), strerror(-aResult));
+    remove(aTemp.c_str());
+  }
+
+  void Load()
+  {
+    std::ifstream input(mPath);
+    std::string line;
+
+    // Nothing was saved yet.
+    if (!input)
+      return;
+
+    if (!std::getline(input, line) || line != Header) {
+      SDL_LogWarn(0, "Ignoring %s: unknown format", mPath.c_str());
+      return;
+    }
+
+    int64_t now = std::time(nullptr);
+    size_t sessions = 0;
+
+    while (std::getline(input, line)) {
+      std::istringstream fields(line);
+      std::string kind;
+      int64_t time = 0;
+      fields >> kind >> time;
+
+      if (kind == "address") {
+        std::string host, port, ip;
+        fields >> host >> port >> ip;
+        if (fields && now - time <= AddressLifetime)
+          mAddresses[host + ':' + port] = { ip, time };
+      } else if (kind == "session") {
+        std::string key, mac, data;
+        fields >> key >> mac >> data;
+        if (fields && time > now && Import(key, mac, data))
+          sessions += 1;
+      }
+    }
+
+    // Entries with a plus expire instead of staying forever.
+    for (const auto& [name, address] : mAddresses) {
+      bool ipv6 = address.Ip.find(':') != std::string::npos;
+      std::string entry = '+' + name + ':' +
+                          (ipv6 ? '[' + address.Ip + ']' : address.Ip);
+      mResolve = curl_slist_append(mResolve, entry.c_str());
+    }
+
+    SDL_Log("Session file: %s (%zu addresses, %zu TLS sessions)",
+            mPath.c_str(),
+            mAddresses.size(),
+            sessions);
+  }
+
+  bool Import(const std::string& aKey,
+              const std::string& aMac,
+              const std::string& aData)
+  {
+    std::optional<std::string> key = FromHex(aKey);
+    std::optional<std::string> mac = FromHex(aMac);
+    std::optional<std::string> data = FromHex(aData);
+    if (!mPortable || !key || !mac || !data)
+      return false;
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+    // Sessions of hosts that hash their keys have no plain key.
+    auto bytes = [](const std::string& aText) {
+      return reinterpret_cast<const unsigned char*>(aText.data());
+    };
+    return curl_easy_ssls_import(mHandle,
+                                 key->empty() ? nullptr : key->c_str(),
+                                 bytes(mac.value()),
+                                 mac->size(),
+                                 bytes(data.value()),
+                                 data->size()) == CURLE_OK;
+#else
+    return false;
+#endif
+  }
+
+  static CURLcode ExportProc(CURL*,
+                             void* aOutput,
+                             const char* aKey,
+                             const unsigned char* aMac,
+                             size_t aMacSize,
+                             const unsigned char* aData,
+                             size_t aDataSize,
+                             curl_off_t aValidUntil,
+                             int,
+                             const char*,
+                             size_t)
+  {
+    auto& output = *reinterpret_cast<std::string*>(aOutput);
+    output += "session " + std::to_string(aValidUntil) + ' ' +
+              ToHex(aKey, aKey ? strlen(aKey) : 0) + ' ' +
+              ToHex(aMac, aMacSize) + ' ' + ToHex(aData, aDataSize) + '\n';
+    return CURLE_OK;
+  }
+
+  /// Empty values are written as a dash to keep the fields apart.
+  static std::string ToHex(const void* aData, size_t aSize)
+  {
+    static const char digits[] = "0123456789abcdef";
+    auto bytes = static_cast<const unsigned char*>(aData);
+    std::string result;
+
+    for (size_t i = 0; i < aSize; ++i) {
+      result += digits[bytes[i] >> 4];
+      result += digits[bytes[i] & 15];
+    }
+
+    return result.empty() ? "-" : result;
+  }
+
+  static std::optional<std::string> FromHex(const std::string& aText)
+  {
+    if (aText == "-")
+      return std::string();
+    if (aText.size() % 2 != 0)
+      return std::nullopt;
+
+    std::string result;
+    for (size_t i = 0; i < aText.size(); i += 2) {
+      int high = GetDigit(aText[i]);
+      int low = GetDigit(aText[i + 1]);
+      if (high < 0 || low < 0)
+        return std::nullopt;
+      result += static_cast<char>(high << 4 | low);
+    }
+
+    return result;
+  }
+
+  static int GetDigit(char aDigit)
+  {
+    if (aDigit >= '0' && aDigit <= '9')
+      return aDigit - '0';
+    if (aDigit >= 'a' && aDigit <= 'f')
+      return aDigit - 'a' + 10;
+    return -1;
+  }
+};
 
 }
 
@@ -72,29 +1155,52 @@ namespace {
 class DownloadThread
 {
   /// Whether the main loop for the thread should exit.
-  bool mRunning;
+  std::atomic<bool> mRunning;
   /// All downloads and i/o will happen on this thread.
   std::thread mThread;
+  /// Set once the main loop has cancelled its transfers.
+  std::promise<void> mExited;
   /// Synchronize access to the transfer queue.
-  std::mutex mMutex;
+  MeteredMutex mMutex;
+  /// Transfers that are queued or running.
+  std::atomic<size_t> mPending;
 
 public:
   struct Task
   {
     std::string ResourceLink;
+    /// Emit the result as soon as the transfer starts.
+    bool Streaming = false;
+    /// Runs the signals on the thread of the requester.
+    Executor Runner;
+    /// Filled in just before the signals are emitted.
+    DownloadTiming Timing;
     sigc::signal<void(std::string)> Failed;
     sigc::signal<void(std::shared_ptr<std::istream>)> Finished;
   };
 
 private:
   /// Sequence of transfers to be submitted to CURL.
-  std::queue<std::unique_ptr<Task>> mQueue;
+  MeteredQueue<std::unique_ptr<Task>> mQueue;
   /// Store the single CURL multi context.
   CURLM* mLibrary;
+  /// Time to first byte of the latest transfers (milliseconds).
+  std::deque<double> mFirstBytes;
+  /// Duplicate transfers that can be started right now.
+  double mHedgeTokens;
+  /// Replaced when `network.origins` changes.
+  std::shared_ptr<OriginSet> mOrigins;
+  /// Caches that every transfer shares.
+  SessionStore mSessions;
 
 public:
   DownloadThread()
     : mRunning(true)
+    , mMutex("lock.download")
+    , mPending(0)
+    , mQueue("queue.download")
+    , mHedgeTokens(0.0)
+    , mSessions(GetConfig()->SessionFile)
   {
     mLibrary = curl_multi_init();
     mThread = std::thread(std::bind(&DownloadThread::MainLoop, this));
@@ -103,67 +1209,160 @@ public:
   DownloadThread(const DownloadThread& aOther) = delete;
   DownloadThread& operator=(const DownloadThread& aOther) = delete;
 
+  /// Only valid once \ref Stop succeeded.
   ~DownloadThread()
   {
-    mRunning = false;
+    assert(!mThread.joinable());
+    curl_multi_cleanup(mLibrary);
+  }
+
+  /**
+   * \brief Cancel every transfer and wait for the thread to exit.
+   *
+   * Returns false if the thread is still busy at the deadline; it keeps
+   * running detached and this object must not be destroyed.
+   */
+  bool Stop(std::chrono::steady_clock::time_point aDeadline)
+  {
+    std::future<void> exited = mExited.get_future();
+
+    {
+      std::unique_lock<MeteredMutex> lock(mMutex);
+      mRunning = false;
+    }
+
     curl_multi_wakeup(mLibrary);
+
+    if (exited.wait_until(aDeadline) == std::future_status::timeout) {
+      mThread.detach();
+      return false;
+    }
+
     mThread.join();
-    curl_multi_cleanup(mLibrary);
+    return true;
   }
 
   void Enqueue(std::unique_ptr<Task> aTask)
   {
-    std::unique_lock<std::mutex> lock(mMutex);
-    mQueue.emplace(std::move(aTask));
+    std::unique_lock<MeteredMutex> lock(mMutex);
+
+    // Nothing would ever complete the task.
+    if (!mRunning)
+      return;
+
+    mQueue.push(std::move(aTask));
+    mPending += 1;
     curl_multi_wakeup(mLibrary);
   }
 
+  size_t GetPending() const { return mPending; }
+
 private:
+  using Clock = std::chrono::steady_clock;
+
+  /// Transfers that the percentile is taken from.
+  static constexpr size_t HedgeWindow = 256;
+  /// Too few transfers say nothing about the tail.
+  static constexpr size_t HedgeMinimumSamples = 16;
+  /// Most duplicates that can be saved up while the network is fast.
+  static constexpr double HedgeBurst = 10.0;
+
   struct State
   {
+    CURL* Handle;
     std::unique_ptr<TempFile> File;
+    /// Moves to the duplicate if this transfer fails first.
     std::unique_ptr<Task> Job;
+    /// Replaces the file (and the job) for streaming transfers.
+    std::shared_ptr<PipeStream> Pipe;
+    /// Bytes given to the pipe (it cannot start over after that).
+    uint64_t Received = 0;
+    DownloadTiming Timing;
+    /// Link as requested (the timing has the one that was used).
+    std::string Link;
+    /// Origin that the transfer went to and every one tried for the link.
+    std::shared_ptr<OriginSet> Origins;
+    size_t Group = OriginSet::None;
+    size_t Host = 0;
+    uint64_t Tried = 0;
+    /// Other transfer of the same resource that is still running.
+    State* Twin = nullptr;
+    /// Whether this is the duplicate of another transfer.
+    bool Hedge = false;
+    /// Start a duplicate if there is no response by then.
+    std::optional<Clock::time_point> HedgeAt;
   };
 
   static size_t WriteProc(char* src, size_t a, size_t b, void* st)
   {
     auto progress = reinterpret_cast<State*>(st);
     size_t count = a * b;
-    progress->File->write(src, count);
-    return progress->File->good() ? count : 0;
+
+    if (progress->Pipe) {
+      // Error pages must never reach the reader.
+      long code;
+      curl_easy_getinfo(progress->Handle, CURLINFO_RESPONSE_CODE, &code);
+      if (code != 200)
+        return 0;
+
+      progress->Pipe->Append(src, count);
+      progress->Received += count;
+      return count;
+    }
+
+    progress->File->Append(src, count);
+    return count;
   }
 
   void CompleteWithFailure(State& aState, std::string aMessage)
   {
-    auto task = aState.Job.release();
+    if (aState.Pipe) {
+      aState.Pipe->Close(std::move(aMessage));
+      return;
+    }
+
+    // Owned by the functor so nothing leaks if it never runs.
+    std::shared_ptr<Task> task = std::move(aState.Job);
 
-    InvokeAsync([aMessage, task]() {
-      task->Failed(std::move(aMessage));
-      delete task;
-    });
+    task->Runner([aMessage, task]() { task->Failed(std::move(aMessage)); });
   }
 
   void CompleteWithSuccess(State& aState)
   {
-    auto file = aState.File.release();
-    auto task = aState.Job.release();
+    if (aState.Pipe) {
+      aState.Pipe->Close();
+      return;
+    }
+
+    aState.File->Close();
 
-    file->flush();
-    file->seekg(0, std::ios_base::beg);
-    file->clear();
+    std::shared_ptr<std::istream> file = std::move(aState.File);
+    std::shared_ptr<Task> task = std::move(aState.Job);
 
-    InvokeAsync([file, task]() {
-      task->Finished(std::shared_ptr<std::istream>(file));
-      delete task;
-    });
+    task->Runner([file, task]() { task->Finished(file); });
   }
 
   void MainLoop()
   {
+    ProfilerScope profile("download");
+    ApplyThreadClass("download");
     std::unordered_set<CURL*> jobs;
+    std::shared_ptr<const Config> config;
 
     while (mRunning) {
-      SlurpQueue(jobs);
+      // Apply reloaded settings between two rounds of transfers.
+      if (config != GetConfig()) {
+        std::shared_ptr<const Config> prev = std::move(config);
+        config = GetConfig();
+        long limit = static_cast<long>(config->MaxConnections);
+        curl_multi_setopt(mLibrary, CURLMOPT_MAX_TOTAL_CONNECTIONS, limit);
+
+        // Running transfers keep the old origins and their measurements.
+        if (!prev || prev->Origins != config->Origins)
+          mOrigins = std::make_shared<OriginSet>(config->Origins);
+      }
+
+      SlurpQueue(jobs, *config);
 
       int count;
       curl_multi_perform(mLibrary, &count);
@@ -171,75 +1370,325 @@ private:
         if (msg->msg != CURLMSG_DONE)
           continue;
 
+        // The message is gone once a twin is removed below.
+        CURL* easy = msg->easy_handle;
+        CURLcode result = msg->data.result;
         State* state;
-        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &state);
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, &state);
+
+        // Failed transfers are measured too.
+        MeasureTransfer(easy, state->Timing);
+        RecordTransfer(state->Timing);
+        AddFirstByte(state->Timing);
+        mSessions.Remember(easy, state->Timing);
+
+        long code;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &code);
+        std::optional<std::string> error;
+
+        // Missing resources are missing from every origin.
+        bool unreachable = code >= 500 ||
+                           (result != CURLE_OK && result != CURLE_WRITE_ERROR);
+        if (unreachable)
+          state->Origins->ReportFailure(state->Group, state->Host);
+        else
+          state->Origins->Report(state->Group, state->Host, state->Timing);
+
+        if (result == CURLE_OK) {
+          if (code != 200)
+            error = std::to_string(code);
+        } else if (state->Pipe && result == CURLE_WRITE_ERROR) {
+          // Streaming transfers are aborted on error pages.
+          error = std::to_string(code);
+        } else {
+          // The library provides formatted error messages.
+          error = curl_easy_strerror(result);
+        }
 
-        if (msg->data.result == CURLE_OK) {
-          long code;
-          curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &code);
+        State* twin = state->Twin;
+        if (twin) {
+          twin->Twin = nullptr;
+          if (!state->Job)
+            state->Job = std::move(twin->Job);
+        }
 
-          if (code == 200)
-            CompleteWithSuccess(*state);
-          else
-            CompleteWithFailure(*state, std::to_string(code));
+        if (error && twin) {
+          // The other transfer might still succeed.
+          twin->Job = std::move(state->Job);
+        } else if (error && unreachable && FailOver(*state, jobs)) {
+          CountMetric("network.origin.failovers");
         } else {
-          // The library provides formatted error messages.
-          auto message = curl_easy_strerror(msg->data.result);
-          CompleteWithFailure(*state, message);
+          if (state->Job)
+            state->Job->Timing = state->Timing;
+
+          if (error)
+            CompleteWithFailure(*state, error.value());
+          else
+            CompleteWithSuccess(*state);
+
+          mPending -= 1;
+
+          if (twin) {
+            CountMetric(state->Hedge ? "network.hedge.won"
+                                     : "network.hedge.lost");
+            Abandon(*twin);
+            jobs.erase(jobs.find(twin->Handle));
+            curl_multi_remove_handle(mLibrary, twin->Handle);
+            curl_easy_cleanup(twin->Handle);
+            delete twin;
+          }
         }
 
         delete state;
-        jobs.erase(jobs.find(msg->easy_handle));
-        curl_multi_remove_handle(mLibrary, msg->easy_handle);
-        curl_easy_cleanup(msg->easy_handle);
+        jobs.erase(jobs.find(easy));
+        curl_multi_remove_handle(mLibrary, easy);
+        curl_easy_cleanup(easy);
+      }
 
-        // This can be interrupted from another thread.
-        curl_multi_poll(mLibrary, nullptr, 0, 1000, nullptr);
+      mSessions.Save(false);
+
+      // Wake up in time for the next duplicate.
+      auto timeout = static_cast<int>(config->PollTimeout);
+      if (auto next = StartHedges(jobs)) {
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+          next.value() - Clock::now());
+        timeout = std::clamp<int>(wait.count(), 0, timeout);
       }
+
+      // This can be interrupted from another thread.
+      curl_multi_poll(mLibrary, nullptr, 0, timeout, nullptr);
     }
 
     // Clean up any remaining downloads retained by CURL.
+    CountMetric("network.cancelled", jobs.size());
     for (auto easy : jobs) {
       State* state;
       curl_easy_getinfo(easy, CURLINFO_PRIVATE, &state);
 
+      // Readers might still be waiting for more data.
+      if (state->Pipe)
+        state->Pipe->Close("Transfer cancelled");
+
       delete state;
       curl_multi_remove_handle(mLibrary, easy);
       curl_easy_cleanup(easy);
     }
+
+    mSessions.Save(true);
+    mExited.set_value();
+  }
+
+  /// Count a transfer that lost the race as slow if it had no response.
+  void Abandon(State& aState)
+  {
+    curl_off_t first = 0;
+    curl_easy_getinfo(aState.Handle, CURLINFO_STARTTRANSFER_TIME_T, &first);
+    if (first > 0)
+      return;
+
+    curl_off_t elapsed = 0;
+    curl_easy_getinfo(aState.Handle, CURLINFO_TOTAL_TIME_T, &elapsed);
+    aState.Origins->ReportStall(aState.Group, aState.Host, elapsed / 1000.0);
+  }
+
+  /// Start the transfer again on an origin that was not tried yet.
+  bool FailOver(State& aState, std::unordered_set<CURL*>& aWorkingSet)
+  {
+    size_t count = aState.Origins->GetHostCount(aState.Group);
+    bool left = false;
+    for (size_t i = 0; i < std::min<size_t>(count, 64); ++i)
+      left |= !(aState.Tried >> i & 1);
+
+    // The reader has seen part of the response already.
+    if (!left || (aState.Pipe && aState.Received > 0))
+      return false;
+
+    auto state = new State;
+    state->Job = std::move(aState.Job);
+    state->Pipe = std::move(aState.Pipe);
+    if (!state->Pipe)
+      state->File = std::make_unique<TempFile>();
+
+    state->Timing.StartTime = std::chrono::system_clock::now();
+    state->Link = aState.Link;
+    state->Origins = aState.Origins;
+    state->Tried = aState.Tried;
+
+    AddTransfer(*state);
+    aWorkingSet.emplace(state->Handle);
+    return true;
+  }
+
+  void AddFirstByte(const DownloadTiming& aTiming)
+  {
+    if (aTiming.StartTransfer <= 0.0)
+      return;
+
+    if (mFirstBytes.size() >= HedgeWindow)
+      mFirstBytes.pop_front();
+    mFirstBytes.push_back(aTiming.StartTransfer);
+  }
+
+  /// Percentile of the recent times to first byte (if hedging is on).
+  std::optional<double> GetHedgeDelay(const Config& aConfig) const
+  {
+    if (!aConfig.Hedging || mFirstBytes.size() < HedgeMinimumSamples)
+      return std::nullopt;
+
+    std::vector<double> samples(mFirstBytes.begin(), mFirstBytes.end());
+    auto rank = static_cast<size_t>(aConfig.HedgePercentile *
+                                    static_cast<double>(samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return samples[rank];
+  }
+
+  /**
+   * \brief Duplicate the transfers that are late for their first byte.
+   *
+   * The duplicate uses a new connection and whichever transfer finishes
+   * first cancels the other one. Returns the time when the next transfer
+   * will be late.
+   */
+  std::optional<Clock::time_point> StartHedges(
+    std::unordered_set<CURL*>& aWorkingSet)
+  {
+    Clock::time_point now = Clock::now();
+    std::optional<Clock::time_point> result;
+    std::vector<State*> late;
+
+    for (CURL* easy : aWorkingSet) {
+      State* state;
+      curl_easy_getinfo(easy, CURLINFO_PRIVATE, &state);
+      if (!state->HedgeAt)
+        continue;
+
+      curl_off_t first = 0;
+      curl_easy_getinfo(easy, CURLINFO_STARTTRANSFER_TIME_T, &first);
+
+      if (first > 0) {
+        state->HedgeAt.reset();
+      } else if (state->HedgeAt.value() > now) {
+        result = std::min(result.value_or(Clock::time_point::max()),
+                          state->HedgeAt.value());
+      } else {
+        state->HedgeAt.reset();
+        late.push_back(state);
+      }
+    }
+
+    for (State* state : late) {
+      if (mHedgeTokens < 1.0) {
+        CountMetric("network.hedge.skipped");
+        continue;
+      }
+
+      mHedgeTokens -= 1.0;
+      CountMetric("network.hedge.sent");
+
+      // Prefer another origin so the copy does not meet the same delay.
+      auto hedge = new State;
+      hedge->File = std::make_unique<TempFile>();
+      hedge->Timing.StartTime = std::chrono::system_clock::now();
+      hedge->Link = state->Link;
+      hedge->Origins = state->Origins;
+      hedge->Tried = state->Tried;
+      hedge->Hedge = true;
+      hedge->Twin = state;
+      state->Twin = hedge;
+
+      AddTransfer(*hedge);
+      aWorkingSet.emplace(hedge->Handle);
+    }
+
+    return result;
+  }
+
+  void AddTransfer(State& aState)
+  {
+    OriginSet::Route route = aState.Origins->Select(aState.Link, aState.Tried);
+    aState.Group = route.Group;
+    aState.Host = route.Host;
+    if (route.Host < 64)
+      aState.Tried |= uint64_t(1) << route.Host;
+    aState.Timing.ResourceLink = std::move(route.Link);
+
+    auto easy = curl_easy_init();
+    aState.Handle = easy;
+    curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, &aState);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &aState);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, WriteProc);
+    mSessions.Attach(easy);
+
+    // Every request is a GET, which is safe to send with the handshake.
+    long ssl = CURLSSLOPT_NATIVE_CA;
+#ifdef CURLSSLOPT_EARLYDATA
+    ssl |= CURLSSLOPT_EARLYDATA;
+#endif
+    curl_easy_setopt(easy, CURLOPT_SSL_OPTIONS, ssl);
+
+    // The library copies the path.
+    std::shared_ptr<const Config> config = GetConfig();
+    if (!config->CaFile.empty())
+      curl_easy_setopt(easy, CURLOPT_CAINFO, config->CaFile.c_str());
+
+    // A slow server would most likely stall a reused connection again.
+    if (aState.Hedge)
+      curl_easy_setopt(easy, CURLOPT_FRESH_CONNECT, 1L);
+
+    // The library keeps its own copy of the string.
+    curl_easy_setopt(easy, CURLOPT_URL, aState.Timing.ResourceLink.c_str());
+    curl_multi_add_handle(mLibrary, easy);
   }
 
   /// Consume all elements in the queue (thread-safe).
-  void SlurpQueue(std::unordered_set<CURL*>& aWorkingSet)
+  void SlurpQueue(std::unordered_set<CURL*>& aWorkingSet,
+                  const Config& aConfig)
   {
     // Temporary storage for the queue.
-    decltype(mQueue) save;
+    std::vector<std::unique_ptr<Task>> save;
 
     // This is the fastest way to consume the whole queue.
     {
-      std::unique_lock<std::mutex> lock(mMutex);
-      std::swap(save, mQueue);
+      std::unique_lock<MeteredMutex> lock(mMutex);
+      save = mQueue.PopAll();
     }
 
+    std::optional<double> delay;
+    if (!save.empty())
+      delay = GetHedgeDelay(aConfig);
+
     // Use the saved queue so the lock can be released.
-    while (!save.empty()) {
+    for (auto& job : save) {
       auto state = new State;
-      state->File = std::make_unique<TempFile>();
-      state->Job = std::move(save.front());
-
-      auto easy = curl_easy_init();
-      curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
-      curl_easy_setopt(easy, CURLOPT_PRIVATE, state);
-      curl_easy_setopt(easy, CURLOPT_WRITEDATA, state);
-      curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, WriteProc);
-      curl_easy_setopt(easy, CURLOPT_SSL_OPTIONS, CURLSSLOPT_NATIVE_CA);
+      state->Job = std::move(job);
+      state->Link = state->Job->ResourceLink;
+      state->Origins = mOrigins;
+      state->Timing.StartTime = std::chrono::system_clock::now();
+
+      if (state->Job->Streaming) {
+        // Readers will block on the stream until data arrives.
+        auto pipe = std::make_shared<PipeStream>();
+        std::shared_ptr<Task> task = std::move(state->Job);
+        state->Pipe = pipe;
+
+        task->Runner([pipe, task]() { task->Finished(pipe); });
+      } else {
+        state->File = std::make_unique<TempFile>();
+      }
 
-      auto url = state->Job->ResourceLink.c_str();
-      curl_easy_setopt(easy, CURLOPT_URL, url);
-      curl_multi_add_handle(mLibrary, easy);
+      // Streams have handed out their data already so they cannot race.
+      if (delay && !state->Pipe) {
+        std::chrono::duration<double, std::milli> wait(delay.value());
+        state->HedgeAt =
+          Clock::now() + std::chrono::ceil<Clock::duration>(wait);
+        mHedgeTokens =
+          std::min(mHedgeTokens + aConfig.HedgeBudget, HedgeBurst);
+        RecordMetric("network.hedge.delay", delay.value());
+      }
 
-      aWorkingSet.emplace(easy);
-      save.pop();
+      AddTransfer(*state);
+      aWorkingSet.emplace(state->Handle);
     }
   }
 };
@@ -276,13 +1725,222 @@ InitNetwork()
   gThread = new DownloadThread;
 }
 
-void
-FreeNetwork()
+size_t
+GetPendingDownloads()
 {
   assert(gThread);
+  return gThread->GetPending();
+}
+
+bool
+FreeNetwork(std::chrono::steady_clock::time_point aDeadline)
+{
+  assert(gThread);
+
+  if (!gThread->Stop(aDeadline)) {
+    // The library state is still in use so it is leaked as well.
+    SDL_LogWarn(0, "Abandoning the download thread");
+    CountMetric("exit.abandoned");
+    gThread = nullptr;
+    return false;
+  }
+
   delete gThread;
   gThread = nullptr;
   curl_global_cleanup();
+  return true;
+}
+
+//===========================================================================//
+//=== Archive ===============================================================//
+//===========================================================================//
+
+namespace {
+
+using HarWriter = rapidjson::Writer<rapidjson::StringBuffer>;
+
+/// ISO 8601 in UTC with milliseconds.
+std::string
+FormatTime(std::chrono::system_clock::time_point aTime)
+{
+  using namespace std::chrono;
+  auto millis = duration_cast<milliseconds>(aTime.time_since_epoch()) % 1000;
+  std::time_t seconds = system_clock::to_time_t(aTime);
+  std::tm parts;
+
+#ifdef _WIN32
+  gmtime_s(&parts, &seconds);
+#else
+  gmtime_r(&seconds, &parts);
+#endif
+
+  char buffer[32];
+  size_t size = strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &parts);
+  snprintf(buffer + size,
+           sizeof(buffer) - size,
+           ".%03dZ",
+           static_cast<int>(millis.count()));
+  return buffer;
+}
+
+void
+WriteString(HarWriter& aWriter, const std::string& aValue)
+{
+  aWriter.String(aValue.c_str(), aValue.size());
+}
+
+void
+WriteEmptyArray(HarWriter& aWriter, const char* aKey)
+{
+  aWriter.Key(aKey);
+  aWriter.StartArray();
+  aWriter.EndArray();
+}
+
+/// Phases that do not apply are -1 as required by the format.
+void
+WriteTimings(HarWriter& aWriter, const DownloadTiming& aTiming)
+{
+  // The connection is ready for the request at this point.
+  double ready =
+    std::max({ aTiming.NameLookup, aTiming.Connect, aTiming.AppConnect });
+  double first = (aTiming.StartTransfer > 0.0) ? aTiming.StartTransfer
+                                               : aTiming.Total;
+
+  aWriter.Key("timings");
+  aWriter.StartObject();
+  aWriter.Key("blocked");
+  aWriter.Int(-1);
+
+  if (aTiming.Reused) {
+    aWriter.Key("dns");
+    aWriter.Int(-1);
+    aWriter.Key("connect");
+    aWriter.Int(-1);
+    aWriter.Key("ssl");
+    aWriter.Int(-1);
+  } else {
+    // The handshake is also included in the connection time.
+    aWriter.Key("dns");
+    aWriter.Double(aTiming.NameLookup);
+    aWriter.Key("connect");
+    aWriter.Double(ready - aTiming.NameLookup);
+    aWriter.Key("ssl");
+    if (aTiming.AppConnect > 0.0)
+      aWriter.Double(aTiming.AppConnect - aTiming.Connect);
+    else
+      aWriter.Int(-1);
+  }
+
+  aWriter.Key("send");
+  aWriter.Int(0);
+  aWriter.Key("wait");
+  aWriter.Double(std::max(first - ready, 0.0));
+  aWriter.Key("receive");
+  aWriter.Double(std::max(aTiming.Total - first, 0.0));
+  aWriter.EndObject();
+}
+
+void
+WriteEntry(HarWriter& aWriter, const DownloadTiming& aTiming)
+{
+  aWriter.StartObject();
+  aWriter.Key("startedDateTime");
+  WriteString(aWriter, FormatTime(aTiming.StartTime));
+  aWriter.Key("time");
+  aWriter.Double(aTiming.Total);
+
+  aWriter.Key("request");
+  aWriter.StartObject();
+  aWriter.Key("method");
+  aWriter.String("GET");
+  aWriter.Key("url");
+  WriteString(aWriter, aTiming.ResourceLink);
+  aWriter.Key("httpVersion");
+  WriteString(aWriter, aTiming.HttpVersion);
+  WriteEmptyArray(aWriter, "cookies");
+  WriteEmptyArray(aWriter, "headers");
+  WriteEmptyArray(aWriter, "queryString");
+  aWriter.Key("headersSize");
+  aWriter.Int(-1);
+  aWriter.Key("bodySize");
+  aWriter.Int(0);
+  aWriter.EndObject();
+
+  aWriter.Key("response");
+  aWriter.StartObject();
+  aWriter.Key("status");
+  aWriter.Int64(aTiming.StatusCode);
+  aWriter.Key("statusText");
+  aWriter.String("");
+  aWriter.Key("httpVersion");
+  WriteString(aWriter, aTiming.HttpVersion);
+  WriteEmptyArray(aWriter, "cookies");
+  WriteEmptyArray(aWriter, "headers");
+  aWriter.Key("content");
+  aWriter.StartObject();
+  aWriter.Key("size");
+  aWriter.Uint64(aTiming.Size);
+  aWriter.Key("mimeType");
+  WriteString(aWriter, aTiming.ContentType);
+  aWriter.EndObject();
+  aWriter.Key("redirectURL");
+  aWriter.String("");
+  aWriter.Key("headersSize");
+  aWriter.Int(-1);
+  aWriter.Key("bodySize");
+  aWriter.Uint64(aTiming.Size);
+  aWriter.EndObject();
+
+  aWriter.Key("cache");
+  aWriter.StartObject();
+  aWriter.EndObject();
+  WriteTimings(aWriter, aTiming);
+
+  if (!aTiming.ServerAddress.empty()) {
+    aWriter.Key("serverIPAddress");
+    WriteString(aWriter, aTiming.ServerAddress);
+  }
+
+  aWriter.EndObject();
+}
+
+}
+
+void
+ExportHar(std::ostream& aOutput)
+{
+  decltype(gHarLog) entries;
+
+  {
+    std::unique_lock<std::mutex> lock(gHarMutex);
+    entries = gHarLog;
+  }
+
+  rapidjson::StringBuffer buffer;
+  HarWriter writer(buffer);
+
+  writer.StartObject();
+  writer.Key("log");
+  writer.StartObject();
+  writer.Key("version");
+  writer.String("1.2");
+  writer.Key("creator");
+  writer.StartObject();
+  writer.Key("name");
+  writer.String("interview-disney-2020");
+  writer.Key("version");
+  writer.String("0.1.0");
+  writer.EndObject();
+  writer.Key("entries");
+  writer.StartArray();
+  for (const DownloadTiming& elem : entries)
+    WriteEntry(writer, elem);
+  writer.EndArray();
+  writer.EndObject();
+  writer.EndObject();
+
+  aOutput.write(buffer.GetString(), buffer.GetSize());
 }
 
 //===========================================================================//
@@ -298,17 +1956,23 @@ class AsyncDownload::Private
   std::string mResourceLink;
   /// Error string if applicable.
   std::optional<std::string> mErrorMessage;
+  /// Measured by the download thread.
+  DownloadTiming mTiming;
+  /// Where the signals are emitted.
+  Executor mExecutor;
   /// Final data result if applicable.
   std::shared_ptr<std::istream> mResult;
 
 public:
   explicit Private(AsyncDownload& aParent)
     : mParent(aParent)
+    , mExecutor(InvokeAsync)
   {}
 
   Private(AsyncDownload& aParent, std::string aLink)
     : mParent(aParent)
     , mResourceLink(std::move(aLink))
+    , mExecutor(InvokeAsync)
   {}
 
   Private(const Private& aOther) = delete;
@@ -324,7 +1988,9 @@ public:
 
   std::shared_ptr<std::istream> GetResult() const { return mResult; }
 
-  void Enqueue()
+  const DownloadTiming& GetTiming() const { return mTiming; }
+
+  void Enqueue(bool aStreaming)
   {
     if (mResourceLink.empty()) {
       mErrorMessage.emplace("Resource link is empty");
@@ -334,29 +2000,47 @@ public:
       auto it1 = mConnectionList.emplace(mConnectionList.end());
       auto it2 = mConnectionList.emplace(mConnectionList.end());
       task->ResourceLink = mResourceLink;
+      task->Streaming = aStreaming;
+      task->Runner = mExecutor;
 
       *it1 = task->Failed.connect(
-        // The main loop will delete the signal.
-        [this, it1, it2](std::string aMessage) {
+        // The executor will delete the signal.
+        [this, it1, it2, job = task.get()](std::string aMessage) {
           mConnectionList.erase(it1);
           mConnectionList.erase(it2);
+          mTiming = job->Timing;
           mErrorMessage = std::move(aMessage);
           mParent.Failed(mErrorMessage.value());
         });
 
       *it2 = task->Finished.connect(
-        // The main loop will delete the signal.
-        [this, it1, it2](std::shared_ptr<std::istream> aFile) {
+        // The executor will delete the signal.
+        [this, it1, it2, job = task.get()](
+          std::shared_ptr<std::istream> aFile) {
           mConnectionList.erase(it1);
           mConnectionList.erase(it2);
+          mTiming = job->Timing;
           mResult = aFile;
           mParent.Finished(mResult);
         });
 
-      gThread->Enqueue(std::move(task));
+      if (auto data = OpenBundled(mResourceLink)) {
+        // Still delivered later so callers see the same order of events.
+        std::shared_ptr<DownloadThread::Task> job = std::move(task);
+        job->Timing.ResourceLink = mResourceLink;
+        job->Timing.StartTime = std::chrono::system_clock::now();
+        job->Timing.Size = static_cast<uint64_t>(data->rdbuf()->in_avail());
+        job->Timing.StatusCode = 200;
+
+        job->Runner([job, data]() { job->Finished(data); });
+      } else {
+        gThread->Enqueue(std::move(task));
+      }
     }
   }
 
+  void SetExecutor(Executor aNewValue) { mExecutor = std::move(aNewValue); }
+
   void SetLink(std::string aNewValue) { mResourceLink = std::move(aNewValue); }
 };
 
@@ -382,10 +2066,28 @@ AsyncDownload::GetResult() const
   return mPrivate->GetResult();
 }
 
+const DownloadTiming&
+AsyncDownload::GetTiming() const
+{
+  return mPrivate->GetTiming();
+}
+
 void
 AsyncDownload::Enqueue()
 {
-  mPrivate->Enqueue();
+  mPrivate->Enqueue(false);
+}
+
+void
+AsyncDownload::EnqueueStream()
+{
+  mPrivate->Enqueue(true);
+}
+
+void
+AsyncDownload::SetExecutor(Executor aNewValue)
+{
+  mPrivate->SetExecutor(std::move(aNewValue));
 }
 
 void
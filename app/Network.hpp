@@ -6,12 +6,50 @@
  * \brief Asynchronous network transfers.
  */
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <istream>
 #include <memory>
+#include <ostream>
 #include <string>
 
 #include <sigc++/sigc++.h>
 
+#include "Main.hpp"
+
+/// Breakdown of a finished transfer (milliseconds since it started).
+struct DownloadTiming
+{
+  std::string ResourceLink;
+  /// Wall clock time when the transfer was handed to CURL.
+  std::chrono::system_clock::time_point StartTime;
+  double NameLookup = 0.0;
+  double Connect = 0.0;
+  /// End of the TLS handshake (zero for plain HTTP).
+  double AppConnect = 0.0;
+  /// First byte of the response.
+  double StartTransfer = 0.0;
+  double Total = 0.0;
+  /// Size of the response body.
+  uint64_t Size = 0;
+  /// Zero if there was no response.
+  long StatusCode = 0;
+  /// For example "HTTP/2" (empty if there was no response).
+  std::string HttpVersion;
+  /// Whether an existing connection was used.
+  bool Reused = false;
+  std::string ContentType;
+  std::string ServerAddress;
+};
+
+/**
+ * \brief Download a file in the background.
+ *
+ * Requests can be made from any thread. An object and its signals belong to
+ * the thread that runs its executor: enqueue, read and destroy it there (the
+ * main thread by default).
+ */
 class AsyncDownload
 {
   class Private;
@@ -30,16 +68,42 @@ public:
 
   const std::string& GetErrorMessage() const;
   std::shared_ptr<std::istream> GetResult() const;
+  /// Filled in before \ref Finished or \ref Failed (not for streams).
+  const DownloadTiming& GetTiming() const;
 
   void Enqueue();
+  /**
+   * \brief Start the transfer but emit \ref Finished straight away.
+   *
+   * Reading from the stream blocks until more data arrives. Transfer errors
+   * are thrown from the stream instead of emitting \ref Failed.
+   */
+  void EnqueueStream();
+  /// Emit the signals through this from now on.
+  void SetExecutor(Executor aNewValue);
   void SetLink(std::string aNewValue);
 };
 
 /// Initialize CURL library and boot thread.
 void
 InitNetwork();
-/// Shut down thread and clean up CURL library state.
+/**
+ * \brief Cancel every transfer, then shut down the thread and CURL.
+ *
+ * Transfers that finished but were not delivered yet are left in the event
+ * queue (see \ref DiscardAsync). A thread that is still busy at the deadline
+ * is abandoned and false is returned; it may still use the disk, the bundle
+ * and the event queue, so those must not be shut down after that.
+ */
+bool
+FreeNetwork(std::chrono::steady_clock::time_point aDeadline);
+
+/// Transfers that are queued or still running (thread-safe).
+size_t
+GetPendingDownloads();
+
+/// Write the most recent transfers in the HTTP Archive format (thread-safe).
 void
-FreeNetwork();
+ExportHar(std::ostream& aOutput);
 
 #endif
@@ -0,0 +1,407 @@
+#include "Pressure.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SDL.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+#include "Config.hpp"
+#include "Metrics.hpp"
+
+//===========================================================================//
+//=== Levels ================================================================//
+//===========================================================================//
+
+namespace {
+
+/// Highest level that the viewer has not seen yet.
+std::atomic<int> gPending(static_cast<int>(MemoryPressure::None));
+
+const char*
+GetLevelName(MemoryPressure aLevel)
+{
+  switch (aLevel) {
+    case MemoryPressure::None:
+      return "none";
+    case MemoryPressure::Low:
+      return "low";
+    case MemoryPressure::Medium:
+      return "medium";
+    case MemoryPressure::Critical:
+      return "critical";
+  }
+
+  return "unknown";
+}
+
+std::optional<MemoryPressure>
+ParseLevel(const std::string& aName)
+{
+  for (auto level : { MemoryPressure::Low,
+                      MemoryPressure::Medium,
+                      MemoryPressure::Critical })
+    if (aName == GetLevelName(level))
+      return level;
+
+  return std::nullopt;
+}
+
+}
+
+MemoryPressure
+TakeMemoryPressure()
+{
+  int none = static_cast<int>(MemoryPressure::None);
+  return static_cast<MemoryPressure>(gPending.exchange(none));
+}
+
+void
+RaiseMemoryPressure(MemoryPressure aLevel)
+{
+  int value = static_cast<int>(aLevel);
+  int prev = gPending.load();
+
+  // Keep the highest level until the viewer takes it.
+  while (prev < value && !gPending.compare_exchange_weak(prev, value))
+    continue;
+
+  CountMetric(std::string("pressure.") + GetLevelName(aLevel));
+}
+
+//===========================================================================//
+//=== Sources ===============================================================//
+//===========================================================================//
+
+namespace {
+
+class PressureSource
+{
+public:
+  virtual ~PressureSource() = default;
+  virtual const char* GetName() const = 0;
+};
+
+/// Raise the levels of a script at fixed times (for testing).
+class ScriptSource : public PressureSource
+{
+  struct Step
+  {
+    /// Since the start or the last wait.
+    std::chrono::milliseconds Time;
+    /// None to close the program.
+    std::optional<MemoryPressure> Level;
+    /// Non-empty to wait until the counter is set instead.
+    std::string Counter;
+  };
+
+  /// Whether the main loop for the thread should exit.
+  bool mRunning;
+  std::mutex mMutex;
+  /// Interrupt the wait between steps.
+  std::condition_variable mCondition;
+  std::vector<Step> mSteps;
+  std::thread mThread;
+
+public:
+  explicit ScriptSource(const std::string& aPath)
+    : mRunning(true)
+  {
+    std::ifstream input(aPath);
+    if (!input)
+      throw std::runtime_error("Cannot open pressure script: " + aPath);
+
+    // First step that the timed lines are sorted with.
+    size_t first = 0;
+    std::string line;
+
+    while (std::getline(input, line)) {
+      line.erase(std::find(line.begin(), line.end(), '#'), line.end());
+      std::istringstream fields(line);
+      std::string word, name;
+
+      if (!(fields >> word >> name))
+        continue;
+
+      if (word == "wait") {
+        SortSteps(first);
+        mSteps.push_back({ std::chrono::milliseconds(0), std::nullopt, name });
+        first = mSteps.size();
+        continue;
+      }
+
+      char* end;
+      long time = std::strtol(word.c_str(), &end, 10);
+      if (*end != '\0')
+        throw std::runtime_error("Invalid pressure step time: " + word);
+
+      std::optional<MemoryPressure> level = ParseLevel(name);
+      if (!level && name != "quit")
+        throw std::runtime_error("Unknown pressure level: " + name);
+
+      mSteps.push_back({ std::chrono::milliseconds(time), level });
+    }
+
+    SortSteps(first);
+    mThread = std::thread(std::bind(&ScriptSource::MainLoop, this));
+  }
+
+  ScriptSource(const ScriptSource& aOther) = delete;
+  ScriptSource& operator=(const ScriptSource& aOther) = delete;
+
+  ~ScriptSource()
+  {
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mRunning = false;
+    }
+
+    mCondition.notify_all();
+    mThread.join();
+  }
+
+  const char* GetName() const override { return "script"; }
+
+private:
+  void SortSteps(size_t aFirst)
+  {
+    std::stable_sort(
+      // Out-of-order lines would otherwise fire late.
+      mSteps.begin() + aFirst,
+      mSteps.end(),
+      [](const Step& a, const Step& b) { return a.Time < b.Time; });
+  }
+
+  void MainLoop()
+  {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto stop = [&]() { return !mRunning; };
+
+    for (const Step& step : mSteps) {
+      if (!step.Counter.empty()) {
+        while (GetCounter(step.Counter) == 0)
+          if (mCondition.wait_for(lock, std::chrono::milliseconds(50), stop))
+            return;
+
+        start = std::chrono::steady_clock::now();
+        continue;
+      }
+
+      if (mCondition.wait_until(lock, start + step.Time, stop))
+        return;
+
+      if (step.Level) {
+        RaiseMemoryPressure(step.Level.value());
+      } else {
+        // Same as closing the window, so the metrics are printed.
+        SDL_Event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.type = SDL_QUIT;
+        SDL_PushEvent(&ev);
+      }
+    }
+  }
+};
+
+#ifdef __linux__
+
+struct Trigger
+{
+  MemoryPressure Level;
+  /// Stall time (microseconds) within the window that fires the trigger.
+  const char* Threshold;
+};
+
+/// Unprivileged processes may only use windows in multiples of two seconds.
+const Trigger gTriggers[] = {
+  { MemoryPressure::Low, "some 100000 2000000" },
+  { MemoryPressure::Medium, "some 300000 2000000" },
+  { MemoryPressure::Critical, "full 300000 2000000" },
+};
+
+/// Prefer the cgroup so other tenants of the machine do not count.
+std::string
+FindPressureFile()
+{
+  std::ifstream input("/proc/self/cgroup");
+  std::string line;
+
+  // The unified hierarchy is the only line that starts with zero.
+  while (std::getline(input, line))
+    if (line.compare(0, 3, "0::") == 0) {
+      std::string path = "/sys/fs/cgroup" + line.substr(3);
+      path += "/memory.pressure";
+
+      if (access(path.c_str(), R_OK | W_OK) == 0)
+        return path;
+    }
+
+  return "/proc/pressure/memory";
+}
+
+/// Wait for the PSI triggers to fire (see the kernel psi documentation).
+class KernelSource : public PressureSource
+{
+  std::string mName;
+  /// Signaled when the thread should exit.
+  int mWake;
+  /// One descriptor per entry in \ref gTriggers (or -1).
+  std::vector<int> mTriggers;
+  std::thread mThread;
+
+public:
+  KernelSource()
+  {
+    std::string path = FindPressureFile();
+    mName = "PSI (" + path + ")";
+    int error = 0;
+
+    for (const Trigger& elem : gTriggers) {
+      int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+      size_t size = strlen(elem.Threshold) + 1;
+
+      if (fd >= 0 && write(fd, elem.Threshold, size) < 0) {
+        error = errno;
+        close(fd);
+        fd = -1;
+      } else if (fd < 0) {
+        error = errno;
+      }
+
+      mTriggers.push_back(fd);
+    }
+
+    if (std::all_of(
+          mTriggers.begin(), mTriggers.end(), [](int fd) { return fd < 0; }))
+      throw std::runtime_error(path + ": " + strerror(error));
+
+    mWake = eventfd(0, EFD_CLOEXEC);
+    if (mWake < 0) {
+      error = errno;
+      CloseTriggers();
+      throw std::runtime_error(std::string("eventfd: ") + strerror(error));
+    }
+
+    mThread = std::thread(std::bind(&KernelSource::MainLoop, this));
+  }
+
+  KernelSource(const KernelSource& aOther) = delete;
+  KernelSource& operator=(const KernelSource& aOther) = delete;
+
+  ~KernelSource()
+  {
+    uint64_t value = 1;
+    if (write(mWake, &value, sizeof(value)) < 0)
+      SDL_LogWarn(0, "Cannot stop the pressure thread: %s", strerror(errno));
+
+    mThread.join();
+    close(mWake);
+    CloseTriggers();
+  }
+
+  const char* GetName() const override { return mName.c_str(); }
+
+private:
+  void CloseTriggers()
+  {
+    for (int fd : mTriggers)
+      if (fd >= 0)
+        close(fd);
+  }
+
+  void MainLoop()
+  {
+    std::vector<pollfd> fds;
+    fds.push_back({ mWake, POLLIN, 0 });
+    for (int fd : mTriggers)
+      fds.push_back({ fd, POLLPRI, 0 });
+
+    while (true) {
+      if (poll(fds.data(), fds.size(), -1) < 0) {
+        if (errno == EINTR)
+          continue;
+
+        SDL_LogWarn(0, "Pressure poll error: %s", strerror(errno));
+        return;
+      }
+
+      if (fds[0].revents)
+        return;
+
+      for (size_t i = 1; i < fds.size(); ++i) {
+        if (fds[i].revents & POLLERR) {
+          // The cgroup went away; negative descriptors are skipped.
+          fds[i].fd = -1;
+        } else if (fds[i].revents & POLLPRI) {
+          RaiseMemoryPressure(gTriggers[i - 1].Level);
+        }
+      }
+    }
+  }
+};
+
+#endif
+
+PressureSource* gSource = nullptr;
+
+}
+
+void
+InitPressure()
+{
+  assert(!gSource);
+
+  std::string script = GetConfig()->PressureScript;
+  if (!script.empty()) {
+    try {
+      gSource = new ScriptSource(script);
+    } catch (const std::exception& error) {
+      SDL_LogWarn(0, "%s", error.what());
+    }
+  }
+
+#ifdef __linux__
+  if (!gSource) {
+    try {
+      gSource = new KernelSource;
+    } catch (const std::exception& error) {
+      // Needs Linux 4.20+ and write access to the pressure file.
+      SDL_LogWarn(0, "Memory pressure is not available: %s", error.what());
+    }
+  }
+#endif
+
+  if (gSource)
+    SDL_Log("Memory pressure source: %s", gSource->GetName());
+}
+
+void
+FreePressure()
+{
+  delete gSource;
+  gSource = nullptr;
+}
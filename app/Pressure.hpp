@@ -0,0 +1,42 @@
+#ifndef PRESSURE_HPP
+#define PRESSURE_HPP
+
+/**
+ * \file
+ * \brief Memory pressure notifications (Linux PSI or a replayed script).
+ */
+
+/// Each level asks for everything the lower levels ask for as well.
+enum class MemoryPressure
+{
+  None,
+  /// Drop decoded images that are not on the screen.
+  Low,
+  /// Also drop textures that are not on the screen.
+  Medium,
+  /// Also drop the models of rows that are not on the screen.
+  Critical,
+};
+
+/// Highest level reported since the previous call (thread-safe).
+MemoryPressure
+TakeMemoryPressure();
+/// Report pressure as if it came from the kernel (thread-safe).
+void
+RaiseMemoryPressure(MemoryPressure aLevel);
+
+/**
+ * \brief Install the PSI triggers of the current cgroup.
+ *
+ * With `pressure.script` in the configuration the levels in that file are
+ * replayed instead. Every line holds the milliseconds since this call and a
+ * level name (`low`, `medium` or `critical`) or `quit` to close the program;
+ * blank lines and `#` comments are skipped.
+ */
+void
+InitPressure();
+/// Remove the triggers and shut down the thread.
+void
+FreePressure();
+
+#endif
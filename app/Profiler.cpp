@@ -0,0 +1,561 @@
+#include "Profiler.hpp"
+
+#include <SDL.h>
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Config.hpp"
+#include "Metrics.hpp"
+
+// Older C libraries do not name this field.
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+//===========================================================================//
+//=== Sampling ==============================================================//
+//===========================================================================//
+
+namespace {
+
+/// Deepest stack that is recorded.
+constexpr int MaxDepth = 64;
+/// Signal handler and signal trampoline.
+constexpr int SkipFrames = 2;
+/// Samples buffered between two collector passes.
+constexpr uint64_t RingSize = 1024;
+
+/// Slot in the ring; the sequence number works like a seqlock.
+struct Sample
+{
+  std::atomic<uint64_t> Sequence;
+  int Thread;
+  int Depth;
+  void* Frames[MaxDepth];
+};
+
+Sample gRing[RingSize];
+std::atomic<uint64_t> gWriteIndex(0);
+std::atomic<bool> gSampling(false);
+
+/// Index into the thread list (negative if the thread is not sampled).
+thread_local int gThreadIndex = -1;
+
+/// Only async-signal-safe code from here on.
+void
+OnSampleSignal(int, siginfo_t*, void*)
+{
+  int saved = errno;
+  int thread = gThreadIndex;
+
+  if (thread >= 0 && gSampling.load(std::memory_order_relaxed)) {
+    void* frames[MaxDepth + SkipFrames];
+    int depth = backtrace(frames, MaxDepth + SkipFrames) - SkipFrames;
+
+    uint64_t index = gWriteIndex.fetch_add(1, std::memory_order_relaxed);
+    Sample& slot = gRing[index % RingSize];
+    slot.Sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.Thread = thread;
+    slot.Depth = std::max(depth, 0);
+    memcpy(slot.Frames, frames + SkipFrames, slot.Depth * sizeof(void*));
+    slot.Sequence.store(2 * index + 2, std::memory_order_release);
+  }
+
+  errno = saved;
+}
+
+}
+
+//===========================================================================//
+//=== Threads ===============================================================//
+//===========================================================================//
+
+namespace {
+
+struct ThreadEntry
+{
+  std::string Name;
+  pthread_t Handle;
+  pid_t Id;
+  /// Fires on the CPU clock of the thread.
+  timer_t Timer;
+  bool Armed = false;
+  bool Alive = true;
+};
+
+/// Entries are never removed because the samples refer to them by index.
+std::mutex gThreadMutex;
+std::vector<ThreadEntry> gThreads;
+
+/// Lock must be held.
+void
+ArmThread(ThreadEntry& aEntry)
+{
+  clockid_t clock;
+  if (pthread_getcpuclockid(aEntry.Handle, &clock) != 0)
+    return;
+
+  sigevent event;
+  memset(&event, 0, sizeof(event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+  event.sigev_notify_thread_id = aEntry.Id;
+
+  if (timer_create(clock, &event, &aEntry.Timer) != 0) {
+    SDL_LogWarn(
+      0, "Cannot sample %s: %s", aEntry.Name.c_str(), strerror(errno));
+    return;
+  }
+
+  itimerspec interval;
+  interval.it_interval.tv_sec = 0;
+  interval.it_interval.tv_nsec = 1000000000 / GetConfig()->SampleRate;
+  interval.it_value = interval.it_interval;
+  timer_settime(aEntry.Timer, 0, &interval, nullptr);
+  aEntry.Armed = true;
+}
+
+/// Lock must be held.
+void
+DisarmThread(ThreadEntry& aEntry)
+{
+  if (aEntry.Armed) {
+    timer_delete(aEntry.Timer);
+    aEntry.Armed = false;
+  }
+}
+
+}
+
+ProfilerScope::ProfilerScope(const char* aName)
+{
+  std::unique_lock<std::mutex> lock(gThreadMutex);
+  ThreadEntry& entry = gThreads.emplace_back();
+  entry.Name = aName;
+  entry.Handle = pthread_self();
+  entry.Id = static_cast<pid_t>(syscall(SYS_gettid));
+
+  if (gSampling)
+    ArmThread(entry);
+  gThreadIndex = static_cast<int>(gThreads.size() - 1);
+}
+
+ProfilerScope::~ProfilerScope()
+{
+  std::unique_lock<std::mutex> lock(gThreadMutex);
+  ThreadEntry& entry = gThreads[gThreadIndex];
+  gThreadIndex = -1;
+  DisarmThread(entry);
+  entry.Alive = false;
+}
+
+//===========================================================================//
+//=== Collector =============================================================//
+//===========================================================================//
+
+namespace {
+
+/// Distinct stacks that are kept; the rest are merged per thread.
+constexpr size_t MaxStacks = 1 << 16;
+/// Return addresses that are remembered after symbol lookup.
+constexpr size_t MaxAddresses = 1 << 18;
+constexpr auto CollectInterval = std::chrono::milliseconds(100);
+constexpr auto WriteInterval = std::chrono::seconds(10);
+
+class Collector
+{
+  /// Posted from the signal handler so no locks are allowed.
+  sem_t mWakeup;
+  std::atomic<bool> mRunning;
+  std::atomic<bool> mWanted;
+  std::thread mThread;
+
+  /// Only touched by the thread (or while it is stopped).
+  std::string mPath;
+  uint64_t mReadIndex;
+  uint64_t mDropped;
+  /// Thread index followed by the symbols (innermost first).
+  std::unordered_map<std::string, uint64_t> mStacks;
+  std::unordered_map<void*, uint32_t> mAddresses;
+  std::unordered_map<std::string, uint32_t> mSymbols;
+  std::vector<std::string> mNames;
+  std::chrono::steady_clock::time_point mNextWrite;
+
+  /// Set by \ref StartProfiler and read by the thread.
+  std::mutex mPathMutex;
+  std::string mNextPath;
+
+public:
+  Collector()
+    : mRunning(true)
+    , mWanted(false)
+    , mReadIndex(0)
+    , mDropped(0)
+  {
+    sem_init(&mWakeup, 0, 0);
+    mThread = std::thread(std::bind(&Collector::MainLoop, this));
+  }
+
+  Collector(const Collector& aOther) = delete;
+  Collector& operator=(const Collector& aOther) = delete;
+
+  ~Collector()
+  {
+    mRunning = false;
+    sem_post(&mWakeup);
+    mThread.join();
+    sem_destroy(&mWakeup);
+  }
+
+  void Start(std::string aPath)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mPathMutex);
+      mNextPath = std::move(aPath);
+    }
+
+    mWanted = true;
+    sem_post(&mWakeup);
+  }
+
+  void Stop()
+  {
+    mWanted = false;
+    sem_post(&mWakeup);
+  }
+
+  /// Safe to call from a signal handler.
+  void Toggle()
+  {
+    mWanted = !mWanted;
+    sem_post(&mWakeup);
+  }
+
+private:
+  void MainLoop()
+  {
+    while (mRunning) {
+      if (gSampling) {
+        auto wake = std::chrono::system_clock::now() + CollectInterval;
+        auto since = wake.time_since_epoch();
+        timespec deadline;
+        deadline.tv_sec =
+          std::chrono::duration_cast<std::chrono::seconds>(since).count();
+        deadline.tv_nsec =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(since).count() %
+          1000000000;
+        sem_timedwait(&mWakeup, &deadline);
+      } else {
+        sem_wait(&mWakeup);
+      }
+
+      if (mWanted && mRunning && !gSampling)
+        Begin();
+      else if ((!mWanted || !mRunning) && gSampling)
+        End();
+
+      if (gSampling) {
+        Drain();
+
+        if (std::chrono::steady_clock::now() >= mNextWrite) {
+          Write();
+          mNextWrite = std::chrono::steady_clock::now() + WriteInterval;
+        }
+      }
+    }
+  }
+
+  void Begin()
+  {
+    {
+      std::unique_lock<std::mutex> lock(mPathMutex);
+      mPath = mNextPath;
+    }
+
+    // Started by the signal without a path.
+    if (mPath.empty())
+      mPath = "profile-" + std::to_string(getpid()) + ".folded";
+
+    mStacks.clear();
+    mDropped = 0;
+    mReadIndex = gWriteIndex;
+    mNextWrite = std::chrono::steady_clock::now() + WriteInterval;
+
+    std::unique_lock<std::mutex> lock(gThreadMutex);
+    gSampling = true;
+
+    for (ThreadEntry& elem : gThreads)
+      if (elem.Alive)
+        ArmThread(elem);
+
+    SDL_Log("Profiler writing to %s", mPath.c_str());
+  }
+
+  void End()
+  {
+    {
+      std::unique_lock<std::mutex> lock(gThreadMutex);
+      gSampling = false;
+
+      for (ThreadEntry& elem : gThreads)
+        DisarmThread(elem);
+    }
+
+    Drain();
+    Write();
+    SDL_Log("Profiler stopped");
+  }
+
+  void Drain()
+  {
+    uint64_t end = gWriteIndex.load(std::memory_order_acquire);
+    uint64_t start = mReadIndex;
+    uint64_t dropped = mDropped;
+
+    // The writers lapped the collector.
+    if (end - mReadIndex > RingSize) {
+      mDropped += end - mReadIndex - RingSize;
+      mReadIndex = end - RingSize;
+    }
+
+    for (; mReadIndex < end; ++mReadIndex) {
+      const Sample& slot = gRing[mReadIndex % RingSize];
+      uint64_t expected = 2 * mReadIndex + 2;
+      uint64_t sequence = slot.Sequence.load(std::memory_order_acquire);
+
+      // Still being written (try again next time).
+      if (sequence < expected)
+        break;
+
+      int thread = slot.Thread;
+      int depth = std::min(slot.Depth, MaxDepth);
+      void* frames[MaxDepth];
+      memcpy(frames, slot.Frames, depth * sizeof(void*));
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.Sequence.load(std::memory_order_relaxed) != expected) {
+        mDropped += 1;
+        continue;
+      }
+
+      // Samples in the same functions are merged right away.
+      std::string key(sizeof(thread) + depth * sizeof(uint32_t), '\0');
+      memcpy(&key[0], &thread, sizeof(thread));
+
+      for (int i = 0; i < depth; ++i) {
+        // Return addresses point after the call (except the first frame).
+        auto address = static_cast<char*>(frames[i]) - (i == 0 ? 0 : 1);
+        uint32_t symbol = GetSymbol(address);
+        memcpy(&key[sizeof(thread) + i * sizeof(symbol)], &symbol, 4);
+      }
+
+      // Unknown stacks only count toward their thread past the limit.
+      auto it = mStacks.find(key);
+      if (it == mStacks.end() && mStacks.size() >= MaxStacks)
+        it = mStacks.emplace(key.substr(0, sizeof(thread)), 0).first;
+      else if (it == mStacks.end())
+        it = mStacks.emplace(std::move(key), 0).first;
+
+      it->second += 1;
+    }
+
+    CountMetric("profiler.samples", mReadIndex - start);
+    CountMetric("profiler.dropped", mDropped - dropped);
+  }
+
+  /// Identifier of the function that contains the address.
+  uint32_t GetSymbol(void* aAddress)
+  {
+    auto it = mAddresses.find(aAddress);
+    if (it != mAddresses.end())
+      return it->second;
+
+    std::string name;
+    Dl_info info;
+
+    if (dladdr(aAddress, &info) && info.dli_sname) {
+      int status;
+      char* text = abi::__cxa_demangle(info.dli_sname, nullptr, 0, &status);
+      name = (status == 0) ? text : info.dli_sname;
+      free(text);
+    } else if (info.dli_fname) {
+      // Functions with internal linkage are not exported.
+      const char* slash = strrchr(info.dli_fname, '/');
+      name = '[';
+      name += slash ? slash + 1 : info.dli_fname;
+      name += ']';
+    } else {
+      name = "[unknown]";
+    }
+
+    // Semicolons separate the frames in the output.
+    std::replace(name.begin(), name.end(), ';', ':');
+
+    auto [found, inserted] = mSymbols.emplace(name, mNames.size());
+    if (inserted)
+      mNames.push_back(std::move(name));
+
+    // The cache is only bounded by the size of the code.
+    if (mAddresses.size() < MaxAddresses)
+      mAddresses.emplace(aAddress, found->second);
+    return found->second;
+  }
+
+  /// Replace the output file with everything collected so far.
+  void Write()
+  {
+    std::vector<std::string> threads;
+    {
+      std::unique_lock<std::mutex> lock(gThreadMutex);
+      for (const ThreadEntry& elem : gThreads)
+        threads.push_back(elem.Name);
+    }
+
+    std::string temporary = mPath + ".tmp";
+    FILE* output = fopen(temporary.c_str(), "w");
+    if (!output) {
+      SDL_LogWarn(0, "Cannot write %s: %s", mPath.c_str(), strerror(errno));
+      return;
+    }
+
+    for (const auto& [key, count] : mStacks) {
+      int thread;
+      memcpy(&thread, key.data(), sizeof(thread));
+      size_t depth = (key.size() - sizeof(thread)) / sizeof(uint32_t);
+
+      std::string line = threads[thread];
+      if (depth == 0)
+        line += ";[other]";
+
+      // The output starts with the outermost frame.
+      for (size_t i = depth; i-- > 0;) {
+        uint32_t symbol;
+        memcpy(&symbol, &key[sizeof(thread) + i * sizeof(symbol)], 4);
+        line += ';';
+        line += mNames[symbol];
+      }
+
+      fprintf(output,
+              "%s %llu\n",
+              line.c_str(),
+              static_cast<unsigned long long>(count));
+    }
+
+    if (mDropped != 0)
+      fprintf(output,
+              "[dropped] %llu\n",
+              static_cast<unsigned long long>(mDropped));
+
+    fclose(output);
+    rename(temporary.c_str(), mPath.c_str());
+  }
+};
+
+Collector* gCollector = nullptr;
+
+void
+OnToggleSignal(int)
+{
+  if (gCollector)
+    gCollector->Toggle();
+}
+
+}
+
+void
+StartProfiler(std::string aPath)
+{
+  assert(gCollector);
+  gCollector->Start(std::move(aPath));
+}
+
+void
+StopProfiler()
+{
+  assert(gCollector);
+  gCollector->Stop();
+}
+
+void
+InitProfiler()
+{
+  assert(!gCollector);
+
+  // The first call loads the unwinder which is not signal-safe.
+  void* frames[1];
+  backtrace(frames, 1);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = OnSampleSignal;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, nullptr);
+
+  gCollector = new Collector;
+  signal(SIGUSR2, OnToggleSignal);
+}
+
+void
+FreeProfiler()
+{
+  assert(gCollector);
+  signal(SIGUSR2, SIG_DFL);
+  delete gCollector;
+  gCollector = nullptr;
+}
+
+#else
+
+ProfilerScope::ProfilerScope(const char*) {}
+
+ProfilerScope::~ProfilerScope() = default;
+
+void
+StartProfiler(std::string)
+{
+  SDL_LogWarn(0, "The profiler is only available on Linux");
+}
+
+void
+StopProfiler()
+{}
+
+void
+InitProfiler()
+{}
+
+void
+FreeProfiler()
+{}
+
+#endif
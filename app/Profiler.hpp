@@ -0,0 +1,40 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+/**
+ * \file
+ * \brief Sampling profiler that writes folded stacks for flame graphs.
+ */
+
+#include <string>
+
+/// Sample the calling thread while this object exists (Linux only).
+class ProfilerScope
+{
+public:
+  explicit ProfilerScope(const char* aName);
+  ProfilerScope(const ProfilerScope& aOther) = delete;
+  ProfilerScope& operator=(const ProfilerScope& aOther) = delete;
+  ~ProfilerScope();
+};
+
+/**
+ * \brief Start sampling every registered thread.
+ *
+ * The output is rewritten every few seconds so it is usable even if the
+ * process never exits cleanly.
+ */
+void
+StartProfiler(std::string aPath);
+/// Stop sampling and write the output.
+void
+StopProfiler();
+
+/// Install the signal handlers (SIGUSR2 toggles the profiler).
+void
+InitProfiler();
+/// Stop sampling and shut down the collector thread.
+void
+FreeProfiler();
+
+#endif
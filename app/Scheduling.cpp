@@ -0,0 +1,341 @@
+#include "Scheduling.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <SDL.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <sys/qos.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "Config.hpp"
+
+//===========================================================================//
+//=== Settings ==============================================================//
+//===========================================================================//
+
+namespace {
+
+struct Role
+{
+  const char* Name;
+  std::string Config::*Class;
+};
+
+/// Threads that are named after their profiler scope.
+const Role gRoles[] = {
+  { "main", &Config::MainThreadClass },
+  { "download", &Config::DownloadThreadClass },
+  { "worker", &Config::WorkerThreadClass },
+  { "disk", &Config::DiskThreadClass },
+};
+
+struct Profile
+{
+  ThreadClass Class;
+  const char* Name;
+  int64_t Config::*Nice;
+  std::string Config::*Cpus;
+  /// Utilization clamps on the 0-1024 scale (Linux 5.3+), or -1 for none.
+  int MinimumUtil;
+  int MaximumUtil;
+};
+
+/// Raising the minimum moves work to the big cores, lowering the maximum keeps
+/// it off them.
+const Profile gProfiles[] = {
+  { ThreadClass::Interactive,
+    "interactive",
+    &Config::InteractiveNice,
+    &Config::InteractiveCpus,
+    512,
+    -1 },
+  { ThreadClass::Utility,
+    "utility",
+    &Config::UtilityNice,
+    &Config::UtilityCpus,
+    -1,
+    -1 },
+  { ThreadClass::Background,
+    "background",
+    &Config::BackgroundNice,
+    &Config::BackgroundCpus,
+    -1,
+    256 },
+};
+
+const Profile*
+FindProfile(const std::string& aName)
+{
+  for (const Profile& elem : gProfiles)
+    if (aName == elem.Name)
+      return &elem;
+
+  return nullptr;
+}
+
+/// Parse a list such as `0-3,6`; empty means any CPU.
+std::optional<std::vector<int>>
+ParseCpus(const std::string& aText)
+{
+  std::vector<int> result;
+  const char* pos = aText.c_str();
+
+  while (*pos) {
+    char* end;
+    long first = std::strtol(pos, &end, 10);
+    long last = first;
+    if (end == pos)
+      return std::nullopt;
+
+    pos = end;
+    if (*pos == '-') {
+      last = std::strtol(pos + 1, &end, 10);
+      if (end == pos + 1)
+        return std::nullopt;
+      pos = end;
+    }
+
+    if (first < 0 || last < first || last >= 1024)
+      return std::nullopt;
+    for (long i = first; i <= last; ++i)
+      result.push_back(static_cast<int>(i));
+
+    if (*pos == ',')
+      pos += 1;
+    else if (*pos)
+      return std::nullopt;
+  }
+
+  return result;
+}
+
+}
+
+//===========================================================================//
+//=== Platforms =============================================================//
+//===========================================================================//
+
+namespace {
+
+#if defined(__linux__)
+
+/// Layout of `struct sched_attr` (not in every C library).
+struct SchedAttr
+{
+  uint32_t Size;
+  uint32_t Policy;
+  uint64_t Flags;
+  int32_t Nice;
+  uint32_t Priority;
+  uint64_t Runtime;
+  uint64_t Deadline;
+  uint64_t Period;
+  uint32_t MinimumUtil;
+  uint32_t MaximumUtil;
+};
+
+constexpr uint64_t UtilClampMinimum = 0x20;
+constexpr uint64_t UtilClampMaximum = 0x40;
+
+bool
+SetPriority(const std::string& aName, const Profile& aProfile, int aNice)
+{
+  SchedAttr attr = {};
+  attr.Size = sizeof(attr);
+  // Batch threads are assumed to be CPU-bound and are preempted less.
+  attr.Policy = (aProfile.Class == ThreadClass::Background) ? SCHED_BATCH
+                                                            : SCHED_OTHER;
+  attr.Nice = aNice;
+
+  if (aProfile.MinimumUtil >= 0) {
+    attr.Flags |= UtilClampMinimum;
+    attr.MinimumUtil = aProfile.MinimumUtil;
+  }
+
+  if (aProfile.MaximumUtil >= 0) {
+    attr.Flags |= UtilClampMaximum;
+    attr.MaximumUtil = aProfile.MaximumUtil;
+  }
+
+  if (syscall(SYS_sched_setattr, 0, &attr, 0) == 0)
+    return true;
+
+  // The kernel may not have been built with clamps, or it may not let an
+  // unprivileged thread raise its minimum. The rest still applies then.
+  if ((errno == EINVAL || errno == EOPNOTSUPP || errno == EPERM) &&
+      attr.Flags) {
+    attr.Flags = 0;
+    if (syscall(SYS_sched_setattr, 0, &attr, 0) == 0)
+      return true;
+  }
+
+  // Negative values need CAP_SYS_NICE or a raised RLIMIT_NICE.
+  SDL_LogWarn(0,
+              "Cannot set the priority of thread %s: %s",
+              aName.c_str(),
+              strerror(errno));
+  return false;
+}
+
+bool
+SetAffinity(const std::string& aName, const std::vector<int>& aCpus)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int elem : aCpus)
+    if (elem < CPU_SETSIZE)
+      CPU_SET(elem, &set);
+
+  int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (error == 0)
+    return true;
+
+  SDL_LogWarn(0,
+              "Cannot set the CPUs of thread %s: %s",
+              aName.c_str(),
+              strerror(error));
+  return false;
+}
+
+#elif defined(__APPLE__)
+
+bool
+SetPriority(const std::string& aName, const Profile& aProfile, int)
+{
+  qos_class_t value = QOS_CLASS_UTILITY;
+  if (aProfile.Class == ThreadClass::Interactive)
+    value = QOS_CLASS_USER_INTERACTIVE;
+  else if (aProfile.Class == ThreadClass::Background)
+    value = QOS_CLASS_BACKGROUND;
+
+  int error = pthread_set_qos_class_self_np(value, 0);
+  if (error == 0)
+    return true;
+
+  SDL_LogWarn(0,
+              "Cannot set the QoS class of thread %s: %s",
+              aName.c_str(),
+              strerror(error));
+  return false;
+}
+
+bool
+SetAffinity(const std::string& aName, const std::vector<int>&)
+{
+  // The scheduler picks the cores from the QoS class.
+  SDL_LogWarn(0, "CPU sets are not supported (thread %s)", aName.c_str());
+  return false;
+}
+
+#elif defined(_WIN32)
+
+bool
+SetPriority(const std::string& aName, const Profile& aProfile, int)
+{
+  int value = THREAD_PRIORITY_BELOW_NORMAL;
+  if (aProfile.Class == ThreadClass::Interactive)
+    value = THREAD_PRIORITY_ABOVE_NORMAL;
+  else if (aProfile.Class == ThreadClass::Background)
+    value = THREAD_PRIORITY_LOWEST;
+
+  if (SetThreadPriority(GetCurrentThread(), value))
+    return true;
+
+  SDL_LogWarn(0,
+              "Cannot set the priority of thread %s (error %lu)",
+              aName.c_str(),
+              GetLastError());
+  return false;
+}
+
+bool
+SetAffinity(const std::string& aName, const std::vector<int>& aCpus)
+{
+  DWORD_PTR mask = 0;
+  for (int elem : aCpus)
+    if (elem < int(sizeof(mask) * 8))
+      mask |= DWORD_PTR(1) << elem;
+
+  if (SetThreadAffinityMask(GetCurrentThread(), mask))
+    return true;
+
+  SDL_LogWarn(0,
+              "Cannot set the CPUs of thread %s (error %lu)",
+              aName.c_str(),
+              GetLastError());
+  return false;
+}
+
+#else
+
+bool
+SetPriority(const std::string&, const Profile&, int)
+{
+  return false;
+}
+
+bool
+SetAffinity(const std::string&, const std::vector<int>&)
+{
+  return false;
+}
+
+#endif
+
+}
+
+void
+ApplyThreadClass(const std::string& aName)
+{
+  std::shared_ptr<const Config> config = GetConfig();
+  const Role* role = nullptr;
+
+  for (const Role& elem : gRoles)
+    if (aName == elem.Name)
+      role = &elem;
+
+  if (!role)
+    return;
+
+  const std::string& name = config.get()->*role->Class;
+  const Profile* profile = FindProfile(name);
+  if (!profile) {
+    SDL_LogWarn(
+      0, "Unknown thread class for %s: %s", aName.c_str(), name.c_str());
+    return;
+  }
+
+  const std::string& cpus = config.get()->*profile->Cpus;
+  std::optional<std::vector<int>> list = ParseCpus(cpus);
+  if (!list) {
+    SDL_LogWarn(0, "Not a CPU list: %s", cpus.c_str());
+    list.emplace();
+  }
+
+  int nice = static_cast<int>(config.get()->*profile->Nice);
+  bool done = SetPriority(aName, *profile, nice);
+  if (!list->empty())
+    done = SetAffinity(aName, list.value()) && done;
+
+  if (done)
+    SDL_Log("Thread %s: %s (nice %d, CPUs %s)",
+            aName.c_str(),
+            profile->Name,
+            nice,
+            list->empty() ? "any" : cpus.c_str());
+}
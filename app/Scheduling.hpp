@@ -0,0 +1,34 @@
+#ifndef SCHEDULING_HPP
+#define SCHEDULING_HPP
+
+/**
+ * \file
+ * \brief Priority classes and CPU sets for the pipeline threads.
+ */
+
+#include <string>
+
+/// Coarse priority of a thread (mapped to what the platform offers).
+enum class ThreadClass
+{
+  /// Work that a frame waits for (the main loop).
+  Interactive,
+  /// Work that the user is waiting for (transfers and decoding).
+  Utility,
+  /// Work that nobody waits for (cache files).
+  Background,
+};
+
+/**
+ * \brief Move the calling thread into the class that the configuration gives
+ * its name (`threads.<name>`).
+ *
+ * On Linux the class picks a niceness, a utilization clamp (if the kernel has
+ * them) and a CPU set such as `4-7`, so bulk work can be kept on the little
+ * cores. On macOS it picks a QoS class and on Windows a thread priority and
+ * affinity mask. Failures are logged and the thread keeps running as it was.
+ */
+void
+ApplyThreadClass(const std::string& aName);
+
+#endif
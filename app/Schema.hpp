@@ -0,0 +1,42 @@
+#ifndef SCHEMA_HPP
+#define SCHEMA_HPP
+
+/**
+ * \file
+ * \brief Validators generated at build time from the bundled JSON schemas.
+ */
+
+#include <string>
+#include <string_view>
+
+#include <rapidjson/document.h>
+#ifdef USE_SIMDJSON
+#include <simdjson.h>
+#endif
+
+/// Location and reason of the first validation error.
+struct SchemaError
+{
+  /// JSON pointer into the document (empty for the root).
+  std::string DocumentPointer;
+  /// Schema file and JSON pointer of the failing schema.
+  std::string SchemaPointer;
+  /// Keyword that rejected the document.
+  std::string Keyword;
+};
+
+/// Returns false and fills the error if the document is invalid.
+template<typename T>
+using SchemaFunction = bool (*)(const T& aDocument, SchemaError& aError);
+
+/**
+ * \brief Validator for the root of a schema file such as "schema-home.json".
+ *
+ * Available for \c rapidjson::Value and, with the simdjson backend, for
+ * \c simdjson::dom::element. Returns null for unknown files.
+ */
+template<typename T>
+SchemaFunction<T>
+FindSchemaFunction(std::string_view aName);
+
+#endif
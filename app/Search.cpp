@@ -0,0 +1,202 @@
+#include "Search.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//===========================================================================//
+//=== Grams =================================================================//
+//===========================================================================//
+
+namespace {
+
+/// Longest gram stored in the index.
+constexpr size_t GramLength = 3;
+
+std::string
+FoldText(std::string_view aText)
+{
+  std::string result(aText);
+
+  // Only fold ASCII so multi-byte sequences are left intact.
+  for (char& elem : result)
+    if (elem >= 'A' && elem <= 'Z')
+      elem = elem - 'A' + 'a';
+
+  return result;
+}
+
+/// Pack the gram length and its bytes into a single key.
+uint32_t
+PackGram(std::string_view aText, size_t aStart, size_t aLength)
+{
+  uint32_t result = static_cast<uint32_t>(aLength) << 24;
+
+  for (size_t i = 0; i < aLength; ++i) {
+    auto byte = static_cast<unsigned char>(aText[aStart + i]);
+    result |= static_cast<uint32_t>(byte) << (8 * (2 - i));
+  }
+
+  return result;
+}
+
+/// Every distinct gram up to the maximum length (sorted).
+std::vector<uint32_t>
+SplitGrams(std::string_view aText)
+{
+  std::vector<uint32_t> result;
+
+  for (size_t n = 1; n <= GramLength; ++n)
+    for (size_t i = 0; i + n <= aText.size(); ++i)
+      result.push_back(PackGram(aText, i, n));
+
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+  return result;
+}
+
+}
+
+//===========================================================================//
+//=== SearchIndex ===========================================================//
+//===========================================================================//
+
+class SearchIndex::Private
+{
+  struct Entry
+  {
+    /// Folded title used for the final substring check.
+    std::string Text;
+    /// Copy of the tile so results can be shown directly.
+    ApiFuzzyTile Tile;
+  };
+
+  /// Titles in insertion order; the position is the document number.
+  std::vector<Entry> mEntries;
+  /// Attributes of each document so results can still be filtered.
+  ApiTileTable mAttributes;
+  /// Used to skip titles that appear in more than one set.
+  std::unordered_map<std::string, uint32_t> mLookup;
+  /// Document numbers containing each gram (always sorted).
+  std::unordered_map<uint32_t, std::vector<uint32_t>> mPostings;
+
+public:
+  Private() = default;
+  Private(const Private& aOther) = delete;
+  Private& operator=(const Private& aOther) = delete;
+
+  size_t GetCount() const { return mEntries.size(); }
+
+  void Insert(const ApiFuzzySet& aModel, size_t aIndex)
+  {
+    const ApiFuzzyTile& tile = aModel.Tiles[aIndex];
+    if (!Insert(tile))
+      return;
+
+    if (aIndex < aModel.Attributes.GetCount())
+      mAttributes.Append(aModel.Attributes, aIndex);
+    else
+      mAttributes.AppendEmpty();
+  }
+
+  ApiFuzzySet Search(std::string_view aQuery, size_t aLimit) const
+  {
+    ApiFuzzySet result;
+    std::string query = FoldText(aQuery);
+
+    if (query.empty() || aLimit == 0)
+      return result;
+
+    // Longer queries only need the longest grams.
+    size_t length = std::min(query.size(), GramLength);
+    std::vector<const std::vector<uint32_t>*> lists;
+
+    for (size_t i = 0; i + length <= query.size(); ++i) {
+      auto it = mPostings.find(PackGram(query, i, length));
+
+      if (it == mPostings.end())
+        return result;
+      else
+        lists.push_back(&it->second);
+    }
+
+    // Drive the intersection from the most selective gram.
+    std::sort(lists.begin(), lists.end(), [](auto a, auto b) {
+      return a->size() < b->size();
+    });
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+    for (uint32_t id : *lists.front()) {
+      bool match = std::all_of(lists.begin() + 1, lists.end(), [&](auto list) {
+        return std::binary_search(list->begin(), list->end(), id);
+      });
+
+      // The grams might appear in a different order.
+      if (match && mEntries[id].Text.find(query) != std::string::npos) {
+        result.Tiles.push_back(mEntries[id].Tile);
+        result.Attributes.Append(mAttributes, id);
+        if (result.Tiles.size() == aLimit)
+          break;
+      }
+    }
+
+    return result;
+  }
+
+private:
+  bool Insert(const ApiFuzzyTile& aTile)
+  {
+    const std::string& title = aTile.Text.FullTitle;
+
+    if (title.empty())
+      return false;
+    else if (mLookup.count(title) != 0)
+      return false;
+
+    auto id = static_cast<uint32_t>(mEntries.size());
+    mLookup.emplace(title, id);
+    mEntries.push_back({ FoldText(title), aTile });
+
+    // Document numbers only grow so the lists stay sorted.
+    for (uint32_t gram : SplitGrams(mEntries.back().Text))
+      mPostings[gram].push_back(id);
+
+    return true;
+  }
+};
+
+SearchIndex::SearchIndex()
+  : mPrivate(new Private)
+{}
+
+SearchIndex::~SearchIndex() = default;
+
+size_t
+SearchIndex::GetCount() const
+{
+  return mPrivate->GetCount();
+}
+
+void
+SearchIndex::Insert(const ApiFuzzySet& aModel)
+{
+  for (size_t i = 0; i < aModel.Tiles.size(); ++i)
+    mPrivate->Insert(aModel, i);
+}
+
+void
+SearchIndex::Insert(const ApiHome& aModel)
+{
+  for (const auto& container : aModel.Containers)
+    if (auto set = std::get_if<ApiFuzzySet>(&container))
+      Insert(*set);
+}
+
+ApiFuzzySet
+SearchIndex::Search(std::string_view aQuery, size_t aLimit) const
+{
+  return mPrivate->Search(aQuery, aLimit);
+}
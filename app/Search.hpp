@@ -0,0 +1,47 @@
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+/**
+ * \file
+ * \brief Incremental title search over the loaded models.
+ */
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+#include "Json.hpp"
+
+/**
+ * \brief N-gram index over the titles of every tile seen so far.
+ *
+ * Every distinct title is broken into its 1-, 2- and 3-grams (ASCII letters
+ * are folded to lower case) and each gram keeps a sorted list of the titles
+ * that contain it. Queries intersect the shortest lists and only confirm the
+ * survivors with a substring search, so the cost depends on how selective the
+ * query is rather than on the size of the catalog.
+ */
+class SearchIndex
+{
+  class Private;
+  std::unique_ptr<Private> mPrivate;
+
+public:
+  SearchIndex();
+  SearchIndex(const SearchIndex& aOther) = delete;
+  SearchIndex& operator=(const SearchIndex& aOther) = delete;
+  ~SearchIndex();
+
+  /// Number of distinct titles in the index.
+  size_t GetCount() const;
+
+  /// Add every tile in the set; titles already present are skipped.
+  void Insert(const ApiFuzzySet& aModel);
+  /// Add every set that is provided up-front by the home screen.
+  void Insert(const ApiHome& aModel);
+
+  /// Case-insensitive substring match, in the order titles were inserted.
+  ApiFuzzySet Search(std::string_view aQuery, size_t aLimit) const;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "Table.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+//===========================================================================//
+//=== ApiTileTable ==========================================================//
+//===========================================================================//
+
+void
+ApiTileTable::Append(const ApiTileTable& aOther, size_t aRow)
+{
+  assert(aRow < aOther.GetCount());
+  Types.push_back(aOther.Types[aRow]);
+  Kids.push_back(aOther.Kids[aRow]);
+  Regions.push_back(aOther.Regions[aRow]);
+  Years.push_back(aOther.Years[aRow]);
+  Originals.push_back(aOther.Originals[aRow]);
+}
+
+void
+ApiTileTable::AppendEmpty()
+{
+  Types.push_back(Other);
+  Kids.push_back(KidsUnknown);
+  Regions.push_back(0);
+  Years.push_back(0);
+  Originals.push_back(0);
+}
+
+uint16_t
+PackRegion(std::string_view aCode)
+{
+  if (aCode.size() != 2)
+    return 0;
+
+  auto hi = static_cast<unsigned char>(aCode[0]);
+  auto lo = static_cast<unsigned char>(aCode[1]);
+  return static_cast<uint16_t>(hi << 8 | lo);
+}
+
+//===========================================================================//
+//=== Operators =============================================================//
+//===========================================================================//
+
+void
+FilterTiles(const ApiTileTable& aTable,
+            const ApiTileFilter& aFilter,
+            std::vector<uint8_t>& aMask)
+{
+  const size_t count = aTable.GetCount();
+  aMask.assign(count, 1);
+
+  // Each pass is branch-free so the compiler can vectorize it.
+  {
+    const uint8_t* types = aTable.Types.data();
+    const unsigned mask = aFilter.TypeMask;
+    for (size_t i = 0; i < count; ++i)
+      aMask[i] &= (mask >> types[i]) & 1u;
+  }
+
+  if (aFilter.KidsOnly) {
+    const uint8_t* kids = aTable.Kids.data();
+    for (size_t i = 0; i < count; ++i)
+      aMask[i] &= kids[i] == ApiTileTable::KidsIncluded;
+  }
+
+  if (aFilter.OriginalsOnly) {
+    const uint8_t* originals = aTable.Originals.data();
+    for (size_t i = 0; i < count; ++i)
+      aMask[i] &= originals[i] != 0;
+  }
+
+  if (aFilter.Region != 0) {
+    const uint16_t* regions = aTable.Regions.data();
+    const uint16_t region = aFilter.Region;
+    for (size_t i = 0; i < count; ++i)
+      aMask[i] &= regions[i] == region;
+  }
+}
+
+void
+SortTiles(const ApiTileTable& aTable,
+          const std::vector<uint8_t>& aMask,
+          ApiTileOrder aOrder,
+          std::vector<uint32_t>& aResult)
+{
+  assert(aMask.size() == aTable.GetCount());
+  aResult.clear();
+
+  if (aOrder == ApiTileOrder::Original) {
+    for (size_t i = 0; i < aMask.size(); ++i)
+      if (aMask[i])
+        aResult.push_back(static_cast<uint32_t>(i));
+    return;
+  }
+
+  // Sort on plain integers with the row number in the low bits.
+  // This keeps the sort stable and avoids indirect comparisons.
+  std::vector<uint64_t> keys;
+  keys.reserve(aMask.size());
+
+  for (size_t i = 0; i < aMask.size(); ++i) {
+    if (!aMask[i])
+      continue;
+
+    uint64_t year = aTable.Years[i];
+    if (aOrder == ApiTileOrder::Newest)
+      year = UINT16_MAX - year;
+
+    keys.push_back(year << 32 | i);
+  }
+
+  std::sort(keys.begin(), keys.end());
+
+  for (uint64_t key : keys)
+    aResult.push_back(static_cast<uint32_t>(key & UINT32_MAX));
+}
@@ -0,0 +1,95 @@
+#ifndef TABLE_HPP
+#define TABLE_HPP
+
+/**
+ * \file
+ * \brief Columnar tile attributes with filter and sort operators.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * \brief Attributes of a sequence of tiles stored one column per field.
+ *
+ * The parser fills one row per tile next to the tile itself. Every column
+ * holds small integers so the operators below run as tight loops over
+ * contiguous memory and never touch the (much larger) tile structures.
+ */
+struct ApiTileTable
+{
+  /// Coarse content type from the "type" field.
+  enum Type : uint8_t
+  {
+    Other,
+    Series,
+    Video,
+    Collection,
+  };
+
+  /// Tri-state because the web API sometimes reports null.
+  enum KidsMode : uint8_t
+  {
+    KidsUnknown,
+    KidsExcluded,
+    KidsIncluded,
+  };
+
+  std::vector<uint8_t> Types;
+  std::vector<uint8_t> Kids;
+  /// Two-letter region code packed into 16 bits (zero if unknown).
+  std::vector<uint16_t> Regions;
+  /// Year of the first release (zero if unknown).
+  std::vector<uint16_t> Years;
+  /// Non-zero for Disney+ originals.
+  std::vector<uint8_t> Originals;
+
+  size_t GetCount() const { return Types.size(); }
+
+  /// Copy a single row from another table to the end of this one.
+  void Append(const ApiTileTable& aOther, size_t aRow);
+  /// Add an empty row with every attribute unknown.
+  void AppendEmpty();
+};
+
+/// Pack a two-letter region code (anything else becomes zero).
+uint16_t
+PackRegion(std::string_view aCode);
+
+/// Rows must match every criterion to pass.
+struct ApiTileFilter
+{
+  /// One bit for each accepted \ref ApiTileTable::Type.
+  unsigned TypeMask = ~0u;
+  /// Only keep tiles that are known to be available in kids mode.
+  bool KidsOnly = false;
+  /// Only keep Disney+ originals.
+  bool OriginalsOnly = false;
+  /// Packed region code; zero accepts every region.
+  uint16_t Region = 0;
+};
+
+/// Sequence in which the surviving rows are returned.
+enum class ApiTileOrder
+{
+  Original,
+  Newest,
+  Oldest,
+};
+
+/// Write one byte per row: one if it passes and zero otherwise.
+void
+FilterTiles(const ApiTileTable& aTable,
+            const ApiTileFilter& aFilter,
+            std::vector<uint8_t>& aMask);
+
+/// Write the indices of the rows that pass the mask in the requested order.
+void
+SortTiles(const ApiTileTable& aTable,
+          const std::vector<uint8_t>& aMask,
+          ApiTileOrder aOrder,
+          std::vector<uint32_t>& aResult);
+
+#endif
@@ -0,0 +1,583 @@
+#include "Trace.hpp"
+
+#include <SDL.h>
+
+#ifdef TRACE_GL
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "Metrics.hpp"
+
+//===========================================================================//
+//=== State =================================================================//
+//===========================================================================//
+
+namespace {
+
+/// Every wrapped entry point (same order as \ref gCalls).
+enum class Call
+{
+  Begin,
+  BindTexture,
+  BlendFunc,
+  Clear,
+  ClearColor,
+  ClearStencil,
+  Color4f,
+  Color4fv,
+  ColorMask,
+  DeleteTextures,
+  Disable,
+  Enable,
+  End,
+  GenTextures,
+  GetFloatv,
+  GetIntegerv,
+  LoadIdentity,
+  MatrixMode,
+  PopAttrib,
+  PopMatrix,
+  PushAttrib,
+  PushMatrix,
+  Scalef,
+  StencilFunc,
+  StencilOp,
+  TexCoord2f,
+  TexCoord2fv,
+  TexEnvi,
+  TexImage2D,
+  TexParameteri,
+  Translatef,
+  Vertex2f,
+  Vertex3fv,
+  Viewport,
+  Count,
+};
+
+struct CallInfo
+{
+  const char* Name;
+  /// Whether the call sets a value that can be compared with the previous.
+  bool State;
+};
+
+const CallInfo gCalls[] = {
+  { "glBegin", false },         { "glBindTexture", true },
+  { "glBlendFunc", true },      { "glClear", false },
+  { "glClearColor", true },     { "glClearStencil", true },
+  { "glColor4f", false },       { "glColor4fv", false },
+  { "glColorMask", true },      { "glDeleteTextures", false },
+  { "glDisable", true },        { "glEnable", true },
+  { "glEnd", false },           { "glGenTextures", false },
+  { "glGetFloatv", false },     { "glGetIntegerv", false },
+  { "glLoadIdentity", false },  { "glMatrixMode", true },
+  { "glPopAttrib", false },     { "glPopMatrix", false },
+  { "glPushAttrib", false },    { "glPushMatrix", false },
+  { "glScalef", false },        { "glStencilFunc", true },
+  { "glStencilOp", true },      { "glTexCoord2f", false },
+  { "glTexCoord2fv", false },   { "glTexEnvi", true },
+  { "glTexImage2D", false },    { "glTexParameteri", false },
+  { "glTranslatef", false },    { "glVertex2f", false },
+  { "glVertex3fv", false },     { "glViewport", false },
+};
+
+constexpr size_t CallCount = static_cast<size_t>(Call::Count);
+static_assert(sizeof(gCalls) / sizeof(gCalls[0]) == CallCount);
+
+/// What the wrappers know about the context (missing means unknown).
+struct Shadow
+{
+  std::map<GLenum, bool> Enabled;
+  std::map<GLenum, GLuint> Textures;
+  std::map<std::pair<GLenum, GLenum>, GLint> TexEnv;
+  std::optional<std::tuple<GLenum, GLenum>> BlendFunc;
+  std::optional<std::tuple<GLfloat, GLfloat, GLfloat, GLfloat>> ClearColor;
+  std::optional<GLint> ClearStencil;
+  std::optional<std::tuple<GLboolean, GLboolean, GLboolean, GLboolean>>
+    ColorMask;
+  std::optional<GLenum> MatrixMode;
+  std::optional<std::tuple<GLenum, GLint, GLuint>> StencilFunc;
+  std::optional<std::tuple<GLenum, GLenum, GLenum>> StencilOp;
+};
+
+struct Frame
+{
+  uint64_t Calls[CallCount] = {};
+  uint64_t Redundant[CallCount] = {};
+};
+
+Shadow gShadow;
+/// Mirrors the attribute stack of the context.
+std::vector<std::pair<GLbitfield, Shadow>> gSaved;
+Frame gFrame;
+uint64_t gFrameNumber = 0;
+std::ofstream gOutput;
+
+void
+Count(Call aCall, bool aRedundant = false)
+{
+  auto index = static_cast<size_t>(aCall);
+  gFrame.Calls[index] += 1;
+  if (aRedundant)
+    gFrame.Redundant[index] += 1;
+}
+
+/// Store the new value and tell whether it was already current.
+template<typename T, typename U>
+bool
+Update(std::optional<T>& aSlot, U&& aValue)
+{
+  bool same = aSlot && *aSlot == aValue;
+  aSlot = std::forward<U>(aValue);
+  return same;
+}
+
+template<typename K, typename T>
+bool
+Update(std::map<K, T>& aSlots, const K& aKey, const T& aValue)
+{
+  auto [iter, added] = aSlots.emplace(aKey, aValue);
+  if (added)
+    return false;
+
+  bool same = iter->second == aValue;
+  iter->second = aValue;
+  return same;
+}
+
+void
+RestoreCapability(const Shadow& aSaved, GLenum aCapability)
+{
+  auto iter = aSaved.Enabled.find(aCapability);
+  if (iter == aSaved.Enabled.end())
+    gShadow.Enabled.erase(aCapability);
+  else
+    gShadow.Enabled[aCapability] = iter->second;
+}
+
+/// Only restore the groups that the attribute mask covers.
+void
+RestoreShadow(GLbitfield aMask, const Shadow& aSaved)
+{
+  if (aMask & GL_ENABLE_BIT) {
+    gShadow.Enabled = aSaved.Enabled;
+  } else {
+    if (aMask & GL_COLOR_BUFFER_BIT)
+      RestoreCapability(aSaved, GL_BLEND);
+    if (aMask & GL_DEPTH_BUFFER_BIT)
+      RestoreCapability(aSaved, GL_DEPTH_TEST);
+    if (aMask & GL_STENCIL_BUFFER_BIT)
+      RestoreCapability(aSaved, GL_STENCIL_TEST);
+  }
+
+  if (aMask & GL_COLOR_BUFFER_BIT) {
+    gShadow.BlendFunc = aSaved.BlendFunc;
+    gShadow.ClearColor = aSaved.ClearColor;
+    gShadow.ColorMask = aSaved.ColorMask;
+  }
+
+  if (aMask & GL_STENCIL_BUFFER_BIT) {
+    gShadow.ClearStencil = aSaved.ClearStencil;
+    gShadow.StencilFunc = aSaved.StencilFunc;
+    gShadow.StencilOp = aSaved.StencilOp;
+  }
+
+  if (aMask & GL_TEXTURE_BIT) {
+    gShadow.Textures = aSaved.Textures;
+    gShadow.TexEnv = aSaved.TexEnv;
+  }
+
+  if (aMask & GL_TRANSFORM_BIT)
+    gShadow.MatrixMode = aSaved.MatrixMode;
+}
+
+void
+SetCapability(GLenum aCapability, bool aEnabled)
+{
+  bool same = Update(gShadow.Enabled, aCapability, aEnabled);
+  Count(aEnabled ? Call::Enable : Call::Disable, same);
+}
+
+}
+
+//===========================================================================//
+//=== Wrappers ==============================================================//
+//===========================================================================//
+
+// The names are in parentheses to skip the macros from the header.
+
+void
+TraceBegin(GLenum aMode)
+{
+  Count(Call::Begin);
+  (glBegin)(aMode);
+}
+
+void
+TraceBindTexture(GLenum aTarget, GLuint aTexture)
+{
+  Count(Call::BindTexture, Update(gShadow.Textures, aTarget, aTexture));
+  (glBindTexture)(aTarget, aTexture);
+}
+
+void
+TraceBlendFunc(GLenum aSource, GLenum aDestination)
+{
+  auto value = std::make_tuple(aSource, aDestination);
+  Count(Call::BlendFunc, Update(gShadow.BlendFunc, value));
+  (glBlendFunc)(aSource, aDestination);
+}
+
+void
+TraceClear(GLbitfield aMask)
+{
+  Count(Call::Clear);
+  (glClear)(aMask);
+}
+
+void
+TraceClearColor(GLfloat aRed, GLfloat aGreen, GLfloat aBlue, GLfloat aAlpha)
+{
+  auto value = std::make_tuple(aRed, aGreen, aBlue, aAlpha);
+  Count(Call::ClearColor, Update(gShadow.ClearColor, value));
+  (glClearColor)(aRed, aGreen, aBlue, aAlpha);
+}
+
+void
+TraceClearStencil(GLint aValue)
+{
+  Count(Call::ClearStencil, Update(gShadow.ClearStencil, aValue));
+  (glClearStencil)(aValue);
+}
+
+void
+TraceColor4f(GLfloat aRed, GLfloat aGreen, GLfloat aBlue, GLfloat aAlpha)
+{
+  Count(Call::Color4f);
+  (glColor4f)(aRed, aGreen, aBlue, aAlpha);
+}
+
+void
+TraceColor4fv(const GLfloat* aValue)
+{
+  Count(Call::Color4fv);
+  (glColor4fv)(aValue);
+}
+
+void
+TraceColorMask(GLboolean aRed,
+               GLboolean aGreen,
+               GLboolean aBlue,
+               GLboolean aAlpha)
+{
+  auto value = std::make_tuple(aRed, aGreen, aBlue, aAlpha);
+  Count(Call::ColorMask, Update(gShadow.ColorMask, value));
+  (glColorMask)(aRed, aGreen, aBlue, aAlpha);
+}
+
+void
+TraceDeleteTextures(GLsizei aCount, const GLuint* aTextures)
+{
+  Count(Call::DeleteTextures);
+
+  // Deleting a bound texture reverts the binding to zero.
+  for (GLsizei i = 0; i < aCount; ++i)
+    for (auto& [target, texture] : gShadow.Textures)
+      if (texture == aTextures[i])
+        texture = 0;
+
+  (glDeleteTextures)(aCount, aTextures);
+}
+
+void
+TraceDisable(GLenum aCapability)
+{
+  SetCapability(aCapability, false);
+  (glDisable)(aCapability);
+}
+
+void
+TraceEnable(GLenum aCapability)
+{
+  SetCapability(aCapability, true);
+  (glEnable)(aCapability);
+}
+
+void
+TraceEnd()
+{
+  Count(Call::End);
+  (glEnd)();
+}
+
+void
+TraceGenTextures(GLsizei aCount, GLuint* aTextures)
+{
+  Count(Call::GenTextures);
+  (glGenTextures)(aCount, aTextures);
+}
+
+void
+TraceGetFloatv(GLenum aName, GLfloat* aValue)
+{
+  Count(Call::GetFloatv);
+  (glGetFloatv)(aName, aValue);
+}
+
+void
+TraceGetIntegerv(GLenum aName, GLint* aValue)
+{
+  Count(Call::GetIntegerv);
+  (glGetIntegerv)(aName, aValue);
+
+  // Queries are free information for the shadow state.
+  if (aName == GL_TEXTURE_BINDING_2D)
+    gShadow.Textures[GL_TEXTURE_2D] = *aValue;
+  else if (aName == GL_MATRIX_MODE)
+    gShadow.MatrixMode = *aValue;
+}
+
+void
+TraceLoadIdentity()
+{
+  Count(Call::LoadIdentity);
+  (glLoadIdentity)();
+}
+
+void
+TraceMatrixMode(GLenum aMode)
+{
+  Count(Call::MatrixMode, Update(gShadow.MatrixMode, aMode));
+  (glMatrixMode)(aMode);
+}
+
+void
+TracePopAttrib()
+{
+  Count(Call::PopAttrib);
+
+  if (!gSaved.empty()) {
+    RestoreShadow(gSaved.back().first, gSaved.back().second);
+    gSaved.pop_back();
+  }
+
+  (glPopAttrib)();
+}
+
+void
+TracePopMatrix()
+{
+  Count(Call::PopMatrix);
+  (glPopMatrix)();
+}
+
+void
+TracePushAttrib(GLbitfield aMask)
+{
+  Count(Call::PushAttrib);
+  gSaved.emplace_back(aMask, gShadow);
+  (glPushAttrib)(aMask);
+}
+
+void
+TracePushMatrix()
+{
+  Count(Call::PushMatrix);
+  (glPushMatrix)();
+}
+
+void
+TraceScalef(GLfloat aX, GLfloat aY, GLfloat aZ)
+{
+  Count(Call::Scalef);
+  (glScalef)(aX, aY, aZ);
+}
+
+void
+TraceStencilFunc(GLenum aFunction, GLint aReference, GLuint aMask)
+{
+  auto value = std::make_tuple(aFunction, aReference, aMask);
+  Count(Call::StencilFunc, Update(gShadow.StencilFunc, value));
+  (glStencilFunc)(aFunction, aReference, aMask);
+}
+
+void
+TraceStencilOp(GLenum aFail, GLenum aDepthFail, GLenum aPass)
+{
+  auto value = std::make_tuple(aFail, aDepthFail, aPass);
+  Count(Call::StencilOp, Update(gShadow.StencilOp, value));
+  (glStencilOp)(aFail, aDepthFail, aPass);
+}
+
+void
+TraceTexCoord2f(GLfloat aS, GLfloat aT)
+{
+  Count(Call::TexCoord2f);
+  (glTexCoord2f)(aS, aT);
+}
+
+void
+TraceTexCoord2fv(const GLfloat* aValue)
+{
+  Count(Call::TexCoord2fv);
+  (glTexCoord2fv)(aValue);
+}
+
+void
+TraceTexEnvi(GLenum aTarget, GLenum aName, GLint aValue)
+{
+  auto key = std::make_pair(aTarget, aName);
+  Count(Call::TexEnvi, Update(gShadow.TexEnv, key, aValue));
+  (glTexEnvi)(aTarget, aName, aValue);
+}
+
+void
+TraceTexImage2D(GLenum aTarget,
+                GLint aLevel,
+                GLint aInternalFormat,
+                GLsizei aWidth,
+                GLsizei aHeight,
+                GLint aBorder,
+                GLenum aFormat,
+                GLenum aType,
+                const void* aPixels)
+{
+  Count(Call::TexImage2D);
+  (glTexImage2D)(aTarget,
+                 aLevel,
+                 aInternalFormat,
+                 aWidth,
+                 aHeight,
+                 aBorder,
+                 aFormat,
+                 aType,
+                 aPixels);
+}
+
+void
+TraceTexParameteri(GLenum aTarget, GLenum aName, GLint aValue)
+{
+  Count(Call::TexParameteri);
+  (glTexParameteri)(aTarget, aName, aValue);
+}
+
+void
+TraceTranslatef(GLfloat aX, GLfloat aY, GLfloat aZ)
+{
+  Count(Call::Translatef);
+  (glTranslatef)(aX, aY, aZ);
+}
+
+void
+TraceVertex2f(GLfloat aX, GLfloat aY)
+{
+  Count(Call::Vertex2f);
+  (glVertex2f)(aX, aY);
+}
+
+void
+TraceVertex3fv(const GLfloat* aValue)
+{
+  Count(Call::Vertex3fv);
+  (glVertex3fv)(aValue);
+}
+
+void
+TraceViewport(GLint aX, GLint aY, GLsizei aWidth, GLsizei aHeight)
+{
+  Count(Call::Viewport);
+  (glViewport)(aX, aY, aWidth, aHeight);
+}
+
+//===========================================================================//
+//=== Output ================================================================//
+//===========================================================================//
+
+void
+StartTrace(std::string aPath)
+{
+  gOutput.open(aPath, std::ios_base::trunc);
+  if (!gOutput) {
+    SDL_LogWarn(0, "Cannot write the GL trace to %s", aPath.c_str());
+    return;
+  }
+
+  gOutput << "frame,calls,draws,state,redundant";
+  for (const CallInfo& elem : gCalls)
+    gOutput << ',' << elem.Name;
+  for (const CallInfo& elem : gCalls)
+    if (elem.State)
+      gOutput << ',' << elem.Name << ".redundant";
+  gOutput << '\n';
+}
+
+void
+EndTraceFrame()
+{
+  uint64_t calls = 0;
+  uint64_t state = 0;
+  uint64_t redundant = 0;
+
+  for (size_t i = 0; i < CallCount; ++i) {
+    calls += gFrame.Calls[i];
+    redundant += gFrame.Redundant[i];
+    if (gCalls[i].State)
+      state += gFrame.Calls[i];
+
+    if (gFrame.Redundant[i] > 0)
+      CountMetric(std::string("gl.redundant.") + gCalls[i].Name,
+                  gFrame.Redundant[i]);
+  }
+
+  uint64_t draws = gFrame.Calls[static_cast<size_t>(Call::Begin)];
+  RecordMetric("gl.calls", calls);
+  RecordMetric("gl.draws", draws);
+  RecordMetric("gl.state", state);
+  RecordMetric("gl.redundant", redundant);
+
+  if (gOutput.is_open()) {
+    gOutput << gFrameNumber << ',' << calls << ',' << draws << ',' << state
+            << ',' << redundant;
+    for (size_t i = 0; i < CallCount; ++i)
+      gOutput << ',' << gFrame.Calls[i];
+    for (size_t i = 0; i < CallCount; ++i)
+      if (gCalls[i].State)
+        gOutput << ',' << gFrame.Redundant[i];
+    gOutput << '\n';
+  }
+
+  gFrameNumber += 1;
+  gFrame = Frame();
+}
+
+void
+FreeTrace()
+{
+  if (gOutput.is_open())
+    gOutput.close();
+}
+
+#else
+
+void
+StartTrace(std::string)
+{
+  SDL_LogWarn(0, "Configure with -DTRACE_GL=ON to trace OpenGL calls");
+}
+
+void
+EndTraceFrame()
+{}
+
+void
+FreeTrace()
+{}
+
+#endif
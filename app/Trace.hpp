@@ -0,0 +1,149 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+/**
+ * \file
+ * \brief OpenGL call accounting (configure with `-DTRACE_GL=ON`).
+ *
+ * Including this header after the GL headers routes the legacy GL calls of
+ * that file through counting wrappers. The wrappers keep a shadow copy of
+ * the state they touch so calls that set a value which is already current
+ * can be reported as redundant. Without the option the header only declares
+ * the frame functions, which do nothing.
+ */
+
+#include <string>
+
+#include <GL/glew.h>
+
+/// Write a summary line per frame to a CSV file (needs `TRACE_GL`).
+void
+StartTrace(std::string aPath);
+/// Account for every call made since the previous frame (main thread).
+void
+EndTraceFrame();
+/// Close the output file.
+void
+FreeTrace();
+
+#ifdef TRACE_GL
+
+void
+TraceBegin(GLenum aMode);
+void
+TraceBindTexture(GLenum aTarget, GLuint aTexture);
+void
+TraceBlendFunc(GLenum aSource, GLenum aDestination);
+void
+TraceClear(GLbitfield aMask);
+void
+TraceClearColor(GLfloat aRed, GLfloat aGreen, GLfloat aBlue, GLfloat aAlpha);
+void
+TraceClearStencil(GLint aValue);
+void
+TraceColor4f(GLfloat aRed, GLfloat aGreen, GLfloat aBlue, GLfloat aAlpha);
+void
+TraceColor4fv(const GLfloat* aValue);
+void
+TraceColorMask(GLboolean aRed,
+               GLboolean aGreen,
+               GLboolean aBlue,
+               GLboolean aAlpha);
+void
+TraceDeleteTextures(GLsizei aCount, const GLuint* aTextures);
+void
+TraceDisable(GLenum aCapability);
+void
+TraceEnable(GLenum aCapability);
+void
+TraceEnd();
+void
+TraceGenTextures(GLsizei aCount, GLuint* aTextures);
+void
+TraceGetFloatv(GLenum aName, GLfloat* aValue);
+void
+TraceGetIntegerv(GLenum aName, GLint* aValue);
+void
+TraceLoadIdentity();
+void
+TraceMatrixMode(GLenum aMode);
+void
+TracePopAttrib();
+void
+TracePopMatrix();
+void
+TracePushAttrib(GLbitfield aMask);
+void
+TracePushMatrix();
+void
+TraceScalef(GLfloat aX, GLfloat aY, GLfloat aZ);
+void
+TraceStencilFunc(GLenum aFunction, GLint aReference, GLuint aMask);
+void
+TraceStencilOp(GLenum aFail, GLenum aDepthFail, GLenum aPass);
+void
+TraceTexCoord2f(GLfloat aS, GLfloat aT);
+void
+TraceTexCoord2fv(const GLfloat* aValue);
+void
+TraceTexEnvi(GLenum aTarget, GLenum aName, GLint aValue);
+void
+TraceTexImage2D(GLenum aTarget,
+                GLint aLevel,
+                GLint aInternalFormat,
+                GLsizei aWidth,
+                GLsizei aHeight,
+                GLint aBorder,
+                GLenum aFormat,
+                GLenum aType,
+                const void* aPixels);
+void
+TraceTexParameteri(GLenum aTarget, GLenum aName, GLint aValue);
+void
+TraceTranslatef(GLfloat aX, GLfloat aY, GLfloat aZ);
+void
+TraceVertex2f(GLfloat aX, GLfloat aY);
+void
+TraceVertex3fv(const GLfloat* aValue);
+void
+TraceViewport(GLint aX, GLint aY, GLsizei aWidth, GLsizei aHeight);
+
+// Function-like so the implementation can still reach the real entry points.
+#define glBegin(...) TraceBegin(__VA_ARGS__)
+#define glBindTexture(...) TraceBindTexture(__VA_ARGS__)
+#define glBlendFunc(...) TraceBlendFunc(__VA_ARGS__)
+#define glClear(...) TraceClear(__VA_ARGS__)
+#define glClearColor(...) TraceClearColor(__VA_ARGS__)
+#define glClearStencil(...) TraceClearStencil(__VA_ARGS__)
+#define glColor4f(...) TraceColor4f(__VA_ARGS__)
+#define glColor4fv(...) TraceColor4fv(__VA_ARGS__)
+#define glColorMask(...) TraceColorMask(__VA_ARGS__)
+#define glDeleteTextures(...) TraceDeleteTextures(__VA_ARGS__)
+#define glDisable(...) TraceDisable(__VA_ARGS__)
+#define glEnable(...) TraceEnable(__VA_ARGS__)
+#define glEnd(...) TraceEnd(__VA_ARGS__)
+#define glGenTextures(...) TraceGenTextures(__VA_ARGS__)
+#define glGetFloatv(...) TraceGetFloatv(__VA_ARGS__)
+#define glGetIntegerv(...) TraceGetIntegerv(__VA_ARGS__)
+#define glLoadIdentity(...) TraceLoadIdentity(__VA_ARGS__)
+#define glMatrixMode(...) TraceMatrixMode(__VA_ARGS__)
+#define glPopAttrib(...) TracePopAttrib(__VA_ARGS__)
+#define glPopMatrix(...) TracePopMatrix(__VA_ARGS__)
+#define glPushAttrib(...) TracePushAttrib(__VA_ARGS__)
+#define glPushMatrix(...) TracePushMatrix(__VA_ARGS__)
+#define glScalef(...) TraceScalef(__VA_ARGS__)
+#define glStencilFunc(...) TraceStencilFunc(__VA_ARGS__)
+#define glStencilOp(...) TraceStencilOp(__VA_ARGS__)
+#define glTexCoord2f(...) TraceTexCoord2f(__VA_ARGS__)
+#define glTexCoord2fv(...) TraceTexCoord2fv(__VA_ARGS__)
+#define glTexEnvi(...) TraceTexEnvi(__VA_ARGS__)
+#define glTexImage2D(...) TraceTexImage2D(__VA_ARGS__)
+#define glTexParameteri(...) TraceTexParameteri(__VA_ARGS__)
+#define glTranslatef(...) TraceTranslatef(__VA_ARGS__)
+#define glVertex2f(...) TraceVertex2f(__VA_ARGS__)
+#define glVertex3fv(...) TraceVertex3fv(__VA_ARGS__)
+#define glViewport(...) TraceViewport(__VA_ARGS__)
+
+#endif
+
+#endif
@@ -6,6 +6,7 @@
 #include <functional>
 #include <optional>
 #include <sstream>
+#include <string>
 #include <type_traits>
 #include <utility>
 #include <variant>
@@ -14,8 +15,14 @@
 #include <GL/glew.h>
 #include <sigc++/sigc++.h>
 
+#include "Config.hpp"
 #include "Graphics.hpp"
 #include "Helper.hpp"
+#include "Metrics.hpp"
+#include "Network.hpp"
+#include "Pressure.hpp"
+#include "Search.hpp"
+#include "Trace.hpp"
 #include "Worker.hpp"
 
 namespace {
@@ -65,6 +72,8 @@ class TileWidget
   decltype(mModel.TileImages)::iterator mImageSelection;
   std::optional<AsyncImage> mImageQuery;
   sigc::connection mImageTrigger;
+  /// Last time the tile was drawn.
+  Uint32 mLastVisible;
 
 public:
   /// Emitted whenever the texture aspect ratio is altered.
@@ -75,8 +84,10 @@ public:
   explicit TileWidget(ApiFuzzyTile aModel)
     : mModel(std::move(aModel))
     , mImageSelection(mModel.TileImages.end())
+    , mLastVisible(0)
   {
     mRootNode.SetTexture(&mTexture);
+    mRootNode.Visited.connect([&]() { mLastVisible = SDL_GetTicks(); });
     RequestAspectRatio(1.0f);
   }
 
@@ -115,15 +126,8 @@ public:
       return;
 
     mImageSelection = it;
-    mImageTrigger.disconnect();
     mImageQuery.reset();
-
-    mImageTrigger = mRootNode.Visited.connect(
-      // Only download when this is not clipped out.
-      [&]() {
-        mImageTrigger.disconnect();
-        OnVisited();
-      });
+    ArmTrigger();
   }
 
   void SetDepth(float aNewValue)
@@ -132,7 +136,50 @@ public:
       vert.Location.z = aNewValue;
   }
 
+  /// Download the image before it becomes visible (true if started).
+  bool Warm()
+  {
+    if (!mImageTrigger.connected())
+      return false;
+
+    mImageTrigger.disconnect();
+    OnVisited();
+    return true;
+  }
+
+  /// Free what can be loaded again once the tile is visible.
+  void Shed(MemoryPressure aLevel, Uint32 aNow)
+  {
+    auto delay = static_cast<Uint32>(GetConfig()->ShedDelay);
+    if (!SDL_TICKS_PASSED(aNow, mLastVisible + delay))
+      return;
+
+    // The decoded image would only be uploaded to an unseen texture.
+    if (mImageQuery) {
+      mImageQuery.reset();
+      ArmTrigger();
+      CountMetric("viewer.shed.images");
+    }
+
+    if (aLevel >= MemoryPressure::Medium && mTexture.GetWidth() != 0) {
+      mTexture.Unload();
+      ArmTrigger();
+      CountMetric("viewer.shed.textures");
+    }
+  }
+
 private:
+  void ArmTrigger()
+  {
+    mImageTrigger.disconnect();
+    mImageTrigger = mRootNode.Visited.connect(
+      // Only download when this is not clipped out.
+      [&]() {
+        mImageTrigger.disconnect();
+        OnVisited();
+      });
+  }
+
   void OnVisited()
   {
     if (mImageSelection == mModel.TileImages.end())
@@ -159,9 +206,6 @@ private:
   }
 };
 
-constexpr float Margin = 0.025;
-constexpr float Spacing = 0.015;
-
 class RowWidget
 {
   ApiSetRef mRefModel;
@@ -171,16 +215,44 @@ class RowWidget
 
   std::optional<AsyncQuery> mQuery;
   sigc::connection mQueryTrigger;
+  /// Kept to decode the row again after it was shed.
+  std::optional<ApiLazySet> mLazyModel;
+  /// Last time the row was drawn.
+  Uint32 mLastVisible;
+  /// Reloads after shedding must not add to the search index again.
+  size_t mIndexedCount;
+
+  /// Download of the next page (see \ref ApiFuzzySet::PageSize).
+  std::optional<AsyncQuery> mPageQuery;
+  std::string mSetId;
+  size_t mTotalCount;
+  size_t mPageSize;
+  /// Position of the next page within the whole set.
+  size_t mNextOffset;
 
   float mWindowStart;
   float mRequestedAspectRatio;
   std::optional<int> mSelection;
   std::vector<std::unique_ptr<TileWidget>> mTiles;
 
+  /// Attributes of each tile (same order as the tiles).
+  ApiTileTable mAttributes;
+  /// Cleared for tiles whose image failed to download.
+  std::vector<uint8_t> mUsable;
+  /// Tiles that survived the filter in display order.
+  std::vector<TileWidget*> mShown;
+  ApiTileFilter mFilter;
+  ApiTileOrder mOrder;
+
 public:
+  /// Emitted when a referenced set is downloaded and parsed.
+  mutable sigc::signal<void(const ApiFuzzySet&)> Loaded;
+
   explicit RowWidget(ApiFuzzySet aModel)
     : RowWidget()
   {
+    // The home screen is in the search index already.
+    mIndexedCount = aModel.PageOffset + aModel.Tiles.size();
     OnQueryFinished(std::move(aModel));
   }
 
@@ -198,28 +270,42 @@ public:
       });
   }
 
+  explicit RowWidget(ApiLazySet aModel)
+    : RowWidget()
+  {
+    mLazyModel = std::move(aModel);
+
+    mQueryTrigger = mRootNode.Visited.connect(
+      // Only decode when this is not clipped out.
+      [&]() {
+        mQueryTrigger.disconnect();
+        OnVisited();
+      });
+  }
+
   const RenderNode& GetNode() const { return mRootNode; }
   RenderNode& GetNode() { return mRootNode; }
-  decltype(mTiles)::size_type GetCount() const { return mTiles.size(); }
+  decltype(mShown)::size_type GetCount() const { return mShown.size(); }
 
   void Layout(const SDL_FRect& aBounds)
   {
     mBounds = aBounds;
+    float spacing = GetConfig()->Spacing;
     float x = 0.0f;
     float y = 0.0f;
     float h = aBounds.h;
 
     // Text nodes choose their own width.
     mTitle.Layout({ x, y, 0, 0.03f });
-    y += 0.03f + Spacing;
-    h -= 0.03f + Spacing;
+    y += 0.03f + spacing;
+    h -= 0.03f + spacing;
 
-    for (auto it = mTiles.begin(); it != mTiles.end(); ++it) {
-      float ratio = it->get()->GetImageAspectRatio();
+    for (auto it = mShown.begin(); it != mShown.end(); ++it) {
+      float ratio = (*it)->GetImageAspectRatio();
       SDL_FRect bounds{ x, y, h * ratio, h };
-      x += bounds.w + Spacing;
+      x += bounds.w + spacing;
 
-      if (mSelection && it - mTiles.begin() == mSelection.value()) {
+      if (mSelection && it - mShown.begin() == mSelection.value()) {
         // Slide the window so this tile is always visible.
         if (bounds.x + bounds.w > mWindowStart + aBounds.w)
           mWindowStart = bounds.x + bounds.w - aBounds.w;
@@ -236,13 +322,13 @@ public:
         bounds.h *= coeff;
 
         // Hack for depth testing.
-        it->get()->SetDepth(-1.0f);
+        (*it)->SetDepth(-1.0f);
       } else {
         // Hack for depth testing.
-        it->get()->SetDepth(+0.0f);
+        (*it)->SetDepth(+0.0f);
       }
 
-      it->get()->Layout(bounds);
+      (*it)->Layout(bounds);
     }
 
     mRootNode.SetTranslate({ aBounds.x - mWindowStart, aBounds.y });
@@ -260,58 +346,354 @@ public:
     if (mSelection != aNewValue) {
       mSelection = aNewValue;
       Layout(mBounds);
+      LoadNextPage();
+    }
+  }
+
+  /// Hide and reorder tiles without re-creating them.
+  void SetFilter(const ApiTileFilter& aFilter, ApiTileOrder aOrder)
+  {
+    mFilter = aFilter;
+    mOrder = aOrder;
+    Refresh();
+  }
+
+  /// Load the set and the first few images early (false when done).
+  bool Warm(size_t aTileCount)
+  {
+    if (mQueryTrigger.connected()) {
+      mQueryTrigger.disconnect();
+      OnVisited();
+      return true;
     }
+
+    // The tiles do not exist until the set is decoded.
+    if (mQuery)
+      return true;
+
+    bool started = false;
+    for (size_t i = 0; i < std::min(aTileCount, mShown.size()); ++i)
+      started |= mShown[i]->Warm();
+    return started;
+  }
+
+  /// Free what can be rebuilt once the row is visible again.
+  void Shed(MemoryPressure aLevel, Uint32 aNow)
+  {
+    auto delay = static_cast<Uint32>(GetConfig()->ShedDelay);
+    bool hidden = SDL_TICKS_PASSED(aNow, mLastVisible + delay);
+    bool reload = mLazyModel || !mRefModel.ReferenceId.empty();
+
+    if (aLevel >= MemoryPressure::Critical && hidden && reload &&
+        !mTiles.empty()) {
+      Unload();
+      return;
+    }
+
+    for (std::unique_ptr<TileWidget>& tile : mTiles)
+      tile->Shed(aLevel, aNow);
   }
 
 private:
   RowWidget()
-    : mWindowStart(0.0f)
+    : mLastVisible(0)
+    , mIndexedCount(0)
+    , mTotalCount(0)
+    , mPageSize(0)
+    , mNextOffset(0)
+    , mWindowStart(0.0f)
+    , mOrder(ApiTileOrder::Original)
   {
     mRootNode.AddChild(mTitle.GetNode());
+    mRootNode.Visited.connect([&]() { mLastVisible = SDL_GetTicks(); });
+  }
+
+  /// Drop the tiles and the model until the row scrolls back into view.
+  void Unload()
+  {
+    for (TileWidget* tile : mShown)
+      mRootNode.RemoveChild(tile->GetNode());
+
+    mShown.clear();
+    mTiles.clear();
+    mAttributes = ApiTileTable();
+    mUsable.clear();
+
+    // The first page comes back with the row.
+    mPageQuery.reset();
+    mTotalCount = 0;
+    mPageSize = 0;
+    mNextOffset = 0;
+
+    mQueryTrigger = mRootNode.Visited.connect(
+      // The source is either on the network or in the home screen.
+      [&]() {
+        mQueryTrigger.disconnect();
+        OnVisited();
+      });
+
+    Layout(mBounds);
+    CountMetric("viewer.shed.rows");
   }
 
+  /// Add the tiles of a page after the ones that are already there.
   void OnQueryFinished(ApiFuzzySet aModel)
   {
-    mTitle.SetText(aModel.Text.FullTitle.c_str());
+    size_t first = mTiles.size();
+    if (first == 0)
+      mTitle.SetText(aModel.Text.FullTitle.c_str());
+
+    // Sets that did not come from the parser have no attributes.
+    for (size_t i = 0; i < aModel.Tiles.size(); ++i)
+      if (i < aModel.Attributes.GetCount())
+        mAttributes.Append(aModel.Attributes, i);
+      else
+        mAttributes.AppendEmpty();
+
+    if (!aModel.SetId.empty())
+      mSetId = std::move(aModel.SetId);
+
+    mTotalCount = aModel.TotalCount;
+    mPageSize = aModel.PageSize;
+    mNextOffset = aModel.PageOffset + aModel.Tiles.size();
 
     for (ApiFuzzyTile& ent : aModel.Tiles) {
+      size_t index = mTiles.size();
       mTiles.emplace_back(new TileWidget(std::move(ent)));
-      mRootNode.AddChild(mTiles.back()->GetNode());
       mTiles.back()->RequestAspectRatio(mRequestedAspectRatio);
       mTiles.back()->AspectRatioChanged.connect(
         [&](float) { Layout(mBounds); });
-      mTiles.back()->Failed.connect([&, ptr = mTiles.back().get()]() {
-        for (auto it = mTiles.begin(); it != mTiles.end(); ++it)
-          if (it->get() == ptr) {
-            mRootNode.RemoveChild(ptr->GetNode());
-            mTiles.erase(it);
-            Layout(mBounds);
-          }
+      mTiles.back()->Failed.connect([&, index]() {
+        mUsable[index] = 0;
+        Refresh();
       });
     }
 
+    mUsable.resize(mTiles.size(), 1);
+    Extend(first);
+  }
+
+  /// Show the tiles from the given index on without touching the others.
+  void Extend(size_t aFirst)
+  {
+    // Sorted rows may have to put the new tiles anywhere.
+    if (aFirst == 0 || mOrder != ApiTileOrder::Original) {
+      Refresh();
+      return;
+    }
+
+    std::vector<uint8_t> mask;
+    FilterTiles(mAttributes, mFilter, mask);
+
+    for (size_t i = aFirst; i < mTiles.size(); ++i)
+      if (mask[i] && mUsable[i]) {
+        mShown.push_back(mTiles[i].get());
+        mRootNode.AddChild(mShown.back()->GetNode());
+      }
+
+    Layout(mBounds);
+  }
+
+  void Refresh()
+  {
+    std::vector<uint8_t> mask;
+    std::vector<uint32_t> order;
+    FilterTiles(mAttributes, mFilter, mask);
+
+    for (size_t i = 0; i < mTiles.size(); ++i)
+      mask[i] &= mUsable[i];
+
+    SortTiles(mAttributes, mask, mOrder, order);
+
+    for (TileWidget* tile : mShown)
+      mRootNode.RemoveChild(tile->GetNode());
+
+    mShown.clear();
+
+    for (uint32_t index : order) {
+      mShown.push_back(mTiles[index].get());
+      mRootNode.AddChild(mShown.back()->GetNode());
+    }
+
     Layout(mBounds);
   }
 
   void OnVisited()
   {
-    std::ostringstream oss;
-    oss << "https://cd-static.bamgrid.com/dp-117731241344/sets";
-    oss << '/' << mRefModel.ReferenceId << ".json";
+    // Lazy rows already hold their data.
+    AsyncQuery::Mode mode = AsyncQuery::LazyRow;
+
+    if (mLazyModel) {
+      mQuery.emplace(mLazyModel.value());
+    } else {
+      std::ostringstream oss;
+      oss << GetConfig()->BaseLink << "/sets";
+      oss << '/' << mRefModel.ReferenceId << ".json";
 
-    mQuery.emplace(oss.str());
+      mQuery.emplace(oss.str());
+      mode = AsyncQuery::Dereference;
+    }
 
     mQuery->Failed.connect(
       //
-      [&](std::string aMessage) { SDL_LogWarn(0, "%s", aMessage.c_str()); });
+      [&](std::string aMessage) {
+        SDL_LogWarn(0, "%s", aMessage.c_str());
+        mQuery.reset();
+      });
     mQuery->Finished.connect(
       //
       [&](std::shared_ptr<AsyncQuery::ResultType> aResult) {
-        OnQueryFinished(std::move(std::get<ApiFuzzySet>(*aResult)));
+        OnPageFinished(std::move(std::get<ApiFuzzySet>(*aResult)));
         mQuery.reset();
       });
 
-    mQuery->Enqueue(AsyncQuery::Dereference);
+    mQuery->Enqueue(mode);
+  }
+
+  void OnPageFinished(ApiFuzzySet aModel)
+  {
+    size_t end = aModel.PageOffset + aModel.Tiles.size();
+    if (end > mIndexedCount) {
+      Loaded(aModel);
+      mIndexedCount = end;
+    }
+
+    OnQueryFinished(std::move(aModel));
+  }
+
+  /// Download the next page once the selection gets close to the end.
+  void LoadNextPage()
+  {
+    const std::string& id = mSetId.empty() ? mRefModel.ReferenceId : mSetId;
+    if (mPageQuery || mQuery || !mSelection || id.empty())
+      return;
+    if (mPageSize == 0 || mNextOffset >= mTotalCount)
+      return;
+
+    auto ahead = static_cast<size_t>(GetConfig()->PageAhead);
+    if (mSelection.value() + ahead < mShown.size())
+      return;
+
+    std::ostringstream oss;
+    oss << GetConfig()->BaseLink << "/sets";
+    oss << '/' << id << ".json";
+    oss << "?offset=" << mNextOffset << "&page_size=" << mPageSize;
+
+    std::string link = oss.str();
+    size_t offset = mNextOffset;
+    mPageQuery.emplace(link);
+    mPageQuery->Failed.connect(
+      // Try again when the selection moves.
+      [&](std::string aMessage) {
+        SDL_LogWarn(0, "%s", aMessage.c_str());
+        mPageQuery.reset();
+      });
+    mPageQuery->Finished.connect(
+      //
+      [&, link, offset](std::shared_ptr<AsyncQuery::ResultType> aResult) {
+        ApiFuzzySet& model = std::get<ApiFuzzySet>(*aResult);
+        mPageQuery.reset();
+
+        // Servers that ignore the query would repeat the first page forever.
+        if (model.PageOffset != offset || model.Tiles.empty()) {
+          SDL_LogWarn(0, "Not the page that was asked for: %s", link.c_str());
+          mPageSize = 0;
+          return;
+        }
+
+        CountMetric("viewer.pages");
+        OnPageFinished(std::move(model));
+        // The new tiles might all be filtered out.
+        LoadNextPage();
+      });
+
+    mPageQuery->Enqueue(AsyncQuery::Dereference);
+  }
+};
+
+/**
+ * \brief Load the rest of the home screen while nothing else is happening.
+ *
+ * A step only starts after a quiet period without input and once every
+ * download and decode has finished (including the previous step), so anything
+ * the user asks for always comes first. The pause after each step grows with
+ * its duration and the walk stops for good when the byte budget is spent.
+ * Memory pressure pauses it until none has been reported for a while.
+ */
+class IdleWarmer
+{
+  Uint32 mLastInput;
+  Uint32 mNextStep;
+  /// Start of the step that is still running.
+  std::optional<Uint32> mStepStart;
+  int64_t mStepBytes;
+  int64_t mSpentBytes;
+  /// End of the pause after memory pressure.
+  Uint32 mResumeAt;
+
+public:
+  IdleWarmer()
+    : mLastInput(0)
+    , mNextStep(0)
+    , mStepBytes(0)
+    , mSpentBytes(0)
+    , mResumeAt(0)
+  {}
+
+  void NotifyInput() { mLastInput = SDL_GetTicks(); }
+  /// Do not load ahead until `viewer.warm_resume_delay` from now.
+  void Pause()
+  {
+    auto delay = static_cast<Uint32>(GetConfig()->WarmResumeDelay);
+    mResumeAt = SDL_GetTicks() + delay;
+  }
+
+  /// Call every frame; the step returns false when there is nothing to do.
+  void Update(const std::function<bool()>& aStep)
+  {
+    // A reload can raise the budget again.
+    std::shared_ptr<const Config> config = GetConfig();
+    auto idleDelay = static_cast<Uint32>(config->WarmIdleDelay);
+    auto share = static_cast<float>(config->WarmTimeShare);
+
+    if (mSpentBytes >= config->WarmByteBudget)
+      return;
+    if (GetPendingDownloads() != 0 || GetPendingTasks() != 0)
+      return;
+
+    Uint32 now = SDL_GetTicks();
+    int64_t bytes = GetCounter("network.bytes");
+
+    if (mStepStart) {
+      // Foreground transfers in the meantime are charged as well.
+      Uint32 elapsed = now - mStepStart.value();
+      mSpentBytes += bytes - mStepBytes;
+      float pause = elapsed * (1.0f - share) / share;
+      mNextStep = now + static_cast<Uint32>(pause);
+      mStepStart.reset();
+      RecordMetric("viewer.warm.step", elapsed);
+
+      if (mSpentBytes >= config->WarmByteBudget) {
+        SDL_Log("Stopped loading ahead after %lld bytes",
+                static_cast<long long>(mSpentBytes));
+        CountMetric("viewer.warm.done");
+        return;
+      }
+    }
+
+    if (!SDL_TICKS_PASSED(now, mLastInput + idleDelay) ||
+        !SDL_TICKS_PASSED(now, mNextStep) || !SDL_TICKS_PASSED(now, mResumeAt))
+      return;
+
+    if (aStep()) {
+      mStepStart = now;
+      mStepBytes = bytes;
+      CountMetric("viewer.warm.steps");
+    } else {
+      // More rows might show up later.
+      mNextStep = now + idleDelay;
+      CountMetric("viewer.warm.done");
+    }
   }
 };
 
@@ -331,9 +713,26 @@ class HomeWidget
   std::vector<int> mSelectColumn;
   std::vector<std::unique_ptr<RowWidget>> mRows;
 
+  /// Every title loaded so far, both inline and referenced sets.
+  SearchIndex mSearch;
+  std::string mSearchText;
+  /// Whether the first row holds the search results.
+  bool mSearchRow;
+
+  /// Applied to every row including the search results.
+  ApiTileFilter mFilter;
+  ApiTileOrder mOrder;
+
+  IdleWarmer mWarmer;
+  /// Next row to load ahead (not counting the search results).
+  size_t mWarmCursor;
+
 public:
   HomeWidget()
     : mWindowStart(0.0f)
+    , mSearchRow(false)
+    , mOrder(ApiTileOrder::Original)
+    , mWarmCursor(0)
   {
     mRootNode.AddChild(mContentClip);
     mRootNode.AddChild(mTitle.GetNode());
@@ -341,17 +740,22 @@ public:
     mTitle.SetText("Loading...");
 
     // Download the home screen and deal with it later.
-    mQuery.emplace("https://cd-static.bamgrid.com/dp-117731241344/home.json");
+    std::shared_ptr<const Config> config = GetConfig();
+    mQuery.emplace(config->BaseLink + "/home.json");
     mQuery->Failed.connect(
       // Print error to the console and ignore.
       [](std::string aMessage) { SDL_LogWarn(0, "%s", aMessage.c_str()); });
+    mQuery->Progress.connect(
+      // Rows are added while the rest is still downloading.
+      [&](auto ptr) { OnQueryProgress(std::move(std::get<ApiHome>(*ptr))); });
     mQuery->Finished.connect(
-      // Populate the interface when the model data is ready.
+      // Only the title is left when the model data is ready.
       [&](auto ptr) {
         OnQueryFinished(std::move(std::get<ApiHome>(*ptr)));
         mQuery.reset();
       });
-    mQuery->Enqueue(AsyncQuery::Home);
+    mQuery->Enqueue(config->LazyRows ? AsyncQuery::LazyHome
+                                     : AsyncQuery::ProgressiveHome);
   }
 
   const RenderNode& GetNode() const { return mRootNode; }
@@ -359,9 +763,61 @@ public:
 
   void Event(const SDL_KeyboardEvent& aEvent)
   {
+    mWarmer.NotifyInput();
+
     if (aEvent.type != SDL_KEYDOWN)
       return;
-    else if (mRows.empty())
+
+    if (!mSearchText.empty()) {
+      if (aEvent.keysym.sym == SDLK_BACKSPACE) {
+        // Remove the whole UTF-8 sequence of the last character.
+        while (!mSearchText.empty()) {
+          char last = mSearchText.back();
+          mSearchText.pop_back();
+          if ((last & 0xC0) != 0x80)
+            break;
+        }
+
+        OnSearchChanged();
+        return;
+      } else if (aEvent.keysym.sym == SDLK_ESCAPE) {
+        mSearchText.clear();
+        OnSearchChanged();
+        return;
+      }
+    }
+
+    switch (aEvent.keysym.sym) {
+      case SDLK_F1:
+        mFilter.KidsOnly = !mFilter.KidsOnly;
+        OnFilterChanged();
+        return;
+      case SDLK_F2:
+        // Cycle through everything, series only and videos only.
+        if (mFilter.TypeMask == 1u << ApiTileTable::Series)
+          mFilter.TypeMask = 1u << ApiTileTable::Video;
+        else if (mFilter.TypeMask == 1u << ApiTileTable::Video)
+          mFilter.TypeMask = ~0u;
+        else
+          mFilter.TypeMask = 1u << ApiTileTable::Series;
+        OnFilterChanged();
+        return;
+      case SDLK_F3:
+        mFilter.OriginalsOnly = !mFilter.OriginalsOnly;
+        OnFilterChanged();
+        return;
+      case SDLK_F4:
+        if (mOrder == ApiTileOrder::Original)
+          mOrder = ApiTileOrder::Newest;
+        else if (mOrder == ApiTileOrder::Newest)
+          mOrder = ApiTileOrder::Oldest;
+        else
+          mOrder = ApiTileOrder::Original;
+        OnFilterChanged();
+        return;
+    }
+
+    if (mRows.empty())
       return;
 
     if (mSelectRow) {
@@ -405,19 +861,29 @@ public:
     }
   }
 
+  void Event(const SDL_TextInputEvent& aEvent)
+  {
+    mWarmer.NotifyInput();
+    mSearchText += aEvent.text;
+    OnSearchChanged();
+  }
+
   // TODO: rows only require re-layout when tiles change
   void Layout(const SDL_FRect& aBounds)
   {
     mBounds = aBounds;
-    float x = Margin;
-    float y = Margin;
-    float w = aBounds.w - Margin - Margin;
-    float h = aBounds.h - Margin - Margin;
+    std::shared_ptr<const Config> config = GetConfig();
+    float margin = config->Margin;
+    float spacing = config->Spacing;
+    float x = margin;
+    float y = margin;
+    float w = aBounds.w - margin - margin;
+    float h = aBounds.h - margin - margin;
 
     // Text nodes choose their own width.
     mTitle.Layout({ x, y, 0, 0.05f });
-    y += 0.05f + Spacing;
-    h -= 0.05f + Spacing;
+    y += 0.05f + spacing;
+    h -= 0.05f + spacing;
 
     mContentClip.SetTranslate({ x, y });
     {
@@ -427,8 +893,8 @@ public:
     }
     x = 0.0f; // move inside of the clip node
     y = 0.0f; // move inside of the clip node
-    w -= Spacing + Spacing;
-    h -= Spacing + Spacing;
+    w -= spacing + spacing;
+    h -= spacing + spacing;
 
     //
     for (auto it = mRows.begin(); it != mRows.end(); ++it) {
@@ -444,16 +910,57 @@ public:
           mWindowStart = bounds.y;
       }
 
-      y += bounds.h + Spacing;
+      y += bounds.h + spacing;
     }
 
     mRootNode.SetTranslate({ 0.0f, -mWindowStart });
   }
 
+  void Update()
+  {
+    MemoryPressure level = TakeMemoryPressure();
+    if (level != MemoryPressure::None)
+      Shed(level);
+
+    // Rows are still arriving until the home screen is done.
+    if (!mQuery)
+      mWarmer.Update([&]() { return WarmStep(); });
+  }
+
 private:
+  /// Give memory back; everything is rebuilt once it is visible again.
+  void Shed(MemoryPressure aLevel)
+  {
+    // Loading ahead now would only undo the work.
+    mWarmer.Pause();
+
+    Uint32 now = SDL_GetTicks();
+    for (std::unique_ptr<RowWidget>& row : mRows)
+      row->Shed(aLevel, now);
+  }
+
+  /// Load the next row that is not ready yet.
+  bool WarmStep()
+  {
+    size_t first = mSearchRow ? 1 : 0;
+    auto count = static_cast<size_t>(GetConfig()->WarmTileCount);
+
+    for (; first + mWarmCursor < mRows.size(); ++mWarmCursor)
+      if (mRows[first + mWarmCursor]->Warm(count))
+        return true;
+
+    return false;
+  }
+
   void OnQueryFinished(ApiHome aModel)
   {
     mTitle.SetText(aModel.Text.FullTitle.c_str());
+    OnQueryProgress(std::move(aModel));
+  }
+
+  void OnQueryProgress(ApiHome aModel)
+  {
+    mSearch.Insert(aModel);
 
     for (auto& variant : aModel.Containers) {
       std::visit(
@@ -464,13 +971,63 @@ private:
         std::move(variant));
 
       mContentNode.AddChild(mRows.back()->GetNode());
+      mRows.back()->SetFilter(mFilter, mOrder);
+      mRows.back()->Loaded.connect(
+        // Referenced sets arrive much later than the home screen.
+        [&](const ApiFuzzySet& aSet) { mSearch.Insert(aSet); });
     }
 
-    mSelectRow.reset();
     mSelectColumn.resize(mRows.size(), 0);
 
     Layout(mBounds);
   }
+
+  void OnFilterChanged()
+  {
+    for (size_t i = 0; i < mRows.size(); ++i) {
+      mRows[i]->SetFilter(mFilter, mOrder);
+
+      // Keep the remembered column inside the shorter row.
+      int max = static_cast<int>(mRows[i]->GetCount());
+      mSelectColumn[i] = std::clamp(mSelectColumn[i], 0, std::max(max - 1, 0));
+    }
+
+    if (mSelectRow) {
+      int row = mSelectRow.value();
+      mRows[row]->Select(mSelectColumn[row]);
+    }
+
+    Layout(mBounds);
+  }
+
+  void OnSearchChanged()
+  {
+    // Row indices shift when the results come and go.
+    if (mSelectRow)
+      mRows[mSelectRow.value()]->Select(std::nullopt);
+    mSelectRow.reset();
+
+    if (mSearchRow) {
+      mContentNode.RemoveChild(mRows.front()->GetNode());
+      mRows.erase(mRows.begin());
+      mSelectColumn.erase(mSelectColumn.begin());
+      mSearchRow = false;
+    }
+
+    if (!mSearchText.empty()) {
+      auto limit = static_cast<size_t>(GetConfig()->SearchLimit);
+      ApiFuzzySet model = mSearch.Search(mSearchText, limit);
+      model.Text.FullTitle = "Search: " + mSearchText;
+
+      mRows.emplace(mRows.begin(), new RowWidget(std::move(model)));
+      mContentNode.AddChild(mRows.front()->GetNode());
+      mRows.front()->SetFilter(mFilter, mOrder);
+      mSelectColumn.insert(mSelectColumn.begin(), 0);
+      mSearchRow = true;
+    }
+
+    Layout(mBounds);
+  }
 };
 
 }
@@ -481,9 +1038,12 @@ class Viewer::Private
 
   float mViewportWidth;
   float mViewportHeight;
+  /// Settings used for the current layout.
+  std::shared_ptr<const Config> mConfig;
 
 public:
   Private()
+    : mConfig(GetConfig())
   {
     GLint viewport[4];
     glGetIntegerv(GL_VIEWPORT, viewport);
@@ -495,6 +1055,14 @@ public:
 
   void DrawFrame()
   {
+    // Margins and spacing may have been reloaded.
+    std::shared_ptr<const Config> config = GetConfig();
+    if (config != mConfig) {
+      mConfig = config;
+      OnResize(static_cast<int>(mViewportWidth),
+               static_cast<int>(mViewportHeight));
+    }
+
     glClearStencil(0);
     glClearColor(0.f, 0.f, 0.f, 1.f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -517,6 +1085,7 @@ public:
         glScalef(1.0f, aspect, 1.0f);
     }
 
+    mHome.Update();
     Render(mHome.GetNode(), false);
   }
 
@@ -527,6 +1096,9 @@ public:
       case SDL_KEYUP:
         mHome.Event(aEvent.key);
         break;
+      case SDL_TEXTINPUT:
+        mHome.Event(aEvent.text);
+        break;
       case SDL_WINDOWEVENT:
         Event(aEvent.window);
         break;
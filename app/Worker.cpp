@@ -1,20 +1,29 @@
 #include "Worker.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <condition_variable>
 #include <exception>
+#include <functional>
+#include <future>
 #include <list>
 #include <mutex>
 #include <optional>
-#include <queue>
+#include <string>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include <SDL_image.h>
 
+#include "Config.hpp"
 #include "Helper.hpp"
 #include "Main.hpp"
+#include "Metrics.hpp"
 #include "Network.hpp"
+#include "Profiler.hpp"
+#include "Scheduling.hpp"
 
 //===========================================================================//
 //=== Thread ================================================================//
@@ -22,21 +31,33 @@
 
 namespace {
 
+/**
+ * \brief Decoder threads that take their jobs from two queues.
+ *
+ * A progressive parse blocks until its download is done, while the rows it
+ * hands out queue more decodes. Those parses get a thread of their own so
+ * the decoders keep going.
+ */
 class WorkerThread
 {
   /// Whether the main loop for the thread should exit.
   bool mRunning;
-  /// All downloads and i/o will happen on this thread.
-  std::thread mThread;
+  std::vector<std::thread> mThreads;
+  /// Threads that have not left their main loop yet.
+  std::atomic<size_t> mAlive;
+  /// Set once every main loop has finished its last job.
+  std::promise<void> mExited;
   /// Synchronize access to the transfer queue.
-  std::mutex mMutex;
-  /// Allow the thread to wait for more inputs.
-  std::condition_variable mCondition;
+  MeteredMutex mMutex;
+  /// Jobs that are queued or running.
+  std::atomic<size_t> mPending;
 
 public:
   struct ImageTask
   {
     std::shared_ptr<std::istream> File;
+    /// Runs the signals on the thread of the requester.
+    Executor Runner;
     sigc::signal<void(std::string)> Failed;
     sigc::signal<void(std::shared_ptr<SDL_Surface>)> Finished;
   };
@@ -45,63 +66,144 @@ public:
   {
     AsyncQuery::Mode Mode;
     std::shared_ptr<std::istream> File;
+    /// Only used to decode lazy rows.
+    ApiLazySet Row;
+    /// Runs the signals on the thread of the requester.
+    Executor Runner;
     sigc::signal<void(std::string)> Failed;
     sigc::signal<void(AsyncQuery::ResultType)> Finished;
+    sigc::signal<void(AsyncQuery::ResultType)> Progress;
   };
 
 private:
   using ImageTaskRef = std::unique_ptr<ImageTask>;
   using QueryTaskRef = std::unique_ptr<QueryTask>;
+  using Job = std::variant<ImageTaskRef, QueryTaskRef>;
 
-  /// Sequence of image files to be decoded.
-  std::queue<std::variant<ImageTaskRef, QueryTaskRef>> mQueue;
+  /// Jobs for some of the threads.
+  struct Lane
+  {
+    MeteredQueue<Job> Queue;
+    /// Allow the threads to wait for more inputs.
+    std::condition_variable_any Condition;
+
+    explicit Lane(const std::string& aName)
+      : Queue(aName)
+    {}
+  };
+
+  /// Sequence of files to be decoded.
+  Lane mDecodes;
+  /// Progressive parses (one at a time).
+  Lane mStreams;
 
 public:
-  WorkerThread()
+  explicit WorkerThread(size_t aCount)
     : mRunning(true)
+    , mAlive(aCount + 1)
+    , mMutex("lock.worker")
+    , mPending(0)
+    , mDecodes("queue.worker")
+    , mStreams("queue.stream")
   {
-    mThread = std::thread(std::bind(&WorkerThread::MainLoop, this));
+    for (size_t i = 0; i < aCount; ++i)
+      mThreads.emplace_back(
+        std::bind(&WorkerThread::MainLoop, this, std::ref(mDecodes)));
+
+    mThreads.emplace_back(
+      std::bind(&WorkerThread::MainLoop, this, std::ref(mStreams)));
   }
 
   WorkerThread(const WorkerThread& aOther) = delete;
   WorkerThread& operator=(const WorkerThread& aOther) = delete;
 
+  /// Only valid once \ref Stop succeeded.
   ~WorkerThread()
   {
-    mRunning = false;
-    mCondition.notify_all();
-    mThread.join();
+    for (std::thread& elem : mThreads)
+      assert(!elem.joinable());
   }
 
-  void Enqueue(decltype(mQueue)::value_type aTask)
+  /**
+   * \brief Drop the queued jobs and wait for the current ones to finish.
+   *
+   * Returns false if a thread is still busy at the deadline; they all keep
+   * running detached and this object must not be destroyed.
+   */
+  bool Stop(std::chrono::steady_clock::time_point aDeadline)
   {
-    std::unique_lock<std::mutex> lock(mMutex);
-    mQueue.emplace(std::move(aTask));
-    mCondition.notify_all();
+    std::future<void> exited = mExited.get_future();
+
+    // Setting this under the lock makes sure the thread sees it.
+    {
+      std::unique_lock<MeteredMutex> lock(mMutex);
+      mRunning = false;
+      CountMetric("worker.dropped",
+                  mDecodes.Queue.size() + mStreams.Queue.size());
+      mDecodes.Condition.notify_all();
+      mStreams.Condition.notify_all();
+    }
+
+    if (exited.wait_until(aDeadline) == std::future_status::timeout) {
+      for (std::thread& elem : mThreads)
+        elem.detach();
+      return false;
+    }
+
+    for (std::thread& elem : mThreads)
+      elem.join();
+    return true;
   }
 
+  void Enqueue(Job aTask)
+  {
+    auto query = std::get_if<QueryTaskRef>(&aTask);
+    bool stream = query && (*query)->Mode == AsyncQuery::ProgressiveHome;
+    Lane& lane = stream ? mStreams : mDecodes;
+
+    std::unique_lock<MeteredMutex> lock(mMutex);
+
+    // Nothing would ever complete the task.
+    if (!mRunning)
+      return;
+
+    lane.Queue.push(std::move(aTask));
+    mPending += 1;
+    lane.Condition.notify_one();
+  }
+
+  size_t GetPending() const { return mPending; }
+
 private:
-  void MainLoop()
+  void MainLoop(Lane& aLane)
   {
-    while (mRunning) {
-      std::optional<decltype(mQueue)::value_type> job;
+    ProfilerScope profile("worker");
+    ApplyThreadClass("worker");
+
+    while (true) {
+      std::optional<Job> job;
 
       // Grab the job from the top of the queue.
       // Hold the lock for the minimum amount of time.
       {
-        std::unique_lock<std::mutex> lock(mMutex);
-        if (mQueue.empty()) {
-          mCondition.wait(lock);
-        } else {
-          job.emplace(std::move(mQueue.front()));
-          mQueue.pop();
-        }
+        std::unique_lock<MeteredMutex> lock(mMutex);
+        if (!mRunning)
+          break;
+        else if (aLane.Queue.empty())
+          aLane.Condition.wait(lock);
+        else
+          job.emplace(aLane.Queue.pop());
       }
 
       // Process the job without holding the lock.
-      if (job)
+      if (job) {
         std::visit([&](auto&& obj) { Process(std::move(obj)); }, job.value());
+        mPending -= 1;
+      }
     }
+
+    if (--mAlive == 0)
+      mExited.set_value();
   }
 
   void Process(std::unique_ptr<ImageTask> aTask)
@@ -109,16 +211,15 @@ private:
     SDL_RWops* ops = CppToRW(*aTask->File);
     std::shared_ptr<SDL_Surface> result(IMG_Load_RW(ops, 1), SDL_FreeSurface);
 
+    // Owned by the functor so nothing leaks if it never runs.
+    std::shared_ptr<ImageTask> task = std::move(aTask);
+
     if (result) {
-      InvokeAsync([result, task = aTask.release()]() {
-        task->Finished(std::move(result));
-        delete task;
-      });
+      task->Runner([result, task]() { task->Finished(std::move(result)); });
     } else {
       std::string message = IMG_GetError();
-      InvokeAsync([message = std::move(message), task = aTask.release()]() {
+      task->Runner([message = std::move(message), task]() {
         task->Failed(std::move(message));
-        delete task;
       });
     }
   }
@@ -140,16 +241,43 @@ private:
       } catch (std::exception& ex) {
         error.emplace(ex.what());
       }
+    else if (aTask->Mode == AsyncQuery::LazyHome)
+      try {
+        result = ReadLazyApiHome(*aTask->File);
+      } catch (std::exception& ex) {
+        error.emplace(ex.what());
+      }
+    else if (aTask->Mode == AsyncQuery::LazyRow)
+      try {
+        result = ReadApiFuzzySet(aTask->Row);
+      } catch (std::exception& ex) {
+        error.emplace(ex.what());
+      }
+    else if (aTask->Mode == AsyncQuery::ProgressiveHome)
+      try {
+        // The events are delivered in order so the task outlives these.
+        result = ReadApiHome(*aTask->File, [task = aTask.get()](auto aRow) {
+          ApiHome partial;
+          partial.Containers.emplace_back(std::move(aRow));
+
+          task->Runner([partial = std::move(partial), task]() mutable {
+            task->Progress(std::move(partial));
+          });
+        });
+      } catch (std::exception& ex) {
+        error.emplace(ex.what());
+      }
+
+    // Owned by the functor so nothing leaks if it never runs.
+    std::shared_ptr<QueryTask> task = std::move(aTask);
 
     if (error)
-      InvokeAsync([error = std::move(error), task = aTask.release()] {
+      task->Runner([error = std::move(error), task] {
         task->Failed(std::move(error.value()));
-        delete task;
       });
     else
-      InvokeAsync([result = std::move(result), task = aTask.release()] {
+      task->Runner([result = std::move(result), task] {
         task->Finished(std::move(result));
-        delete task;
       });
   }
 };
@@ -170,16 +298,42 @@ void
 InitWorker()
 {
   assert(!gThread);
-  gThread = new WorkerThread;
+
+  auto count = static_cast<size_t>(GetConfig()->WorkerThreads);
+  if (count == 0)
+    count = std::max(std::thread::hardware_concurrency(), 1u);
+
+  // The loaders are set up on first use, which is not thread-safe.
+  IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG);
+
+  SDL_Log("Worker threads: %zu", count);
+  gThread = new WorkerThread(count);
 }
 
-void
-FreeWorker()
+size_t
+GetPendingTasks()
+{
+  assert(gThread);
+  return gThread->GetPending();
+}
+
+bool
+FreeWorker(std::chrono::steady_clock::time_point aDeadline)
 {
   assert(gThread);
+
+  if (!gThread->Stop(aDeadline)) {
+    // The image libraries are still in use so they are leaked as well.
+    SDL_LogWarn(0, "Abandoning the worker thread");
+    CountMetric("exit.abandoned");
+    gThread = nullptr;
+    return false;
+  }
+
   delete gThread;
   gThread = nullptr;
   IMG_Quit();
+  return true;
 }
 
 //===========================================================================//
@@ -197,20 +351,25 @@ class AsyncImage::Private
   std::optional<std::string> mErrorMessage;
   /// Final data result if applicable.
   std::shared_ptr<SDL_Surface> mResult;
+  /// Where the signals are emitted.
+  Executor mExecutor;
 
 public:
   explicit Private(AsyncImage& aParent)
     : mParent(aParent)
+    , mExecutor(InvokeAsync)
   {}
 
   Private(AsyncImage& aParent, std::shared_ptr<std::istream> aData)
     : mParent(aParent)
     , mDataSource(std::move(aData))
+    , mExecutor(InvokeAsync)
   {}
 
   Private(AsyncImage& aParent, std::string aLink)
     : mParent(aParent)
     , mDataSource(std::in_place_type<AsyncDownload>)
+    , mExecutor(InvokeAsync)
   {
     std::get<AsyncDownload>(mDataSource).SetLink(std::move(aLink));
   }
@@ -256,6 +415,7 @@ public:
           OnDownloadFinished(std::move(aData));
         });
 
+      download.SetExecutor(mExecutor);
       download.Enqueue();
     } else if (mDataSource.index() == 1) {
       OnDownloadFinished(std::get<1>(mDataSource));
@@ -267,6 +427,8 @@ public:
     mDataSource = std::move(aNewValue);
   }
 
+  void SetExecutor(Executor aNewValue) { mExecutor = std::move(aNewValue); }
+
   void SetLink(std::string aNewValue)
   {
     auto& ref = mDataSource.emplace<AsyncDownload>();
@@ -280,9 +442,10 @@ private:
     auto it1 = mConnectionList.emplace(mConnectionList.end());
     auto it2 = mConnectionList.emplace(mConnectionList.end());
     task->File = std::move(aData);
+    task->Runner = mExecutor;
 
     *it1 = task->Failed.connect(
-      // The main loop will delete the signal.
+      // The executor will delete the signal.
       [this, it1, it2](std::string aMessage) {
         mConnectionList.erase(it1);
         mConnectionList.erase(it2);
@@ -291,7 +454,7 @@ private:
       });
 
     *it2 = task->Finished.connect(
-      // The main loop will delete the signal.
+      // The executor will delete the signal.
       [this, it1, it2](std::shared_ptr<SDL_Surface> aImage) {
         mConnectionList.erase(it1);
         mConnectionList.erase(it2);
@@ -341,6 +504,12 @@ AsyncImage::SetData(std::shared_ptr<std::istream> aNewValue)
   mPrivate->SetData(std::move(aNewValue));
 }
 
+void
+AsyncImage::SetExecutor(Executor aNewValue)
+{
+  mPrivate->SetExecutor(std::move(aNewValue));
+}
+
 void
 AsyncImage::SetLink(std::string aNewValue)
 {
@@ -356,30 +525,42 @@ class AsyncQuery::Private
   AsyncQuery& mParent;
   /// Used to disconnect from signal early when this object dies.
   std::list<sigc::connection> mConnectionList;
-  /// Location from which the image is loaded.
-  std::variant<AsyncDownload, std::shared_ptr<std::istream>> mDataSource;
+  /// Location from which the document is loaded.
+  std::variant<AsyncDownload, std::shared_ptr<std::istream>, ApiLazySet>
+    mDataSource;
   /// Error string if applicable.
   std::optional<std::string> mErrorMessage;
   /// Final data result if applicable.
   std::shared_ptr<ResultType> mResult;
+  /// Where the signals are emitted.
+  Executor mExecutor;
 
 public:
   explicit Private(AsyncQuery& aParent)
     : mParent(aParent)
+    , mExecutor(InvokeAsync)
   {}
 
   Private(AsyncQuery& aParent, std::shared_ptr<std::istream> aData)
     : mParent(aParent)
     , mDataSource(std::move(aData))
+    , mExecutor(InvokeAsync)
   {}
 
   Private(AsyncQuery& aParent, std::string aLink)
     : mParent(aParent)
     , mDataSource(std::in_place_type<AsyncDownload>)
+    , mExecutor(InvokeAsync)
   {
     std::get<AsyncDownload>(mDataSource).SetLink(std::move(aLink));
   }
 
+  Private(AsyncQuery& aParent, ApiLazySet aRow)
+    : mParent(aParent)
+    , mDataSource(std::move(aRow))
+    , mExecutor(InvokeAsync)
+  {}
+
   Private(const Private& aOther) = delete;
   Private& operator=(const Private& aOther) = delete;
 
@@ -421,9 +602,17 @@ public:
           OnDownloadFinished(aMode, std::move(aData));
         });
 
-      download.Enqueue();
+      // Progressive parsing can start before the download is done.
+      download.SetExecutor(mExecutor);
+      if (aMode == ProgressiveHome)
+        download.EnqueueStream();
+      else
+        download.Enqueue();
     } else if (mDataSource.index() == 1) {
       OnDownloadFinished(aMode, std::get<1>(mDataSource));
+    } else if (mDataSource.index() == 2) {
+      assert(aMode == LazyRow);
+      OnDownloadFinished(aMode, nullptr);
     }
   }
 
@@ -432,39 +621,56 @@ public:
     mDataSource = std::move(aNewValue);
   }
 
+  void SetExecutor(Executor aNewValue) { mExecutor = std::move(aNewValue); }
+
   void SetLink(std::string aNewValue)
   {
     auto& ref = mDataSource.emplace<AsyncDownload>();
     ref.SetLink(std::move(aNewValue));
   }
 
+  void SetRow(ApiLazySet aNewValue) { mDataSource = std::move(aNewValue); }
+
 private:
   void OnDownloadFinished(Mode aMode, std::shared_ptr<std::istream> aData)
   {
     auto task = std::make_unique<WorkerThread::QueryTask>();
     auto it1 = mConnectionList.emplace(mConnectionList.end());
     auto it2 = mConnectionList.emplace(mConnectionList.end());
+    auto it3 = mConnectionList.emplace(mConnectionList.end());
     task->File = std::move(aData);
     task->Mode = aMode;
+    task->Runner = mExecutor;
+
+    if (auto row = std::get_if<ApiLazySet>(&mDataSource))
+      task->Row = *row;
 
     *it1 = task->Failed.connect(
-      // The main loop will delete the signal.
-      [this, it1, it2](std::string aMessage) {
+      // The executor will delete the signal.
+      [this, it1, it2, it3](std::string aMessage) {
         mConnectionList.erase(it1);
         mConnectionList.erase(it2);
+        mConnectionList.erase(it3);
         mErrorMessage = std::move(aMessage);
         mParent.Failed(mErrorMessage.value());
       });
 
     *it2 = task->Finished.connect(
-      // The main loop will delete the signal.
-      [this, it1, it2](ResultType aBuffer) {
+      // The executor will delete the signal.
+      [this, it1, it2, it3](ResultType aBuffer) {
         mConnectionList.erase(it1);
         mConnectionList.erase(it2);
+        mConnectionList.erase(it3);
         mResult = std::make_shared<ResultType>(std::move(aBuffer));
         mParent.Finished(mResult);
       });
 
+    *it3 = task->Progress.connect(
+      // Only used for progressive parsing.
+      [this](ResultType aBuffer) {
+        mParent.Progress(std::make_shared<ResultType>(std::move(aBuffer)));
+      });
+
     gThread->Enqueue(std::move(task));
   }
 };
@@ -481,6 +687,10 @@ AsyncQuery::AsyncQuery(std::string aLink)
   : mPrivate(new Private(*this, std::move(aLink)))
 {}
 
+AsyncQuery::AsyncQuery(ApiLazySet aRow)
+  : mPrivate(new Private(*this, std::move(aRow)))
+{}
+
 AsyncQuery::~AsyncQuery() = default;
 
 const std::string&
@@ -507,8 +717,20 @@ AsyncQuery::SetData(std::shared_ptr<std::istream> aNewValue)
   mPrivate->SetData(std::move(aNewValue));
 }
 
+void
+AsyncQuery::SetExecutor(Executor aNewValue)
+{
+  mPrivate->SetExecutor(std::move(aNewValue));
+}
+
 void
 AsyncQuery::SetLink(std::string aNewValue)
 {
   mPrivate->SetLink(std::move(aNewValue));
 }
+
+void
+AsyncQuery::SetRow(ApiLazySet aNewValue)
+{
+  mPrivate->SetRow(std::move(aNewValue));
+}
@@ -6,6 +6,7 @@
  * \brief Asynchronous parsing operations.
  */
 
+#include <chrono>
 #include <istream>
 #include <memory>
 #include <string>
@@ -15,7 +16,13 @@
 #include <sigc++/sigc++.h>
 
 #include "Json.hpp"
+#include "Main.hpp"
 
+/**
+ * \brief Download (if needed) and decode an image in the background.
+ *
+ * The same thread rules as for \ref AsyncDownload apply.
+ */
 class AsyncImage
 {
   class Private;
@@ -38,9 +45,16 @@ public:
 
   void Enqueue();
   void SetData(std::shared_ptr<std::istream> aNewValue);
+  /// Emit the signals through this from now on (also for the download).
+  void SetExecutor(Executor aNewValue);
   void SetLink(std::string aNewValue);
 };
 
+/**
+ * \brief Download (if needed) and decode a web API document.
+ *
+ * The same thread rules as for \ref AsyncDownload apply.
+ */
 class AsyncQuery
 {
   class Private;
@@ -54,14 +68,27 @@ public:
   {
     Home,
     Dereference,
+    /**
+     * \brief Home screen where each row is emitted through \ref Progress.
+     *
+     * This runs on a thread of its own because it waits for the download.
+     */
+    ProgressiveHome,
+    /// Home screen where inline sets are left as \ref ApiLazySet.
+    LazyHome,
+    /// Decode a single \ref ApiLazySet given to the constructor.
+    LazyRow,
   };
 
   mutable sigc::signal<void(std::string)> Failed;
   mutable sigc::signal<void(std::shared_ptr<ResultType>)> Finished;
+  /// Partial home screen with a single container (progressive mode only).
+  mutable sigc::signal<void(std::shared_ptr<ResultType>)> Progress;
 
   AsyncQuery();
   explicit AsyncQuery(std::shared_ptr<std::istream> aData);
   explicit AsyncQuery(std::string aLink);
+  explicit AsyncQuery(ApiLazySet aRow);
 
   AsyncQuery(const AsyncQuery& aOther) = delete;
   AsyncQuery& operator=(const AsyncQuery& aOther) = delete;
@@ -72,12 +99,25 @@ public:
 
   void Enqueue(Mode aMode);
   void SetData(std::shared_ptr<std::istream> aNewValue);
+  /// Emit the signals through this from now on (also for the download).
+  void SetExecutor(Executor aNewValue);
   void SetLink(std::string aNewValue);
+  void SetRow(ApiLazySet aNewValue);
 };
 
 void
 InitWorker();
-void
-FreeWorker();
+/**
+ * \brief Drop the queued jobs and shut down the thread.
+ *
+ * The job that is running is allowed to finish; a thread that is still busy
+ * at the deadline is abandoned and false is returned (see \ref FreeNetwork).
+ */
+bool
+FreeWorker(std::chrono::steady_clock::time_point aDeadline);
+
+/// Images and queries that are queued or being decoded (thread-safe).
+size_t
+GetPendingTasks();
 
 #endif
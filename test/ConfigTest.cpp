@@ -0,0 +1,108 @@
+#include "Config.hpp"
+
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Test.hpp"
+
+namespace {
+
+const char* const gPath = "config-test.conf";
+
+/// Message of the error thrown by InitConfig (empty if it succeeded).
+std::string
+RunInit(std::vector<std::string> aArgs)
+{
+  std::vector<char*> argv;
+  aArgs.insert(aArgs.begin(), "test");
+  for (std::string& elem : aArgs)
+    argv.push_back(elem.data());
+
+  try {
+    InitConfig(static_cast<int>(argv.size()), argv.data());
+  } catch (const std::runtime_error& error) {
+    return error.what();
+  }
+
+  return std::string();
+}
+
+bool
+Contains(const std::string& aText, const std::string& aPart)
+{
+  return aText.find(aPart) != std::string::npos;
+}
+
+void
+WriteFile(const std::string& aText)
+{
+  std::ofstream output(gPath, std::ios::trunc);
+  output << aText;
+  CHECK(output.good());
+}
+
+}
+
+// These run before any value is accepted because InitConfig keeps them.
+TEST_CASE(config, errors)
+{
+  CHECK(Contains(RunInit({ "--set", "viewer.nothing=1" }), "Unknown"));
+  CHECK(Contains(RunInit({ "--set", "viewer.margin" }), "key=value"));
+  CHECK(Contains(RunInit({ "--set", "viewer.margin=0.9" }), "between"));
+  CHECK(Contains(RunInit({ "--set", "viewer.lazy_rows=maybe" }), "boolean"));
+  CHECK(Contains(RunInit({ "--set", "disk.threads=2.5" }), "not a number"));
+  CHECK(Contains(RunInit({ "--har" }), "needs a value"));
+
+  WriteFile("[viewer]\nmargin = 0.1\nsearch_limit\n");
+  CHECK(Contains(RunInit({ "--config", gPath }), ":3: Expected key"));
+}
+
+TEST_CASE(config, layers)
+{
+  WriteFile("# Comments and blank lines are skipped.\n"
+            "\n"
+            "[viewer]\n"
+            "margin = 0.05\n"
+            "search_limit = 12\n"
+            "; Keys with a dot ignore the section.\n"
+            "network.max_connections = 8\n");
+
+  CHECK(RunInit({ "--config", gPath, "--set", "viewer.margin=0.1", "--har",
+                  "out.har", "--lazy-rows" })
+          .empty());
+
+  std::shared_ptr<const Config> config = GetConfig();
+  CHECK(config->SearchLimit == 12);
+  CHECK(config->MaxConnections == 8);
+  CHECK(config->Margin == 0.1);
+  CHECK(config->HarPath == "out.har");
+  CHECK(config->LazyRows);
+  CHECK(config->ShutdownTimeout == Config().ShutdownTimeout);
+
+#ifdef SIGHUP
+  // Nothing happens without the signal.
+  WriteFile("viewer.search_limit = 20\nviewer.margin = 0.3\n");
+  UpdateConfig();
+  CHECK(GetConfig() == config);
+
+  // The command line still wins over the file.
+  std::raise(SIGHUP);
+  UpdateConfig();
+  CHECK(GetConfig()->SearchLimit == 20);
+  CHECK(GetConfig()->Margin == 0.1);
+  CHECK(GetConfig()->MaxConnections == Config().MaxConnections);
+
+  // A file with errors is ignored.
+  WriteFile("viewer.search_limit = many\n");
+  std::raise(SIGHUP);
+  UpdateConfig();
+  CHECK(GetConfig()->SearchLimit == 20);
+#endif
+
+  FreeConfig();
+  std::remove(gPath);
+}
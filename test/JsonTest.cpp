@@ -0,0 +1,225 @@
+#include "Json.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Metrics.hpp"
+#include "Test.hpp"
+
+namespace {
+
+/// Example documents in the doc directory and whether each is a home screen.
+const std::pair<const char*, bool> gExamples[] = {
+  { "home.json.example", true },
+  { "curated.json.example", false },
+  { "personalized.json.example", false },
+  { "trending.json.example", false },
+};
+
+/// Every backend that is compiled in.
+const JsonBackend gBackends[] = {
+  JsonBackend::RapidJson,
+#ifdef USE_SIMDJSON
+  JsonBackend::Simdjson,
+#endif
+};
+
+std::ifstream
+OpenExample(const std::string& aName)
+{
+  std::ifstream result(std::string(TEST_SOURCE_DIR) + "/doc/" + aName);
+  CHECK(result.is_open());
+  return result;
+}
+
+//===========================================================================//
+//=== Descriptions ==========================================================//
+//===========================================================================//
+
+// Every field is written out so two models can be compared as text, which
+// also shows where they differ.
+
+void
+Describe(std::ostream& aOutput, const ApiFuzzyText& aModel)
+{
+  aOutput << "text " << std::quoted(aModel.FullTitle) << ' '
+          << std::quoted(aModel.SlugTitle) << '\n';
+}
+
+void
+Describe(std::ostream& aOutput, const ApiFuzzySet& aModel)
+{
+  aOutput << "set " << aModel.SetId << ' ' << aModel.TotalCount << ' '
+          << aModel.PageOffset << ' ' << aModel.PageSize << '\n';
+  Describe(aOutput, aModel.Text);
+
+  for (const ApiFuzzyTile& tile : aModel.Tiles) {
+    Describe(aOutput, tile.Text);
+    for (const ApiImage& image : tile.TileImages)
+      aOutput << "image " << std::setprecision(9) << image.AspectRatio << ' '
+              << image.MasterWidth << ' ' << image.MasterHeight << ' '
+              << image.ResourceLink << '\n';
+  }
+
+  const ApiTileTable& table = aModel.Attributes;
+  for (size_t i = 0; i < table.GetCount(); ++i)
+    aOutput << "row " << int(table.Types[i]) << ' ' << int(table.Kids[i])
+            << ' ' << table.Regions[i] << ' ' << table.Years[i] << ' '
+            << int(table.Originals[i]) << '\n';
+}
+
+void
+Describe(std::ostream& aOutput, const ApiContainer& aModel)
+{
+  if (auto set = std::get_if<ApiFuzzySet>(&aModel)) {
+    Describe(aOutput, *set);
+  } else if (auto ref = std::get_if<ApiSetRef>(&aModel)) {
+    aOutput << "ref " << ref->ReferenceId << ' ' << ref->ReferenceType << '\n';
+    Describe(aOutput, ref->Text);
+  } else {
+    aOutput << "lazy\n";
+  }
+}
+
+void
+Describe(std::ostream& aOutput, const ApiHome& aModel)
+{
+  Describe(aOutput, aModel.Text);
+  for (const ApiContainer& elem : aModel.Containers)
+    Describe(aOutput, elem);
+}
+
+/// Parse and validate an example with one backend and describe the result.
+std::string
+ReadExample(const std::pair<const char*, bool>& aExample,
+            JsonBackend aBackend)
+{
+  std::ifstream input = OpenExample(aExample.first);
+  std::ostringstream result;
+
+  // Otherwise only the first backend would validate the example.
+  ClearValidationCache();
+
+  if (aExample.second)
+    Describe(result, ReadApiHome(input, aBackend));
+  else
+    Describe(result, ReadApiFuzzySet(input, aBackend));
+
+  return result.str();
+}
+
+bool
+Rejects(const char* aDocument, JsonBackend aBackend)
+{
+  try {
+    std::istringstream input(aDocument);
+    ReadApiFuzzySet(input, aBackend);
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+
+  return false;
+}
+
+}
+
+//===========================================================================//
+//=== Cases =================================================================//
+//===========================================================================//
+
+TEST_CASE(json, examples)
+{
+  int64_t hits = GetCounter("json.validation.hit");
+
+  for (JsonBackend backend : gBackends) {
+    ClearValidationCache();
+    std::ifstream input = OpenExample("home.json.example");
+    ApiHome home = ReadApiHome(input, backend);
+    CHECK(!home.Text.FullTitle.empty());
+    CHECK(home.Containers.size() > 1);
+
+    for (const auto& elem : gExamples) {
+      if (elem.second)
+        continue;
+
+      std::ifstream file = OpenExample(elem.first);
+      ApiFuzzySet set = ReadApiFuzzySet(file, backend);
+      CHECK(!set.Tiles.empty());
+      CHECK(set.Attributes.GetCount() == set.Tiles.size());
+    }
+  }
+
+  CHECK(GetCounter("json.validation.hit") == hits);
+}
+
+TEST_CASE(json, invalid)
+{
+  const char* const documents[] = {
+    "",
+    "{\"data\":",
+    "{\"data\": {}}",
+    "{\"data\": {\"CuratedSet\": {\"items\": 5}}}",
+  };
+
+  for (JsonBackend backend : gBackends)
+    for (const char* elem : documents)
+      CHECK(Rejects(elem, backend));
+}
+
+/// Every backend must produce the same models as RapidJSON.
+TEST_CASE(json, backends)
+{
+  int64_t hits = GetCounter("json.validation.hit");
+
+  for (const auto& elem : gExamples) {
+    std::string expected = ReadExample(elem, JsonBackend::RapidJson);
+    for (JsonBackend backend : gBackends)
+      CHECK(ReadExample(elem, backend) == expected);
+  }
+
+  CHECK(GetCounter("json.validation.hit") == hits);
+}
+
+TEST_CASE(json, progressive)
+{
+  std::ifstream input = OpenExample("home.json.example");
+  ApiHome expected = ReadApiHome(input, JsonBackend::RapidJson);
+
+  // The rows arrive through the callback instead.
+  std::ifstream stream = OpenExample("home.json.example");
+  std::vector<ApiContainer> rows;
+  ApiHome result = ReadApiHome(
+    stream, [&](ApiContainer aRow) { rows.push_back(std::move(aRow)); });
+  CHECK(result.Containers.empty());
+
+  result.Containers = std::move(rows);
+  std::ostringstream a, b;
+  Describe(a, expected);
+  Describe(b, result);
+  CHECK(a.str() == b.str());
+}
+
+TEST_CASE(json, lazy)
+{
+  std::ifstream input = OpenExample("home.json.example");
+  ApiHome expected = ReadApiHome(input, JsonBackend::RapidJson);
+
+  std::ifstream lazy = OpenExample("home.json.example");
+  ApiHome result = ReadLazyApiHome(lazy);
+  CHECK(result.Containers.size() == expected.Containers.size());
+
+  for (ApiContainer& elem : result.Containers)
+    if (auto row = std::get_if<ApiLazySet>(&elem))
+      elem = ReadApiFuzzySet(*row);
+
+  std::ostringstream a, b;
+  Describe(a, expected);
+  Describe(b, result);
+  CHECK(a.str() == b.str());
+}
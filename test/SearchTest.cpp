@@ -0,0 +1,175 @@
+#include "Search.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "Config.hpp"
+#include "Test.hpp"
+
+namespace {
+
+ApiFuzzySet
+MakeSet(const std::vector<std::string>& aTitles)
+{
+  ApiFuzzySet result;
+
+  for (const std::string& elem : aTitles) {
+    ApiFuzzyTile tile;
+    tile.Text.FullTitle = elem;
+    result.Tiles.push_back(tile);
+    result.Attributes.AppendEmpty();
+  }
+
+  return result;
+}
+
+std::vector<std::string>
+GetTitles(const ApiFuzzySet& aModel)
+{
+  std::vector<std::string> result;
+  for (const ApiFuzzyTile& elem : aModel.Tiles)
+    result.push_back(elem.Text.FullTitle);
+  return result;
+}
+
+/// Words made of random syllables so the grams are spread like real titles.
+std::string
+MakeWord(std::mt19937& aRandom)
+{
+  static const char* const syllables[] = {
+    "an", "ar", "be", "da", "el", "fro", "ka", "lo", "man", "mi",
+    "no", "or", "ra", "sa", "star", "te", "the", "to", "va", "zen",
+  };
+  std::uniform_int_distribution<size_t> pick(0, std::size(syllables) - 1);
+  std::uniform_int_distribution<int> length(1, 4);
+
+  std::string result;
+  for (int i = length(aRandom); i > 0; --i)
+    result += syllables[pick(aRandom)];
+
+  result[0] = static_cast<char>(result[0] - 'a' + 'A');
+  return result;
+}
+
+}
+
+TEST_CASE(search, substring)
+{
+  SearchIndex index;
+  index.Insert(MakeSet({ "The Mandalorian",
+                         "Star Wars: The Clone Wars",
+                         "Frozen",
+                         "Frozen II",
+                         "Toy Story" }));
+
+  CHECK(index.GetCount() == 5);
+  CHECK(GetTitles(index.Search("WARS", 10)) ==
+        std::vector<std::string>{ "Star Wars: The Clone Wars" });
+  CHECK(GetTitles(index.Search("the", 10)) ==
+        std::vector<std::string>({ "The Mandalorian",
+                                   "Star Wars: The Clone Wars" }));
+  CHECK(GetTitles(index.Search("Frozen", 1)) ==
+        std::vector<std::string>{ "Frozen" });
+  CHECK(GetTitles(index.Search("y", 10)) ==
+        std::vector<std::string>{ "Toy Story" });
+  CHECK(index.Search("zzz", 10).Tiles.empty());
+  CHECK(index.Search("", 10).Tiles.empty());
+  CHECK(index.Search("Frozen", 0).Tiles.empty());
+}
+
+TEST_CASE(search, gram_order)
+{
+  SearchIndex index;
+  index.Insert(MakeSet({ "abcxbcd", "xabcdx" }));
+
+  // Both grams of the query appear in the first title, but not together.
+  CHECK(GetTitles(index.Search("abcd", 10)) ==
+        std::vector<std::string>{ "xabcdx" });
+}
+
+TEST_CASE(search, duplicates)
+{
+  ApiFuzzySet model = MakeSet({ "Moana", "", "Encanto", "Moana" });
+  model.Attributes.Types[2] = ApiTileTable::Series;
+
+  SearchIndex index;
+  index.Insert(model);
+  index.Insert(model);
+  CHECK(index.GetCount() == 2);
+
+  // The attributes stay with the title they belong to.
+  ApiFuzzySet result = index.Search("canto", 10);
+  CHECK(result.Tiles.size() == 1);
+  CHECK(result.Attributes.GetCount() == 1);
+  CHECK(result.Attributes.Types[0] == ApiTileTable::Series);
+}
+
+TEST_CASE(search, home)
+{
+  ApiHome home;
+  home.Containers.push_back(MakeSet({ "Bluey" }));
+  home.Containers.push_back(ApiSetRef());
+  home.Containers.push_back(ApiLazySet());
+  home.Containers.push_back(MakeSet({ "Loki", "Bluey" }));
+
+  SearchIndex index;
+  index.Insert(home);
+  CHECK(index.GetCount() == 2);
+  CHECK(GetTitles(index.Search("l", 10)) ==
+        std::vector<std::string>({ "Bluey", "Loki" }));
+}
+
+TEST_CASE(search, speed)
+{
+  std::mt19937 random(117);
+  std::vector<std::string> titles;
+  std::unordered_set<std::string> seen;
+
+  while (titles.size() < 100000) {
+    std::string title = MakeWord(random);
+    for (int i = std::uniform_int_distribution<int>(0, 3)(random); i; --i)
+      title += ' ' + MakeWord(random);
+    if (seen.insert(title).second)
+      titles.push_back(title);
+  }
+
+  SearchIndex index;
+  index.Insert(MakeSet(titles));
+  CHECK(index.GetCount() == titles.size());
+
+  // Type words like the ones in the titles one letter at a time.
+  auto limit = static_cast<size_t>(Config().SearchLimit);
+  std::vector<double> times;
+
+  for (int i = 0; i < 100; ++i) {
+    std::string word = MakeWord(random);
+    for (size_t n = 1; n <= word.size(); ++n) {
+      auto start = std::chrono::steady_clock::now();
+      index.Search(std::string_view(word).substr(0, n), limit);
+      std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+      times.push_back(elapsed.count());
+    }
+  }
+
+  std::sort(times.begin(), times.end());
+  double median = times[times.size() / 2];
+  double high = times[times.size() * 99 / 100];
+  std::printf("%zu titles, %zu queries: median %.3f ms, p99 %.3f ms\n",
+              index.GetCount(),
+              times.size(),
+              median,
+              high);
+
+  // Shared machines are too noisy for a wall-clock target, so it is opt-in
+  // (and only holds for optimized builds).
+  if (std::getenv("TEST_TIMING"))
+    CHECK(high < 1.0);
+}
@@ -0,0 +1,119 @@
+#include "Table.hpp"
+
+#include <vector>
+
+#include "Test.hpp"
+
+namespace {
+
+struct Row
+{
+  ApiTileTable::Type Type;
+  ApiTileTable::KidsMode Kids;
+  const char* Region;
+  uint16_t Year;
+  bool Original;
+};
+
+ApiTileTable
+MakeTable(const std::vector<Row>& aRows)
+{
+  ApiTileTable result;
+
+  for (const Row& elem : aRows) {
+    result.Types.push_back(elem.Type);
+    result.Kids.push_back(elem.Kids);
+    result.Regions.push_back(PackRegion(elem.Region));
+    result.Years.push_back(elem.Year);
+    result.Originals.push_back(elem.Original);
+  }
+
+  return result;
+}
+
+const std::vector<Row> gRows = {
+  { ApiTileTable::Series, ApiTileTable::KidsIncluded, "US", 2019, true },
+  { ApiTileTable::Video, ApiTileTable::KidsExcluded, "US", 1977, false },
+  { ApiTileTable::Video, ApiTileTable::KidsIncluded, "GB", 2013, false },
+  { ApiTileTable::Collection, ApiTileTable::KidsUnknown, "", 0, false },
+  { ApiTileTable::Series, ApiTileTable::KidsExcluded, "US", 2019, true },
+};
+
+std::vector<uint32_t>
+Run(const ApiTileFilter& aFilter, ApiTileOrder aOrder)
+{
+  ApiTileTable table = MakeTable(gRows);
+  std::vector<uint8_t> mask;
+  std::vector<uint32_t> result;
+
+  FilterTiles(table, aFilter, mask);
+  CHECK(mask.size() == table.GetCount());
+  SortTiles(table, mask, aOrder, result);
+  return result;
+}
+
+}
+
+TEST_CASE(table, region)
+{
+  CHECK(PackRegion("US") == ('U' << 8 | 'S'));
+  CHECK(PackRegion("") == 0);
+  CHECK(PackRegion("USA") == 0);
+}
+
+TEST_CASE(table, append)
+{
+  ApiTileTable source = MakeTable(gRows);
+  ApiTileTable table;
+  table.Append(source, 2);
+  table.AppendEmpty();
+
+  CHECK(table.GetCount() == 2);
+  CHECK(table.Types[0] == ApiTileTable::Video);
+  CHECK(table.Years[0] == 2013);
+  CHECK(table.Types[1] == ApiTileTable::Other);
+  CHECK(table.Kids[1] == ApiTileTable::KidsUnknown);
+  CHECK(table.Regions[1] == 0);
+}
+
+TEST_CASE(table, filter)
+{
+  ApiTileFilter all;
+  CHECK(Run(all, ApiTileOrder::Original) ==
+        std::vector<uint32_t>({ 0, 1, 2, 3, 4 }));
+
+  ApiTileFilter series;
+  series.TypeMask = 1u << ApiTileTable::Series;
+  CHECK(Run(series, ApiTileOrder::Original) ==
+        std::vector<uint32_t>({ 0, 4 }));
+
+  // Unknown counts as excluded.
+  ApiTileFilter kids;
+  kids.KidsOnly = true;
+  CHECK(Run(kids, ApiTileOrder::Original) == std::vector<uint32_t>({ 0, 2 }));
+
+  ApiTileFilter combined;
+  combined.OriginalsOnly = true;
+  combined.Region = PackRegion("US");
+  combined.KidsOnly = true;
+  CHECK(Run(combined, ApiTileOrder::Original) == std::vector<uint32_t>{ 0 });
+
+  ApiTileFilter none;
+  none.TypeMask = 0;
+  CHECK(Run(none, ApiTileOrder::Original).empty());
+}
+
+TEST_CASE(table, sort)
+{
+  ApiTileFilter all;
+
+  // Ties keep their original order either way.
+  CHECK(Run(all, ApiTileOrder::Newest) ==
+        std::vector<uint32_t>({ 0, 4, 2, 1, 3 }));
+  CHECK(Run(all, ApiTileOrder::Oldest) ==
+        std::vector<uint32_t>({ 3, 1, 2, 0, 4 }));
+
+  ApiTileFilter videos;
+  videos.TypeMask = 1u << ApiTileTable::Video;
+  CHECK(Run(videos, ApiTileOrder::Newest) == std::vector<uint32_t>({ 2, 1 }));
+}
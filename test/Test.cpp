@@ -0,0 +1,92 @@
+#include "Test.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <vector>
+
+//===========================================================================//
+//=== Registry ==============================================================//
+//===========================================================================//
+
+namespace {
+
+struct TestEntry
+{
+  std::string Name;
+  void (*Function)();
+};
+
+/// Function-local so registration works in any order of initialization.
+std::vector<TestEntry>&
+GetTests()
+{
+  static std::vector<TestEntry> result;
+  return result;
+}
+
+std::string
+FormatFailure(const char* aFile, int aLine, const char* aCondition)
+{
+  return std::string(aFile) + ':' + std::to_string(aLine) + ": " + aCondition;
+}
+
+}
+
+TestFailure::TestFailure(const char* aFile, int aLine, const char* aCondition)
+  : std::runtime_error(FormatFailure(aFile, aLine, aCondition))
+{}
+
+bool
+RegisterTest(const char* aName, void (*aFunction)())
+{
+  GetTests().push_back({ aName, aFunction });
+  return true;
+}
+
+//===========================================================================//
+//=== Main ==================================================================//
+//===========================================================================//
+
+/// Run every case of the group given on the command line (or all of them).
+int
+main(int argc, char** argv)
+{
+  std::string prefix = (argc > 1) ? std::string(argv[1]) + '.' : "";
+  size_t count = 0;
+  size_t failed = 0;
+
+  for (const TestEntry& elem : GetTests()) {
+    if (elem.Name.compare(0, prefix.size(), prefix) != 0)
+      continue;
+
+    auto start = std::chrono::steady_clock::now();
+    std::string message;
+    count += 1;
+
+    try {
+      elem.Function();
+    } catch (const std::exception& error) {
+      message = error.what();
+    }
+
+    std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+    if (message.empty()) {
+      std::printf("PASS %s (%.1f ms)\n", elem.Name.c_str(), elapsed.count());
+    } else {
+      std::printf("FAIL %s: %s\n", elem.Name.c_str(), message.c_str());
+      failed += 1;
+    }
+  }
+
+  if (count == 0) {
+    std::printf("No tests match %s\n", prefix.c_str());
+    return 1;
+  }
+
+  std::printf("%zu of %zu passed\n", count - failed, count);
+  return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,37 @@
+#ifndef TEST_HPP
+#define TEST_HPP
+
+/**
+ * \file
+ * \brief Minimal test registry (the tests must not need extra libraries).
+ *
+ * Each case is named `group.name` and ctest runs one group per test. A failed
+ * check throws, which ends the current case and moves on to the next one.
+ */
+
+#include <stdexcept>
+
+/// Thrown by \ref CHECK when a condition does not hold.
+class TestFailure : public std::runtime_error
+{
+public:
+  TestFailure(const char* aFile, int aLine, const char* aCondition);
+};
+
+/// Add a case to the list that is run by main (at static initialization).
+bool
+RegisterTest(const char* aName, void (*aFunction)());
+
+#define TEST_CASE(aGroup, aName)                                              \
+  static void Test_##aGroup##_##aName();                                      \
+  static const bool Registered_##aGroup##_##aName =                           \
+    RegisterTest(#aGroup "." #aName, &Test_##aGroup##_##aName);               \
+  static void Test_##aGroup##_##aName()
+
+#define CHECK(aCondition)                                                     \
+  do {                                                                        \
+    if (!(aCondition))                                                        \
+      throw TestFailure(__FILE__, __LINE__, #aCondition);                     \
+  } while (false)
+
+#endif
@@ -0,0 +1,69 @@
+"""Crawl the mock server and check the report (usage: crawl_test.py PROGRAM).
+
+The mock server breaks one set and the images of one page, so the crawl must
+fail with exactly those in the report and everything else counted.
+"""
+
+import sys
+
+from mock_server import BROKEN_SET, MISSING_SET, PAGE_COUNT, Checks
+from mock_server import MockServer, run_crawl
+
+
+def main(program):
+    server = MockServer()
+    status, report, log = run_crawl(program, server.url,
+                                    "worker.threads=0")
+    checks = Checks()
+
+    checks.check(status == 1, "exit status is 1 (got %d)" % status)
+    checks.check(report is not None, "report is written")
+    if report is None:
+        print(log)
+        checks.exit()
+
+    counts = report["counts"]
+    failures = report["failures"]
+    broken = [elem for elem in failures if elem["kind"] == "set"]
+    missing = [elem for elem in failures if elem["kind"] == "image"]
+
+    checks.check(report["baseUrl"] == server.url, "base link")
+    checks.check(len(broken) == 1 and BROKEN_SET in broken[0]["link"],
+                 "the broken set fails")
+    checks.check(len(missing) > 0, "missing images fail")
+    checks.check(all("/img/%s/" % MISSING_SET[:8] in elem["link"] and
+                     elem["message"] == "404" for elem in missing),
+                 "only the images of the broken page fail")
+    checks.check(len(broken) + len(missing) == len(failures),
+                 "nothing else fails")
+    checks.check(counts["failures"] == len(failures), "failure count")
+
+    # The other pages of every set that loaded are requested (inline sets of
+    # the home screen count as sets as well).
+    checks.check(counts["sets"] > server.sets > 0, "sets are counted")
+    checks.check(server.pages >= (PAGE_COUNT - 1) * server.sets,
+                 "every page is requested")
+    checks.check(counts["pages"] == server.pages, "pages are counted")
+    checks.check(counts["images"] > 0 and counts["bytes"] > 0,
+                 "images are decoded")
+    checks.check(report["throughput"]["imagesPerSecond"] > 0, "throughput")
+
+    timings = report["timings"]
+    checks.check(timings["crawl.image"]["count"] ==
+                 counts["images"] + len(missing), "every image is timed")
+    checks.check("network.ttfb" in timings, "network phases")
+    checks.check(report["counters"].get("network.bytes", 0) > 0, "counters")
+
+    # A catalog without errors passes.
+    server = MockServer(broken=False)
+    status, report, _ = run_crawl(program, server.url)
+    checks.check(status == 0 and report is not None and
+                 not report["failures"], "a clean crawl exits with 0")
+
+    checks.exit()
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit("Usage: crawl_test.py PROGRAM")
+    main(sys.argv[1])
@@ -0,0 +1,75 @@
+"""Check that hedged downloads cut the tail (usage: hedge_test.py PROGRAM).
+
+The first request for one in 25 images stalls for a few seconds. Without
+hedging those stalls show up in the tail of the image times; with it, a
+second copy is requested once the first byte is late and wins the race.
+"""
+
+import sys
+
+from mock_server import Checks, MockServer, run_crawl
+
+STALL_EVERY = 25
+STALL = 3.0
+
+# Enough for the stalls and the transfers beyond the hedge percentile.
+BUDGET = 0.15
+
+
+def crawl(program, *settings):
+    server = MockServer(broken=False, stall_every=STALL_EVERY, stall=STALL)
+    status, report, log = run_crawl(program, server.url, *settings)
+    if report is None:
+        print(log)
+        sys.exit(1)
+
+    image = report["timings"]["crawl.image"]
+    print("%d of %d images stalled: p90 %.0f ms, p99 %.0f ms, max %.0f ms" %
+          (server.stalls, image["count"], image["p90"], image["p99"],
+           image["max"]))
+    return status, report, server
+
+
+def main(program):
+    checks = Checks()
+
+    status, report, server = crawl(program)
+    counters = report["counters"]
+    checks.check(status == 0, "the crawl without hedging succeeds")
+    checks.check(server.stalls * 100 > report["counts"]["images"],
+                 "more than 1% of the images stall")
+    checks.check(report["timings"]["crawl.image"]["p99"] >= STALL * 900,
+                 "the stalls are in the tail")
+    checks.check(counters.get("network.hedge.sent", 0) == 0,
+                 "nothing is hedged when it is off")
+
+    status, report, server = crawl(program, "network.hedging=true",
+                                   "network.hedge_budget=%g" % BUDGET)
+    counters = report["counters"]
+    sent = counters.get("network.hedge.sent", 0)
+    won = counters.get("network.hedge.won", 0)
+    lost = counters.get("network.hedge.lost", 0)
+    print("hedges: %d sent, %d won, %d lost, %d skipped" %
+          (sent, won, lost, counters.get("network.hedge.skipped", 0)))
+
+    checks.check(status == 0, "the crawl with hedging succeeds")
+    checks.check(sent > 0, "late transfers are hedged")
+    checks.check(won > 0, "hedges win against stalls")
+    checks.check(won + lost <= sent, "every race is counted once")
+    # Every transfer earns a share of a hedge, on top of a burst of 10.
+    counts = report["counts"]
+    transfers = counts["images"] + counts["sets"] + counts["pages"] + 1
+    checks.check(sent <= transfers * BUDGET + 10,
+                 "the budget caps the duplicates")
+    # Loose on purpose: the counters above show that hedging worked, this only
+    # shows that the stalls no longer make up the tail.
+    checks.check(report["timings"]["crawl.image"]["p99"] < STALL * 1000,
+                 "the tail is shorter than a stall")
+
+    checks.exit()
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit("Usage: hedge_test.py PROGRAM")
+    main(sys.argv[1])
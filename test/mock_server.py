@@ -0,0 +1,293 @@
+"""Local stand-in for the web API and the image servers.
+
+It serves the home screen from doc/home.json.example and every set from
+doc/curated.json.example, split into pages. The image links point back at the
+server, which answers them with a small PNG. A few things fail on purpose:
+
+- the set BROKEN_SET is not valid JSON
+- the images on the second page of MISSING_SET are 404
+
+Run it by hand to point the program at it:
+
+    $ python3 test/mock_server.py 8000
+    $ ./interview-disney-2020 --set network.base_url=http://127.0.0.1:8000
+
+The tests start it in a thread instead (see MockServer) and run the program
+with run_crawl.
+"""
+
+import http.server
+import json
+import os
+import socketserver
+import ssl
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.parse
+import zlib
+
+SOURCE_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Hosts of the image links in the examples.
+IMAGE_HOSTS = [
+    "https://prod-ripcut-delivery.disney-plus.net",
+    "https://vod-bgc-na-east-1.media.dssott.com",
+]
+
+BROKEN_SET = "bd1bfb9a-bbf7-43a0-ac5e-3e3889d7224d"
+MISSING_SET = "25b87551-fd19-421a-be0f-b7f2eea978b3"
+
+# Every set has this many pages of the example items.
+PAGE_COUNT = 3
+
+# Self-signed certificate for 127.0.0.1 (pass it as network.ca_file).
+CERT_FILE = os.path.join(SOURCE_DIR, "test", "localhost.crt")
+KEY_FILE = os.path.join(SOURCE_DIR, "test", "localhost.key")
+
+
+def make_png(width, height):
+    """Solid color RGB image."""
+
+    def chunk(kind, data):
+        crc = struct.pack(">I", zlib.crc32(kind + data))
+        return struct.pack(">I", len(data)) + kind + data + crc
+
+    header = struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0)
+    rows = b"".join(b"\x00" + b"\x20\x40\x80" * width for _ in range(height))
+    return (b"\x89PNG\r\n\x1a\n" + chunk(b"IHDR", header) +
+            chunk(b"IDAT", zlib.compress(rows)) + chunk(b"IEND", b""))
+
+
+def read_example(name):
+    with open(os.path.join(SOURCE_DIR, "doc", name), encoding="utf-8") as f:
+        return f.read()
+
+
+class MockServer:
+    """Serves the examples on 127.0.0.1 from a thread.
+
+    broken: whether BROKEN_SET and MISSING_SET fail.
+    delay: seconds before every other answer.
+    stall_every, stall: the first request for one in stall_every images waits
+    this many seconds before the answer (repeated requests do not).
+    die_after: the server dies (see kill) after this many requests.
+    tls: serve HTTPS with CERT_FILE instead of HTTP.
+    """
+
+    def __init__(self, port=0, broken=True, delay=0.0, stall_every=0,
+                 stall=0.0, die_after=0, tls=False):
+        self.broken = broken
+        self.delay = delay
+        self.stall_every = stall_every
+        self.stall = stall
+        self.die_after = die_after
+        self.dead = False
+        self.hits = 0
+        # Valid set documents served (first pages and later pages).
+        self.sets = 0
+        self.pages = 0
+        # Images whose first request stalled.
+        self.stalls = 0
+        # Whether each TLS connection resumed an earlier session.
+        self.resumed = []
+        self._lock = threading.Lock()
+        self._seen = set()
+        self._image = make_png(16, 9)
+
+        self._server = _Server(("127.0.0.1", port), _Handler)
+        self._server.mock = self
+        scheme = "http"
+        if tls:
+            context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+            context.load_cert_chain(CERT_FILE, KEY_FILE)
+            self._server.socket = context.wrap_socket(self._server.socket,
+                                                      server_side=True)
+            scheme = "https"
+        self.url = "%s://127.0.0.1:%d" % (scheme,
+                                          self._server.server_address[1])
+
+        home = read_example("home.json.example")
+        self._home = self._rewrite(home, "")
+        self._set = json.loads(read_example("curated.json.example"))
+        self._set = self._set["data"]["CuratedSet"]
+
+        self._thread = threading.Thread(target=self._server.serve_forever)
+        self._thread.daemon = True
+        self._thread.start()
+
+    def kill(self):
+        """Refuse new connections and drop the open ones from now on."""
+        self.dead = True
+        self._server.shutdown()
+        self._server.server_close()
+
+    def _rewrite(self, text, prefix):
+        for host in IMAGE_HOSTS:
+            text = text.replace(host, self.url + "/img" + prefix)
+        return text
+
+    def _stalls(self, path):
+        """Whether this is the first request for a stalling image."""
+        if not self.stall_every or not path.startswith("/img/"):
+            return False
+
+        with self._lock:
+            if path in self._seen:
+                return False
+            self._seen.add(path)
+            if zlib.crc32(path.encode()) % self.stall_every != 0:
+                return False
+            self.stalls += 1
+            return True
+
+    def get(self, path):
+        """Status, content type and body for a request."""
+        with self._lock:
+            self.hits += 1
+            if self.hits == self.die_after:
+                # The serving thread waits for this request to finish.
+                threading.Thread(target=self.kill, daemon=True).start()
+
+        if self._stalls(path):
+            time.sleep(self.stall)
+        elif self.delay:
+            time.sleep(self.delay)
+
+        link = urllib.parse.urlparse(path)
+        query = urllib.parse.parse_qs(link.query)
+
+        if link.path == "/home.json":
+            return 200, "application/json", self._home.encode()
+
+        if link.path.startswith("/sets/") and link.path.endswith(".json"):
+            set_id = link.path[len("/sets/"):-len(".json")]
+            if self.broken and set_id == BROKEN_SET:
+                return 200, "application/json", b'{"data": {'
+
+            items = self._set["items"]
+            offset = int(query.get("offset", ["0"])[0])
+            size = int(query.get("page_size", [str(len(items))])[0])
+            total = len(items) * PAGE_COUNT
+
+            page = dict(self._set)
+            page["setId"] = set_id
+            page["items"] = [items[(offset + i) % len(items)]
+                             for i in range(max(min(size, total - offset), 0))]
+            page["meta"] = {"hits": total, "offset": offset,
+                            "page_size": size}
+
+            with self._lock:
+                if "offset" in query:
+                    self.pages += 1
+                else:
+                    self.sets += 1
+
+            # Every page has images of its own.
+            text = json.dumps({"data": {"CuratedSet": page}})
+            text = self._rewrite(text, "/%s/%d" % (set_id[:8], offset))
+            return 200, "application/json", text.encode()
+
+        if link.path.startswith("/img/"):
+            second = len(self._set["items"])
+            missing = "/img/%s/%d/" % (MISSING_SET[:8], second)
+            if self.broken and link.path.startswith(missing):
+                return 404, "text/plain", b"Not found"
+            return 200, "image/png", self._image
+
+        return 404, "text/plain", b"Not found"
+
+
+class _Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    request_queue_size = 512
+
+    def handle_error(self, request, client_address):
+        # The program drops the connections it no longer needs (such as the
+        # loser of a hedged race) without waiting for the answer.
+        if not isinstance(sys.exc_info()[1], ConnectionError):
+            super().handle_error(request, client_address)
+
+
+class _Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        super().setup()
+        # The handshake is already done when the connection is accepted.
+        if isinstance(self.connection, ssl.SSLSocket):
+            mock = self.server.mock
+            with mock._lock:
+                mock.resumed.append(self.connection.session_reused)
+
+    def do_GET(self):
+        mock = self.server.mock
+        status, content_type, body = mock.get(self.path)
+
+        # The connections that were open when the server died.
+        if mock.dead:
+            self.close_connection = True
+            return
+
+        self.send_response(status)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, *args):
+        pass
+
+
+def run_crawl(program, base_url, *settings, timeout=300):
+    """Crawl with the program; returns the exit status, report and log.
+
+    settings are `key=value` strings for --set. The program runs in a
+    temporary directory so its cache files go away with it.
+    """
+    with tempfile.TemporaryDirectory() as directory:
+        report_path = os.path.join(directory, "report.json")
+        args = [os.path.abspath(program), "--crawl", report_path,
+                "--set", "network.base_url=" + base_url]
+        for elem in settings:
+            args += ["--set", elem]
+
+        result = subprocess.run(args, cwd=directory, timeout=timeout,
+                                stdout=subprocess.PIPE,
+                                stderr=subprocess.STDOUT,
+                                universal_newlines=True)
+        report = None
+        if os.path.exists(report_path):
+            with open(report_path, encoding="utf-8") as f:
+                report = json.load(f)
+
+        return result.returncode, report, result.stdout
+
+
+class Checks:
+    """Collects failed checks so every one of them is printed."""
+
+    def __init__(self):
+        self.failed = 0
+
+    def check(self, condition, message):
+        print("%s %s" % ("PASS" if condition else "FAIL", message))
+        if not condition:
+            self.failed += 1
+
+    def exit(self):
+        sys.exit(1 if self.failed else 0)
+
+
+if __name__ == "__main__":
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else 8000
+    server = MockServer(port)
+    print("Serving on " + server.url)
+    try:
+        while True:
+            time.sleep(3600)
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,71 @@
+"""Crawl three equivalent origins, one of which dies (usage: origin_test.py
+PROGRAM).
+
+The first origin is the fastest until it dies part of the way through, the
+second answers after 10 ms and the third after 200 ms. The requests must
+move to the fastest origin that is alive, fail over from the dead one
+without losing a transfer, and keep probing the others.
+"""
+
+import re
+import sys
+
+from mock_server import Checks, MockServer, run_crawl
+
+DIE_AFTER = 500
+
+
+def main(program):
+    fast = MockServer(broken=False, die_after=DIE_AFTER)
+    # Far apart so that their measurements cannot swap places.
+    medium = MockServer(broken=False, delay=0.01)
+    slow = MockServer(broken=False, delay=0.2)
+    origins = ",".join(elem.url for elem in (fast, medium, slow))
+
+    status, report, log = run_crawl(program, fast.url,
+                                    "network.origins=" + origins)
+    checks = Checks()
+
+    checks.check(status == 0, "exit status is 0 (got %d)" % status)
+    checks.check(report is not None, "report is written")
+    if report is None:
+        print(log)
+        checks.exit()
+
+    counters = report["counters"]
+    print("hits: %d fast, %d medium, %d slow" %
+          (fast.hits, medium.hits, slow.hits))
+    print("origins: %d probes, %d failures, %d failovers" %
+          (counters.get("network.origin.probes", 0),
+           counters.get("network.origin.failures", 0),
+           counters.get("network.origin.failovers", 0)))
+
+    checks.check(not report["failures"], "no transfer is lost")
+    checks.check(fast.dead and fast.hits >= DIE_AFTER,
+                 "the fast origin died")
+    checks.check(counters.get("network.origin.failures", 0) > 0,
+                 "the dead origin fails")
+    checks.check(counters.get("network.origin.failovers", 0) > 0,
+                 "its transfers move to another origin")
+    checks.check(counters.get("network.origin.probes", 0) > 0,
+                 "the other origins are probed")
+    checks.check(slow.hits > 0, "the slow origin is measured")
+    checks.check(medium.hits > slow.hits,
+                 "the medium origin takes most of the rest")
+
+    preferred = re.findall(r"Preferred origin: (\S+)", log)
+    checks.check(fast.url in preferred, "the fast origin is preferred")
+    # Probes may switch back and forth for a while, so this only asks that the
+    # medium origin is chosen after the last time the fast one was.
+    gone = max((i for i, url in enumerate(preferred) if url == fast.url),
+               default=len(preferred))
+    checks.check(medium.url in preferred[gone + 1:],
+                 "the medium origin is preferred once the fast one is gone")
+
+    checks.exit()
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit("Usage: origin_test.py PROGRAM")
+    main(sys.argv[1])
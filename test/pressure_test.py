@@ -0,0 +1,70 @@
+"""Replay memory pressure in the viewer (usage: pressure_test.py PROGRAM).
+
+The viewer shows the mock server until loading ahead is done; then
+test/pressure.txt raises every level of pressure and closes it. The counters
+that it prints on exit must show that textures and rows were given back. This needs a display, so the test is
+skipped without one.
+"""
+
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+from mock_server import SOURCE_DIR, Checks, MockServer
+
+# Tells CTest that the test was skipped (SKIP_RETURN_CODE).
+SKIPPED = 77
+
+
+def run_viewer(program, base_url, script, timeout=120):
+    """Run the program with a window; returns the exit status and log."""
+    with tempfile.TemporaryDirectory() as directory:
+        args = [os.path.abspath(program),
+                "--pressure-script", script,
+                "--set", "network.base_url=" + base_url]
+        result = subprocess.run(args, cwd=directory, timeout=timeout,
+                                stdout=subprocess.PIPE,
+                                stderr=subprocess.STDOUT,
+                                universal_newlines=True)
+        return result.returncode, result.stdout
+
+
+def main(program):
+    if sys.platform.startswith("linux") and not (
+            os.environ.get("DISPLAY") or os.environ.get("WAYLAND_DISPLAY")):
+        print("No display")
+        sys.exit(SKIPPED)
+
+    server = MockServer(broken=False)
+    script = os.path.join(SOURCE_DIR, "test", "pressure.txt")
+    status, log = run_viewer(program, server.url, script)
+    checks = Checks()
+
+    counters = {name: int(value) for name, value in
+                re.findall(r"^(?:INFO: )?([\w.]+): (\d+)$", log, re.M)}
+    print(" ".join("%s=%d" % elem for elem in sorted(counters.items())
+                   if elem[0].startswith(("pressure.", "viewer.shed."))))
+
+    checks.check(status == 0, "exit status is 0 (got %d)" % status)
+    if status != 0:
+        print(log)
+
+    for level in ("low", "medium", "critical"):
+        checks.check(counters.get("pressure." + level) == 1,
+                     "the %s level is replayed" % level)
+
+    checks.check(server.hits > 0, "the viewer loads the mock server")
+    checks.check(counters.get("viewer.shed.textures", 0) > 0,
+                 "textures below the screen are shed")
+    checks.check(counters.get("viewer.shed.rows", 0) > 0,
+                 "rows below the screen are shed")
+
+    checks.exit()
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit("Usage: pressure_test.py PROGRAM")
+    main(sys.argv[1])
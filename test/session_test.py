@@ -0,0 +1,59 @@
+"""Check that TLS sessions are resumed (usage: session_test.py PROGRAM).
+
+The mock server runs over HTTPS and records whether each connection resumed
+an earlier session. Within one crawl the connections share a session cache.
+A second crawl loads the sessions that the first one saved to
+network.session_file, so even its first connection resumes; that part is
+skipped when the CURL build cannot export sessions.
+"""
+
+import os
+import sys
+import tempfile
+
+from mock_server import CERT_FILE, Checks, MockServer, run_crawl
+
+# Logged at startup when sessions cannot be saved.
+NOT_PERSISTED = "TLS sessions are not persisted"
+
+
+def main(program):
+    checks = Checks()
+    server = MockServer(broken=False, tls=True)
+
+    with tempfile.TemporaryDirectory() as directory:
+        settings = ["network.ca_file=" + CERT_FILE,
+                    "network.session_file=" +
+                    os.path.join(directory, "sessions.txt")]
+
+        status, report, log = run_crawl(program, server.url, *settings)
+        first = list(server.resumed)
+        print("first crawl: %d of %d connections resumed" %
+              (sum(first), len(first)))
+
+        checks.check(status == 0, "the crawl over TLS succeeds")
+        if status != 0:
+            print(log)
+        checks.check(len(first) > 1, "several connections are opened")
+        checks.check(any(first[1:]), "later connections resume a session")
+
+        if NOT_PERSISTED in log:
+            print("SKIP restarts: this CURL build cannot export sessions")
+            checks.exit()
+
+        status, report, log = run_crawl(program, server.url, *settings)
+        second = server.resumed[len(first):]
+        print("second crawl: %d of %d connections resumed" %
+              (sum(second), len(second)))
+
+        checks.check(status == 0, "the second crawl succeeds")
+        checks.check(second[:1] == [True],
+                     "the first connection after a restart resumes")
+
+    checks.exit()
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit("Usage: session_test.py PROGRAM")
+    main(sys.argv[1])
@@ -0,0 +1,391 @@
+/**
+ * \file
+ * \brief Crawl the web API into an offline bundle (see app/Bundle.hpp).
+ *
+ * Usage: bundle-builder [--width N] OUTPUT SOURCE [BASE]
+ *
+ * SOURCE is the link prefix that serves `home.json` and `sets/<id>.json`: the
+ * live service, a local mock server or a `file://` mirror. The documents are
+ * stored under BASE instead (SOURCE by default) so that the bundle matches
+ * `network.base_url` of the kiosk. Paged sets are followed through every
+ * `?offset=` page until their `meta` reports the end, with the links that the
+ * viewer asks for. Every tile image of every set is added as well; `--width`
+ * changes the width parameter of their links first so the bundle holds copies
+ * of the size that is actually shown (the program finds them by their master
+ * ID).
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <curl/curl.h>
+#include <rapidjson/document.h>
+
+#include "Bundle.hpp"
+
+//===========================================================================//
+//=== Transfers =============================================================//
+//===========================================================================//
+
+namespace {
+
+/// Concurrent transfers while crawling.
+constexpr size_t Parallel = 16;
+
+size_t
+WriteProc(char* aData, size_t aSize, size_t aCount, void* aOutput)
+{
+  reinterpret_cast<std::string*>(aOutput)->append(aData, aSize * aCount);
+  return aSize * aCount;
+}
+
+/// Download every link; failed transfers are reported and left empty.
+std::vector<std::optional<std::string>>
+FetchAll(const std::vector<std::string>& aLinks)
+{
+  std::vector<std::optional<std::string>> result(aLinks.size());
+  std::vector<std::string> bodies(aLinks.size());
+  CURLM* multi = curl_multi_init();
+  size_t next = 0;
+  size_t done = 0;
+  int running = 0;
+
+  while (done < aLinks.size()) {
+    // Keep a fixed number of transfers in flight.
+    while (next < aLinks.size() && next - done < Parallel) {
+      CURL* easy = curl_easy_init();
+      curl_easy_setopt(easy, CURLOPT_URL, aLinks[next].c_str());
+      curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+      curl_easy_setopt(easy, CURLOPT_FAILONERROR, 1L);
+      curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, WriteProc);
+      curl_easy_setopt(easy, CURLOPT_WRITEDATA, &bodies[next]);
+      curl_easy_setopt(easy, CURLOPT_PRIVATE, reinterpret_cast<void*>(next));
+      curl_multi_add_handle(multi, easy);
+      next += 1;
+    }
+
+    curl_multi_perform(multi, &running);
+
+    int count;
+    while (CURLMsg* msg = curl_multi_info_read(multi, &count)) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      void* ptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &ptr);
+      size_t i = reinterpret_cast<size_t>(ptr);
+
+      if (msg->data.result == CURLE_OK)
+        result[i] = std::move(bodies[i]);
+      else
+        std::cerr << aLinks[i] << ": " << curl_easy_strerror(msg->data.result)
+                  << std::endl;
+
+      curl_multi_remove_handle(multi, msg->easy_handle);
+      curl_easy_cleanup(msg->easy_handle);
+      done += 1;
+    }
+
+    if (done < aLinks.size())
+      curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+  }
+
+  curl_multi_cleanup(multi);
+  return result;
+}
+
+}
+
+//===========================================================================//
+//=== Crawl =================================================================//
+//===========================================================================//
+
+namespace {
+
+struct Crawl
+{
+  /// Set IDs in the order they were found.
+  std::vector<std::string> SetIds;
+  std::set<std::string> SeenSets;
+  /// Path and set ID of the pages that follow the documents so far.
+  std::vector<std::pair<std::string, std::string>> Pages;
+  std::set<std::string> SeenPages;
+  /// Image link and master ID.
+  std::map<std::string, std::string> Images;
+};
+
+/// Queue the page after this one unless the set ends with it.
+void
+AddNextPage(const rapidjson::Value& aSet,
+            const rapidjson::Value& aMeta,
+            size_t aItems,
+            const std::string& aSetId,
+            Crawl& aCrawl)
+{
+  auto hits = aMeta.FindMember("hits");
+  auto offset = aMeta.FindMember("offset");
+  auto size = aMeta.FindMember("page_size");
+  if (hits == aMeta.MemberEnd() || !hits->value.IsUint64() ||
+      offset == aMeta.MemberEnd() || !offset->value.IsUint64() ||
+      size == aMeta.MemberEnd() || !size->value.IsUint64())
+    return;
+
+  uint64_t next = offset->value.GetUint64() + aItems;
+  uint64_t pageSize = size->value.GetUint64();
+  if (aItems == 0 || pageSize == 0 || next >= hits->value.GetUint64())
+    return;
+
+  // Same link as the viewer asks for (see LoadNextPage).
+  auto set = aSet.FindMember("setId");
+  std::string id = (set != aSet.MemberEnd() && set->value.IsString())
+                     ? set->value.GetString()
+                     : aSetId;
+  if (id.empty())
+    return;
+
+  std::string path = "/sets/" + id + ".json?offset=" + std::to_string(next) +
+                     "&page_size=" + std::to_string(pageSize);
+  // Servers that ignore the query would repeat the first page forever.
+  if (aCrawl.SeenPages.insert(path).second)
+    aCrawl.Pages.emplace_back(path, id);
+}
+
+/// Find the set references, the next pages and the tile images (under any
+/// `tile` key); sets without a `setId` of their own have `aSetId`.
+void
+Collect(const rapidjson::Value& aNode,
+        bool aInTile,
+        const std::string& aSetId,
+        Crawl& aCrawl)
+{
+  if (aNode.IsArray()) {
+    for (const auto& elem : aNode.GetArray())
+      Collect(elem, aInTile, aSetId, aCrawl);
+    return;
+  }
+
+  if (!aNode.IsObject())
+    return;
+
+  auto ref = aNode.FindMember("refId");
+  if (ref != aNode.MemberEnd() && ref->value.IsString()) {
+    std::string id = ref->value.GetString();
+    if (aCrawl.SeenSets.insert(id).second)
+      aCrawl.SetIds.push_back(id);
+  }
+
+  auto link = aNode.FindMember("url");
+  auto master = aNode.FindMember("masterId");
+  if (aInTile && link != aNode.MemberEnd() && link->value.IsString() &&
+      master != aNode.MemberEnd() && master->value.IsString())
+    aCrawl.Images.emplace(link->value.GetString(), master->value.GetString());
+
+  auto meta = aNode.FindMember("meta");
+  auto items = aNode.FindMember("items");
+  if (meta != aNode.MemberEnd() && meta->value.IsObject() &&
+      items != aNode.MemberEnd() && items->value.IsArray())
+    AddNextPage(aNode, meta->value, items->value.Size(), aSetId, aCrawl);
+
+  for (const auto& elem : aNode.GetObject()) {
+    bool tile = strcmp(elem.name.GetString(), "tile") == 0;
+    Collect(elem.value, aInTile || tile, aSetId, aCrawl);
+  }
+}
+
+void
+Parse(const std::string& aLink,
+      const std::string& aText,
+      const std::string& aSetId,
+      Crawl& aCrawl)
+{
+  rapidjson::Document doc;
+  doc.Parse(aText.data(), aText.size());
+
+  if (doc.HasParseError())
+    std::cerr << aLink << ": not valid JSON" << std::endl;
+  else
+    Collect(doc, false, aSetId, aCrawl);
+}
+
+/// Replace (or add) the width parameter of an image link.
+std::string
+Resize(const std::string& aLink, const std::string& aWidth)
+{
+  size_t query = aLink.find('?');
+  if (query == std::string::npos)
+    return aLink + "?width=" + aWidth;
+
+  for (size_t pos = query; pos != std::string::npos;
+       pos = aLink.find('&', pos + 1)) {
+    if (aLink.compare(pos + 1, 6, "width=") != 0)
+      continue;
+
+    size_t end = aLink.find('&', pos + 1);
+    return aLink.substr(0, pos + 7) + aWidth +
+           (end == std::string::npos ? std::string() : aLink.substr(end));
+  }
+
+  return aLink + "&width=" + aWidth;
+}
+
+}
+
+//===========================================================================//
+//=== Output ================================================================//
+//===========================================================================//
+
+namespace {
+
+struct Resource
+{
+  std::string Link;
+  std::string MasterId;
+  std::string Data;
+};
+
+void
+WriteBundle(const std::string& aPath, const std::vector<Resource>& aItems)
+{
+  std::ofstream output(aPath, std::ios_base::binary);
+  if (!output)
+    throw std::runtime_error("Cannot create " + aPath);
+
+  BundleHeader header;
+  memcpy(header.Magic, BundleMagic, sizeof(BundleMagic));
+  header.Version = BundleVersion;
+  header.Count = static_cast<uint32_t>(aItems.size());
+  header.IndexOffset = sizeof(header);
+  header.IndexSize = 0;
+
+  std::string index;
+  for (const Resource& item : aItems) {
+    BundleEntry entry;
+    entry.Offset = header.IndexOffset;
+    entry.Size = item.Data.size();
+    entry.LinkSize = static_cast<uint32_t>(item.Link.size());
+    entry.MasterIdSize = static_cast<uint32_t>(item.MasterId.size());
+    header.IndexOffset += entry.Size;
+
+    BundleEntry stored = BundleOrder(entry);
+    index.append(reinterpret_cast<const char*>(&stored), sizeof(stored));
+    index += item.Link;
+    index += item.MasterId;
+  }
+
+  header.IndexSize = index.size();
+  BundleHeader stored = BundleOrder(header);
+  output.write(reinterpret_cast<const char*>(&stored), sizeof(stored));
+  for (const Resource& item : aItems)
+    output.write(item.Data.data(), item.Data.size());
+  output.write(index.data(), index.size());
+
+  if (!output.flush())
+    throw std::runtime_error("Cannot write " + aPath);
+}
+
+}
+
+int
+main(int argc, char** argv)
+{
+  std::vector<std::string> args(argv + 1, argv + argc);
+  std::optional<std::string> width;
+
+  if (args.size() >= 2 && args[0] == "--width") {
+    width = args[1];
+    args.erase(args.begin(), args.begin() + 2);
+  }
+
+  if (args.size() < 2 || args.size() > 3) {
+    std::cerr << "Usage: " << argv[0] << " [--width N] OUTPUT SOURCE [BASE]"
+              << std::endl;
+    return 1;
+  }
+
+  const std::string& source = args[1];
+  const std::string& base = (args.size() == 3) ? args[2] : args[1];
+  std::vector<Resource> items;
+  Crawl crawl;
+
+  curl_global_init(CURL_GLOBAL_ALL);
+
+  auto home = FetchAll({ source + "/home.json" });
+  if (!home[0]) {
+    std::cerr << "Cannot download the home screen" << std::endl;
+    return 1;
+  }
+
+  Parse(source + "/home.json", home[0].value(), "", crawl);
+  items.push_back({ base + "/home.json", "", std::move(home[0].value()) });
+
+  // A page is only known once the one before it is in, so the documents are
+  // fetched in rounds: every new set and the next page of every paged set.
+  size_t sets = 0;
+  std::vector<std::string> links;
+
+  while (sets < crawl.SetIds.size() || !crawl.Pages.empty()) {
+    std::vector<std::pair<std::string, std::string>> round;
+    round.swap(crawl.Pages);
+    for (; sets < crawl.SetIds.size(); ++sets) {
+      const std::string& id = crawl.SetIds[sets];
+      round.emplace_back("/sets/" + id + ".json", id);
+    }
+
+    links.clear();
+    for (const auto& [path, id] : round)
+      links.push_back(source + path);
+
+    auto documents = FetchAll(links);
+    for (size_t i = 0; i < round.size(); ++i)
+      if (documents[i]) {
+        const auto& [path, id] = round[i];
+        Parse(links[i], documents[i].value(), id, crawl);
+        items.push_back({ base + path, "", std::move(documents[i].value()) });
+      }
+  }
+
+  size_t pages = crawl.SeenPages.size();
+
+  // Once the width is fixed, every link of a master gives the same copy. Only
+  // one is stored and the program finds it by the master ID for the others.
+  std::map<std::string, std::string> unique;
+  std::set<std::string> masters;
+  for (const auto& elem : crawl.Images)
+    if (!width || masters.insert(elem.second).second)
+      unique.insert(elem);
+
+  links.clear();
+  for (const auto& [link, master] : unique)
+    links.push_back(width ? Resize(link, width.value()) : link);
+
+  auto images = FetchAll(links);
+  size_t i = 0;
+  for (const auto& [link, master] : unique) {
+    if (images[i])
+      items.push_back({ link, master, std::move(images[i].value()) });
+    i += 1;
+  }
+
+  curl_global_cleanup();
+
+  try {
+    WriteBundle(args[0], items);
+  } catch (const std::exception& error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+  }
+
+  std::cout << items.size() << " resources (" << sets << " sets, " << pages
+            << " pages, " << unique.size() << " images)" << std::endl;
+  return 0;
+}
@@ -0,0 +1,130 @@
+/**
+ * \file
+ * \brief Measure the parse throughput of every JSON backend (see app/Json.hpp).
+ *
+ * Usage: json-bench FILE...
+ *
+ * Each FILE is a home screen or a set from the web API, such as the examples
+ * in `doc`. Every backend that is compiled in parses it from memory again and
+ * again for about a second, including validation and decoding into the model,
+ * and the throughput is printed in GB/s. The validation cache is cleared
+ * before every pass, so each one runs the validators.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Json.hpp"
+#include "Metrics.hpp"
+
+namespace {
+
+/// Time spent on each backend and file.
+constexpr std::chrono::seconds BenchDuration(1);
+
+/// Every backend that is compiled in.
+const std::pair<JsonBackend, const char*> gBackends[] = {
+  { JsonBackend::RapidJson, "rapidjson" },
+#ifdef USE_SIMDJSON
+  { JsonBackend::Simdjson, "simdjson" },
+#endif
+};
+
+std::string
+ReadFile(const std::string& aPath)
+{
+  std::ifstream input(aPath, std::ios::binary);
+  if (!input)
+    throw std::runtime_error("Cannot open " + aPath);
+
+  std::ostringstream oss;
+  oss << input.rdbuf();
+  return oss.str();
+}
+
+/// Parse the document once as a home screen or a set, whichever it is.
+void
+Parse(std::istream& aInput, bool aHome, JsonBackend aBackend)
+{
+  if (aHome)
+    ReadApiHome(aInput, aBackend);
+  else
+    ReadApiFuzzySet(aInput, aBackend);
+}
+
+/// Throughput of one backend in GB/s.
+double
+Measure(const std::string& aPayload, bool aHome, JsonBackend aBackend)
+{
+  using Clock = std::chrono::steady_clock;
+  Clock::duration elapsed{};
+  size_t count = 0;
+
+  // The copy into the input stream and clearing the cache are not part of
+  // the parse.
+  while (elapsed < BenchDuration) {
+    std::istringstream input(aPayload);
+    ClearValidationCache();
+    auto start = Clock::now();
+    Parse(input, aHome, aBackend);
+    elapsed += Clock::now() - start;
+    count += 1;
+  }
+
+  std::chrono::duration<double> seconds = elapsed;
+  return aPayload.size() * count / seconds.count() / 1e9;
+}
+
+}
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " FILE..." << std::endl;
+    return 1;
+  }
+
+  for (int i = 1; i < argc; ++i) {
+    try {
+      std::string payload = ReadFile(argv[i]);
+
+      // The first pass also checks that the document is valid.
+      bool home = true;
+      try {
+        std::istringstream input(payload);
+        Parse(input, true, JsonBackend::RapidJson);
+      } catch (const std::runtime_error&) {
+        std::istringstream input(payload);
+        home = false;
+        Parse(input, false, JsonBackend::RapidJson);
+      }
+
+      std::printf("%s (%s, %.1f kB)\n",
+                  argv[i],
+                  home ? "home" : "set",
+                  payload.size() / 1e3);
+
+      for (const auto& [backend, name] : gBackends)
+        std::printf("  %-10s %6.3f GB/s\n",
+                    name,
+                    Measure(payload, home, backend));
+
+      // Every pass must have run the validators.
+      if (GetCounter("json.validation.hit") != 0)
+        throw std::runtime_error("The validation cache was used");
+    } catch (const std::exception& error) {
+      std::cerr << argv[i] << ": " << error.what() << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,838 @@
+/**
+ * \file
+ * \brief Translate the bundled JSON schemas into C++ validation functions.
+ *
+ * Usage: schema-compiler OUTPUT SCHEMA...
+ *
+ * Every schema node reachable from the given files becomes one function
+ * that walks a \c rapidjson::Value directly. Objects are checked with a
+ * single pass over their members, a switch on the key length and a bitset
+ * of the required fields. Anchored literal patterns become plain string
+ * comparisons. Only the keywords used by the bundled schemas are supported
+ * and anything else is rejected so validation never silently weakens.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+
+//===========================================================================//
+//=== Helpers ===============================================================//
+//===========================================================================//
+
+namespace {
+
+/// Error helpers and the accessors that hide the document library.
+const char* const Preamble = R"(// Generated from the JSON schemas; do not edit.
+
+#include "Schema.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <regex>
+
+namespace {
+
+[[maybe_unused]] bool
+Fail(SchemaError& aError, const char* aSchema, const char* aKeyword)
+{
+  aError.DocumentPointer.clear();
+  aError.SchemaPointer = aSchema;
+  aError.Keyword = aKeyword;
+  return false;
+}
+
+[[maybe_unused]] bool
+Nest(SchemaError& aError, std::string_view aKey)
+{
+  std::string token = "/";
+  for (char elem : aKey) {
+    if (elem == '~')
+      token += "~0";
+    else if (elem == '/')
+      token += "~1";
+    else
+      token += elem;
+  }
+  aError.DocumentPointer.insert(0, token);
+  return false;
+}
+
+[[maybe_unused]] bool
+Nest(SchemaError& aError, size_t aIndex)
+{
+  aError.DocumentPointer.insert(0, "/" + std::to_string(aIndex));
+  return false;
+}
+
+// RapidJSON
+
+[[maybe_unused]] bool
+IsObject(const rapidjson::Value& aValue)
+{
+  return aValue.IsObject();
+}
+
+[[maybe_unused]] bool
+IsArray(const rapidjson::Value& aValue)
+{
+  return aValue.IsArray();
+}
+
+[[maybe_unused]] bool
+IsString(const rapidjson::Value& aValue)
+{
+  return aValue.IsString();
+}
+
+[[maybe_unused]] bool
+IsNumber(const rapidjson::Value& aValue)
+{
+  return aValue.IsNumber();
+}
+
+[[maybe_unused]] bool
+IsBool(const rapidjson::Value& aValue)
+{
+  return aValue.IsBool();
+}
+
+[[maybe_unused]] bool
+IsNull(const rapidjson::Value& aValue)
+{
+  return aValue.IsNull();
+}
+
+[[maybe_unused]] bool
+IsInteger(const rapidjson::Value& aValue)
+{
+  return aValue.IsInt64() || aValue.IsUint64();
+}
+
+[[maybe_unused]] std::string_view
+GetText(const rapidjson::Value& aValue)
+{
+  return { aValue.GetString(), aValue.GetStringLength() };
+}
+
+[[maybe_unused]] auto
+GetMembers(const rapidjson::Value& aValue)
+{
+  return aValue.GetObject();
+}
+
+[[maybe_unused]] size_t
+GetMemberCount(const rapidjson::Value& aValue)
+{
+  return aValue.MemberCount();
+}
+
+[[maybe_unused]] auto
+GetItems(const rapidjson::Value& aValue)
+{
+  return aValue.GetArray();
+}
+
+[[maybe_unused]] std::string_view
+GetKey(const rapidjson::Value::Member& aMember)
+{
+  return GetText(aMember.name);
+}
+
+[[maybe_unused]] const rapidjson::Value&
+GetValue(const rapidjson::Value::Member& aMember)
+{
+  return aMember.value;
+}
+
+// simdjson
+
+#ifdef USE_SIMDJSON
+using Element = simdjson::dom::element;
+
+[[maybe_unused]] bool
+IsObject(const Element& aValue)
+{
+  return aValue.is_object();
+}
+
+[[maybe_unused]] bool
+IsArray(const Element& aValue)
+{
+  return aValue.is_array();
+}
+
+[[maybe_unused]] bool
+IsString(const Element& aValue)
+{
+  return aValue.is_string();
+}
+
+[[maybe_unused]] bool
+IsNumber(const Element& aValue)
+{
+  return aValue.is_number();
+}
+
+[[maybe_unused]] bool
+IsBool(const Element& aValue)
+{
+  return aValue.is_bool();
+}
+
+[[maybe_unused]] bool
+IsNull(const Element& aValue)
+{
+  return aValue.is_null();
+}
+
+[[maybe_unused]] bool
+IsInteger(const Element& aValue)
+{
+  return aValue.is_int64() || aValue.is_uint64();
+}
+
+[[maybe_unused]] std::string_view
+GetText(const Element& aValue)
+{
+  return aValue.get_string().value_unsafe();
+}
+
+[[maybe_unused]] simdjson::dom::object
+GetMembers(const Element& aValue)
+{
+  return aValue.get_object().value_unsafe();
+}
+
+[[maybe_unused]] size_t
+GetMemberCount(const Element& aValue)
+{
+  return aValue.get_object().value_unsafe().size();
+}
+
+[[maybe_unused]] simdjson::dom::array
+GetItems(const Element& aValue)
+{
+  return aValue.get_array().value_unsafe();
+}
+
+[[maybe_unused]] std::string_view
+GetKey(const simdjson::dom::key_value_pair& aMember)
+{
+  return aMember.key;
+}
+
+[[maybe_unused]] Element
+GetValue(const simdjson::dom::key_value_pair& aMember)
+{
+  return aMember.value;
+}
+#endif
+
+// Schemas
+
+)";
+
+/// Keywords that do not affect validation.
+const std::set<std::string> IgnoredKeywords = {
+  "$schema", "definitions", "description", "id", "title", "default",
+};
+
+std::string
+QuoteString(std::string_view aText)
+{
+  std::string result = "\"";
+
+  for (char elem : aText) {
+    auto byte = static_cast<unsigned char>(elem);
+
+    if (elem == '"' || elem == '\\') {
+      result += '\\';
+      result += elem;
+    } else if (byte < 0x20 || byte >= 0x7F) {
+      // Octal escapes cannot swallow the following characters.
+      char buffer[8];
+      std::snprintf(buffer, sizeof(buffer), "\\%03o", byte);
+      result += buffer;
+    } else {
+      result += elem;
+    }
+  }
+
+  return result + '"';
+}
+
+std::string
+GetBaseName(const std::string& aPath)
+{
+  size_t first = aPath.find_last_of("/\\");
+  return (first == std::string::npos) ? aPath : aPath.substr(first + 1);
+}
+
+/// Literal text of a pattern such as "^Text$" (none if it is not one).
+std::optional<std::string>
+GetLiteralPattern(std::string_view aPattern)
+{
+  if (aPattern.size() < 2)
+    return std::nullopt;
+  else if (aPattern.front() != '^' || aPattern.back() != '$')
+    return std::nullopt;
+
+  std::string_view inner = aPattern.substr(1, aPattern.size() - 2);
+  if (inner.find_first_of("\\.^$|?*+()[]{}") != std::string_view::npos)
+    return std::nullopt;
+
+  return std::string(inner);
+}
+
+}
+
+//===========================================================================//
+//=== Compiler ==============================================================//
+//===========================================================================//
+
+namespace {
+
+class Compiler
+{
+  struct Node
+  {
+    std::string File;
+    std::string Pointer;
+    const rapidjson::Value* Value;
+  };
+
+  /// Parsed schema files by base name.
+  std::map<std::string, rapidjson::Document> mFiles;
+  /// Function number of each node that was already requested.
+  std::map<std::string, size_t> mLookup;
+  /// Nodes in the order of their function numbers.
+  std::vector<Node> mNodes;
+  /// Function number of the root of each file.
+  std::map<std::string, size_t> mRoots;
+
+public:
+  Compiler() = default;
+  Compiler(const Compiler& aOther) = delete;
+  Compiler& operator=(const Compiler& aOther) = delete;
+
+  void Load(const std::string& aPath)
+  {
+    std::ifstream stream(aPath, std::ios::binary);
+    if (!stream)
+      throw std::runtime_error("Cannot open " + aPath);
+
+    rapidjson::IStreamWrapper wrapper(stream);
+    rapidjson::Document dom;
+
+    if (dom.ParseStream(wrapper).HasParseError())
+      throw std::runtime_error("Cannot parse " + aPath);
+
+    mFiles[GetBaseName(aPath)] = std::move(dom);
+  }
+
+  void Write(std::ostream& aStream)
+  {
+    for (const auto& [name, dom] : mFiles)
+      mRoots[name] = Request(name, "", 0);
+
+    // Functions request more nodes while they are generated.
+    std::ostringstream body;
+    for (size_t i = 0; i < mNodes.size(); ++i)
+      WriteFunction(body, i);
+
+    aStream << Preamble;
+
+    for (size_t i = 0; i < mNodes.size(); ++i)
+      aStream << "template<typename T>\n"
+              << "bool\n"
+              << "Validate" << i << "(const T& aValue, SchemaError& aError);\n";
+
+    aStream << "\n" << body.str() << "}\n\n";
+
+    aStream << "template<typename T>\n"
+            << "SchemaFunction<T>\n"
+            << "FindSchemaFunction(std::string_view aName)\n"
+            << "{\n";
+    for (const auto& [name, id] : mRoots)
+      aStream << "  if (aName == " << QuoteString(name) << ")\n"
+              << "    return Validate" << id << "<T>;\n";
+    aStream << "  return nullptr;\n"
+            << "}\n"
+            << "\n"
+            << "template SchemaFunction<rapidjson::Value>\n"
+            << "FindSchemaFunction(std::string_view aName);\n"
+            << "\n"
+            << "#ifdef USE_SIMDJSON\n"
+            << "template SchemaFunction<simdjson::dom::element>\n"
+            << "FindSchemaFunction(std::string_view aName);\n"
+            << "#endif\n";
+  }
+
+private:
+  /// Number of the function validating a node (following references).
+  size_t Request(const std::string& aFile,
+                 const std::string& aPointer,
+                 size_t aDepth)
+  {
+    if (aDepth > 32)
+      throw std::runtime_error("Reference loop at " + aFile + aPointer);
+
+    const rapidjson::Value& value = Resolve(aFile, aPointer);
+    if (!value.IsObject())
+      throw std::runtime_error("Not a schema: " + aFile + "#" + aPointer);
+
+    // Keywords next to a reference are ignored in draft-04.
+    auto ref = value.FindMember("$ref");
+    if (ref != value.MemberEnd()) {
+      std::string link(ref->value.GetString(), ref->value.GetStringLength());
+      size_t first = link.find_first_of('#');
+
+      std::string file = link.substr(0, first);
+      std::string pointer;
+      if (first != std::string::npos)
+        pointer = link.substr(first + 1);
+
+      return Request(file.empty() ? aFile : file, pointer, aDepth + 1);
+    }
+
+    std::string key = aFile + "#" + aPointer;
+    auto it = mLookup.find(key);
+    if (it != mLookup.end())
+      return it->second;
+
+    mLookup.emplace(key, mNodes.size());
+    mNodes.push_back({ aFile, aPointer, &value });
+    return mNodes.size() - 1;
+  }
+
+  const rapidjson::Value& Resolve(const std::string& aFile,
+                                  const std::string& aPointer)
+  {
+    auto file = mFiles.find(aFile);
+    if (file == mFiles.end())
+      throw std::runtime_error("Unknown schema file " + aFile);
+
+    const rapidjson::Value* current = &file->second;
+    size_t start = 0;
+
+    while (start < aPointer.size()) {
+      if (aPointer[start] != '/')
+        throw std::runtime_error("Bad pointer " + aPointer);
+
+      size_t end = aPointer.find('/', start + 1);
+      if (end == std::string::npos)
+        end = aPointer.size();
+
+      std::string token;
+      for (size_t i = start + 1; i < end; ++i) {
+        if (aPointer[i] == '~' && i + 1 < end) {
+          token += (aPointer[i + 1] == '1') ? '/' : '~';
+          ++i;
+        } else {
+          token += aPointer[i];
+        }
+      }
+
+      if (current->IsObject()) {
+        auto it = current->FindMember(token.c_str());
+        if (it == current->MemberEnd())
+          throw std::runtime_error("Missing " + aFile + "#" + aPointer);
+        current = &it->value;
+      } else if (current->IsArray()) {
+        size_t index = std::stoul(token);
+        if (index >= current->Size())
+          throw std::runtime_error("Missing " + aFile + "#" + aPointer);
+        current = &(*current)[static_cast<rapidjson::SizeType>(index)];
+      } else {
+        throw std::runtime_error("Missing " + aFile + "#" + aPointer);
+      }
+
+      start = end;
+    }
+
+    return *current;
+  }
+
+  void WriteFunction(std::ostream& aStream, size_t aId)
+  {
+    // Copy because requests grow the vector.
+    const Node node = mNodes[aId];
+    const rapidjson::Value& schema = *node.Value;
+    const std::string where = QuoteString(node.File + "#" + node.Pointer);
+
+    for (const auto& member : schema.GetObject()) {
+      std::string name = member.name.GetString();
+      if (IgnoredKeywords.count(name) == 0 &&
+          name != "type" && name != "properties" && name != "required" &&
+          name != "additionalProperties" && name != "minProperties" &&
+          name != "maxProperties" && name != "items" &&
+          name != "pattern" && name != "oneOf" && name != "anyOf" &&
+          name != "allOf")
+        throw std::runtime_error("Unsupported keyword " + name + " at " +
+                                 node.File + "#" + node.Pointer);
+    }
+
+    aStream << "/// " << node.File << "#" << node.Pointer << "\n"
+            << "template<typename T>\n"
+            << "bool\n"
+            << "Validate" << aId << "(const T& aValue, SchemaError& aError)\n"
+            << "{\n";
+
+    WriteType(aStream, schema, where);
+    WriteObject(aStream, schema, node, where);
+    WriteCount(aStream, schema, where);
+    WriteItems(aStream, schema, node);
+    WritePattern(aStream, schema, where);
+    WriteCombination(aStream, schema, node, where);
+
+    aStream << "  return true;\n"
+            << "}\n"
+            << "\n";
+  }
+
+  void WriteType(std::ostream& aStream,
+                 const rapidjson::Value& aSchema,
+                 const std::string& aWhere)
+  {
+    auto it = aSchema.FindMember("type");
+    if (it == aSchema.MemberEnd())
+      return;
+
+    std::vector<std::string> names;
+    if (it->value.IsArray())
+      for (const auto& elem : it->value.GetArray())
+        names.push_back(elem.GetString());
+    else
+      names.push_back(it->value.GetString());
+
+    std::string condition;
+    for (const std::string& name : names) {
+      if (!condition.empty())
+        condition += " || ";
+
+      if (name == "object")
+        condition += "IsObject(aValue)";
+      else if (name == "array")
+        condition += "IsArray(aValue)";
+      else if (name == "string")
+        condition += "IsString(aValue)";
+      else if (name == "number")
+        condition += "IsNumber(aValue)";
+      else if (name == "integer")
+        condition += "IsInteger(aValue)";
+      else if (name == "boolean")
+        condition += "IsBool(aValue)";
+      else if (name == "null")
+        condition += "IsNull(aValue)";
+      else
+        throw std::runtime_error("Unknown type " + name);
+    }
+
+    aStream << "  if (!(" << condition << "))\n"
+            << "    return Fail(aError, " << aWhere << ", \"type\");\n"
+            << "\n";
+  }
+
+  void WriteObject(std::ostream& aStream,
+                   const rapidjson::Value& aSchema,
+                   const Node& aNode,
+                   const std::string& aWhere)
+  {
+    auto properties = aSchema.FindMember("properties");
+    auto required = aSchema.FindMember("required");
+    auto additional = aSchema.FindMember("additionalProperties");
+
+    if (properties == aSchema.MemberEnd() &&
+        required == aSchema.MemberEnd() &&
+        additional == aSchema.MemberEnd())
+      return;
+
+    // Every key that needs a case: named properties and required fields.
+    struct Field
+    {
+      std::string Key;
+      std::optional<size_t> Function;
+      std::optional<size_t> Bit;
+    };
+    std::map<std::string, Field> fields;
+
+    if (properties != aSchema.MemberEnd())
+      for (const auto& member : properties->value.GetObject()) {
+        std::string key(member.name.GetString(),
+                        member.name.GetStringLength());
+        fields[key].Key = key;
+        fields[key].Function =
+          Request(aNode.File, aNode.Pointer + "/properties/" + Escape(key), 0);
+      }
+
+    size_t bits = 0;
+    if (required != aSchema.MemberEnd())
+      for (const auto& elem : required->value.GetArray()) {
+        std::string key(elem.GetString(), elem.GetStringLength());
+        fields[key].Key = key;
+        fields[key].Bit = bits++;
+      }
+
+    if (bits > 64)
+      throw std::runtime_error("Too many required fields at " + aNode.File +
+                               "#" + aNode.Pointer);
+
+    // Group the cases by the length of the key.
+    std::map<size_t, std::vector<const Field*>> cases;
+    for (const auto& [key, field] : fields)
+      cases[key.size()].push_back(&field);
+
+    aStream << "  if (IsObject(aValue)) {\n";
+    if (bits != 0)
+      aStream << "    uint64_t seen = 0;\n"
+              << "\n";
+
+    aStream << "    for (const auto& member : GetMembers(aValue)) {\n";
+
+    bool named =
+      additional != aSchema.MemberEnd() && additional->value.IsObject();
+    if (!cases.empty() || named)
+      aStream << "      std::string_view key = GetKey(member);\n";
+
+    if (!cases.empty()) {
+      aStream << "\n"
+              << "      switch (key.size()) {\n";
+
+      for (const auto& [length, list] : cases) {
+        aStream << "        case " << length << ":\n";
+
+        for (const Field* field : list) {
+          aStream << "          if (std::memcmp(key.data(), "
+                  << QuoteString(field->Key) << ", " << length
+                  << ") == 0) {\n";
+          if (field->Bit)
+            aStream << "            seen |= UINT64_C(1) << " << *field->Bit
+                    << ";\n";
+          if (field->Function)
+            aStream << "            if (!Validate" << *field->Function
+                    << "(GetValue(member), aError))\n"
+                    << "              return Nest(aError, key);\n"
+                    << "            continue;\n";
+          else
+            aStream << "            break;\n";
+          aStream << "          }\n";
+        }
+
+        aStream << "          break;\n";
+      }
+
+      aStream << "      }\n";
+    }
+
+    if (additional != aSchema.MemberEnd()) {
+      if (additional->value.IsFalse()) {
+        aStream << "\n"
+                << "      return Fail(aError, " << aWhere
+                << ", \"additionalProperties\");\n";
+      } else if (additional->value.IsObject()) {
+        size_t id = Request(
+          aNode.File, aNode.Pointer + "/additionalProperties", 0);
+        aStream << "\n"
+                << "      if (!Validate" << id
+                << "(GetValue(member), aError))\n"
+                << "        return Nest(aError, key);\n";
+      }
+    }
+
+    aStream << "    }\n";
+
+    if (bits != 0) {
+      uint64_t mask = (bits == 64) ? ~UINT64_C(0) : (UINT64_C(1) << bits) - 1;
+      aStream << "\n"
+              << "    if (seen != UINT64_C(" << mask << "))\n"
+              << "      return Fail(aError, " << aWhere
+              << ", \"required\");\n";
+    }
+
+    aStream << "  }\n"
+            << "\n";
+  }
+
+  void WriteCount(std::ostream& aStream,
+                  const rapidjson::Value& aSchema,
+                  const std::string& aWhere)
+  {
+    auto minimum = aSchema.FindMember("minProperties");
+    if (minimum != aSchema.MemberEnd())
+      aStream << "  if (IsObject(aValue) && GetMemberCount(aValue) < "
+              << minimum->value.GetUint() << ")\n"
+              << "    return Fail(aError, " << aWhere
+              << ", \"minProperties\");\n"
+              << "\n";
+
+    auto maximum = aSchema.FindMember("maxProperties");
+    if (maximum != aSchema.MemberEnd())
+      aStream << "  if (IsObject(aValue) && GetMemberCount(aValue) > "
+              << maximum->value.GetUint() << ")\n"
+              << "    return Fail(aError, " << aWhere
+              << ", \"maxProperties\");\n"
+              << "\n";
+  }
+
+  void WriteItems(std::ostream& aStream,
+                  const rapidjson::Value& aSchema,
+                  const Node& aNode)
+  {
+    auto items = aSchema.FindMember("items");
+    if (items == aSchema.MemberEnd())
+      return;
+    else if (!items->value.IsObject())
+      throw std::runtime_error("Tuple items are not supported at " +
+                               aNode.File + "#" + aNode.Pointer);
+
+    size_t id = Request(aNode.File, aNode.Pointer + "/items", 0);
+    aStream << "  if (IsArray(aValue)) {\n"
+            << "    size_t index = 0;\n"
+            << "    for (const auto& elem : GetItems(aValue)) {\n"
+            << "      if (!Validate" << id << "(elem, aError))\n"
+            << "        return Nest(aError, index);\n"
+            << "      index += 1;\n"
+            << "    }\n"
+            << "  }\n"
+            << "\n";
+  }
+
+  void WritePattern(std::ostream& aStream,
+                    const rapidjson::Value& aSchema,
+                    const std::string& aWhere)
+  {
+    auto pattern = aSchema.FindMember("pattern");
+    if (pattern == aSchema.MemberEnd())
+      return;
+
+    std::string text(pattern->value.GetString(),
+                     pattern->value.GetStringLength());
+
+    aStream << "  if (IsString(aValue)) {\n"
+            << "    std::string_view text = GetText(aValue);\n"
+            << "\n";
+
+    if (auto literal = GetLiteralPattern(text)) {
+      aStream << "    if (text.size() != " << literal->size()
+              << " || std::memcmp(text.data(), " << QuoteString(*literal)
+              << ", " << literal->size() << ") != 0)\n";
+    } else {
+      aStream << "    static const std::regex pattern(" << QuoteString(text)
+              << ");\n"
+              << "    if (!std::regex_search(text.begin(), text.end(), "
+              << "pattern))\n";
+    }
+
+    aStream << "      return Fail(aError, " << aWhere << ", \"pattern\");\n"
+            << "  }\n"
+            << "\n";
+  }
+
+  void WriteCombination(std::ostream& aStream,
+                        const rapidjson::Value& aSchema,
+                        const Node& aNode,
+                        const std::string& aWhere)
+  {
+    for (const char* keyword : { "allOf", "anyOf", "oneOf" }) {
+      auto it = aSchema.FindMember(keyword);
+      if (it == aSchema.MemberEnd())
+        continue;
+
+      std::vector<size_t> list;
+      for (rapidjson::SizeType i = 0; i < it->value.Size(); ++i)
+        list.push_back(Request(aNode.File,
+                               aNode.Pointer + "/" + keyword + "/" +
+                                 std::to_string(i),
+                               0));
+
+      std::string name = keyword;
+      if (name == "allOf") {
+        // The first failing branch is the most useful error.
+        for (size_t id : list)
+          aStream << "  if (!Validate" << id << "(aValue, aError))\n"
+                  << "    return false;\n";
+        aStream << "\n";
+        continue;
+      }
+
+      aStream << "  {\n"
+              << "    SchemaError ignored;\n"
+              << "    int matches = 0;\n";
+      for (size_t id : list)
+        aStream << "    matches += Validate" << id << "(aValue, ignored);\n";
+
+      if (name == "anyOf")
+        aStream << "    if (matches == 0)\n";
+      else
+        aStream << "    if (matches != 1)\n";
+
+      aStream << "      return Fail(aError, " << aWhere << ", "
+              << QuoteString(name) << ");\n"
+              << "  }\n"
+              << "\n";
+    }
+  }
+
+  static std::string Escape(const std::string& aKey)
+  {
+    std::string result;
+    for (char elem : aKey) {
+      if (elem == '~')
+        result += "~0";
+      else if (elem == '/')
+        result += "~1";
+      else
+        result += elem;
+    }
+    return result;
+  }
+};
+
+}
+
+//===========================================================================//
+//=== Main ==================================================================//
+//===========================================================================//
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " OUTPUT SCHEMA..." << std::endl;
+    return 1;
+  }
+
+  try {
+    Compiler compiler;
+    for (int i = 2; i < argc; ++i)
+      compiler.Load(argv[i]);
+
+    std::ostringstream oss;
+    compiler.Write(oss);
+
+    std::ofstream stream(argv[1], std::ios::binary);
+    stream << oss.str();
+
+    if (!stream)
+      throw std::runtime_error(std::string("Cannot write ") + argv[1]);
+  } catch (const std::exception& error) {
+    std::cerr << error.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}